@@ -0,0 +1,105 @@
+#pragma once
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	#include "windows.h"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+/**
+ * A file which is read and written asynchronously at explicit offsets.
+ * On linux the requests are submitted to an io_uring, if it is unavailable, or on other
+ * systems, they are run by a small pool of threads. The AUDIO_IO_BACKEND environment variable
+ * can be set to threads to always use the threads.
+ *
+ * Files opened for direct io bypass the page cache, which requires the buffers, sizes and
+ * offsets of every request to be multiples of direct_alignment. If the file system does not
+ * support direct io the file is opened normally and direct() returns false.
+ *
+ * An Async_File may only be used by one thread at a time.
+ */
+class Async_File {
+public:
+	enum class Mode {
+		read,
+		// creates or truncates the file
+		write
+	};
+
+	using Request = std::uint64_t;
+
+	static constexpr std::size_t direct_alignment = 4096;
+
+	Async_File(const std::filesystem::path& path, Mode mode, bool direct = false);
+	Async_File(const Async_File& other) = delete;
+
+	// waits for every outstanding request
+	~Async_File();
+
+	Async_File& operator=(const Async_File& other) = delete;
+
+	bool direct() const noexcept { return m_direct; }
+
+	// the name of the backend, io_uring or threads
+	const char* backend() const noexcept;
+
+	// starts reading up to size bytes at offset into buffer, fewer bytes are read at the end of the file
+	Request read(void* buffer, std::size_t size, std::uint64_t offset);
+
+	// starts writing size bytes from buffer at offset, the buffer must stay valid until the request completes
+	Request write(const void* buffer, std::size_t size, std::uint64_t offset);
+
+	/**
+	 * Waits for a request to complete and returns the number of bytes transferred.
+	 * Throws std::runtime_error if the request failed.
+	 */
+	std::size_t wait(Request request);
+
+	void wait_all();
+
+	// sets the size of the file, waiting for every outstanding request first
+	void truncate(std::uint64_t size);
+
+	struct Backend;
+
+private:
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+	#elif __APPLE__ || __linux__
+		int m_file = -1;
+	#endif
+	std::unique_ptr<Backend> m_backend;
+	bool m_direct = false;
+};
+
+/**
+ * Zeroed memory aligned to Async_File::direct_alignment, its size is rounded up to a
+ * multiple of the alignment so it can be used for direct io
+ */
+class Io_Buffer {
+public:
+	Io_Buffer() = default;
+	Io_Buffer(Io_Buffer&& other) noexcept;
+	explicit Io_Buffer(std::size_t size);
+	Io_Buffer(const Io_Buffer& other) = delete;
+
+	~Io_Buffer();
+
+	Io_Buffer& operator=(Io_Buffer&& other) noexcept;
+
+	char* data() noexcept { return m_data; }
+	const char* data() const noexcept { return m_data; }
+	std::size_t size() const noexcept { return m_size; }
+
+private:
+	char* m_data = nullptr;
+	std::size_t m_size = 0;
+};
+
+/**
+ * Returns true if direct io was requested by setting the AUDIO_DIRECT_IO environment variable to 1
+ */
+bool direct_io_requested();
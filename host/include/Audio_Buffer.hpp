@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Memory_Map.hpp"
+
+/**
+ * Planar audio with frames() samples in each of channels() channels.
+ * Every channel is stored in a single allocation, the channels start capacity() frames
+ * apart rounded up to 64 bytes so that each one is aligned to a cache line. New memory is
+ * zeroed by the system as it is first touched, so reserving space for padding costs nothing
+ * until it is used. Large allocations request transparent huge pages unless the
+ * AUDIO_HUGE_PAGES environment variable is set to 0.
+ *
+ * Audio read from a single channel 32 bit floating point file may instead refer directly to
+ * the mapped file. Mapped audio is read only, it is copied into its own allocation when it is resized.
+ */
+class Audio_Buffer {
+public:
+	// the alignment of every channel in bytes
+	static constexpr size_t alignment = 64;
+
+	Audio_Buffer() = default;
+	Audio_Buffer(Audio_Buffer&& other) noexcept;
+	Audio_Buffer(const Audio_Buffer& other) = delete;
+
+	// creates silent audio
+	Audio_Buffer(size_t channels, size_t frames);
+
+	// refers to frames samples at offset bytes into map, which must be aligned to a float
+	Audio_Buffer(Memory_Map map, size_t offset, size_t frames);
+
+	~Audio_Buffer();
+
+	Audio_Buffer& operator=(Audio_Buffer&& other) noexcept;
+
+	size_t channels() const noexcept { return m_channels; }
+	size_t frames() const noexcept { return m_frames; }
+	// the number of frames each channel can hold without reallocating
+	size_t capacity() const noexcept { return m_capacity; }
+
+	bool mapped() const noexcept { return m_mapped; }
+
+	const float* channel(size_t channel) const noexcept {
+		return m_mapped ? m_mapped : m_samples + channel*m_stride;
+	}
+
+	// throws std::logic_error if the audio is mapped
+	float* channel(size_t channel);
+
+	/**
+	 * Allocates space for at least channels channels of frames frames
+	 * so that resizing up to that size does not reallocate
+	 */
+	void reserve(size_t channels, size_t frames);
+
+	/**
+	 * Changes the number of channels and frames keeping the existing samples, new samples
+	 * are silent. Does nothing if the size is unchanged, so mapped audio is only copied when needed.
+	 */
+	void resize(size_t channels, size_t frames);
+
+private:
+	size_t m_channels = 0;
+	size_t m_frames = 0;
+
+	// the allocated number of channels and frames per channel
+	size_t m_channel_capacity = 0;
+	size_t m_capacity = 0;
+	// the distance between the starts of the channels in floats
+	size_t m_stride = 0;
+	float* m_samples = nullptr;
+	size_t m_bytes = 0;
+	// samples outside of the first m_used_frames frames of the first m_used_channels
+	// channels have never been written so they are still zero
+	size_t m_used_channels = 0;
+	size_t m_used_frames = 0;
+
+	Memory_Map m_map;
+	const float* m_mapped = nullptr;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Decides which buffer holds the output of each step of a processing graph.
+ * Steps may run concurrently as soon as the values they read have been computed, so a buffer
+ * is only written over or reused by a step which runs after every step reading its value,
+ * because it reads their outputs. Buffers which are not reused are freed once every step
+ * reading their value has run. Steps which may process in place write their output over
+ * their first input's value, each output only overwriting the channel read by the input of
+ * the same index.
+ *
+ * Values are numbered so that value 0 is the input audio, held in buffer 0, and value i+1 is
+ * the output of step i. The output of the last step is never released.
+ */
+class Buffer_Plan {
+public:
+	// a channel of a value
+	struct Channel {
+		size_t value;
+		size_t channel;
+	};
+
+	struct Step {
+		// the channel connected to each audio input, steps may only read earlier values
+		std::vector<Channel> inputs;
+		size_t outputs = 0;
+		// the outputs may point to the same samples as the inputs
+		bool inplace = false;
+	};
+
+	struct Allocation {
+		// the buffer holding the output
+		size_t buffer = 0;
+		// the output is written over the value read by the first input, which is in the same buffer
+		bool aliased = false;
+	};
+
+	// throws std::invalid_argument if a step reads a value which is not computed before it
+	explicit Buffer_Plan(const std::vector<Step>& steps);
+
+	const Allocation& step(size_t step) const noexcept { return m_steps[step]; }
+
+	// the buffer holding value
+	size_t buffer(size_t value) const noexcept { return m_value_buffers[value]; }
+
+	/**
+	 * True if the buffer of value should be freed once every step reading it has run,
+	 * or once it has been computed if no step reads it.
+	 * It is false for the result and for values whose buffer is written over or reused.
+	 */
+	bool freed(size_t value) const noexcept { return m_freed[value]; }
+
+	// the number of buffers used
+	size_t buffers() const noexcept { return m_buffers; }
+
+private:
+	std::vector<Allocation> m_steps;
+	std::vector<size_t> m_value_buffers;
+	std::vector<bool> m_freed;
+	size_t m_buffers = 1;
+};
@@ -29,6 +29,9 @@ public:
 
 	void* get_function_address(const char* symbol);
 
+	// returns nullptr instead of throwing if the library does not export symbol
+	void* find_function_address(const char* symbol) noexcept;
+
 	native_handle_type native_handle();
 
 	explicit operator bool() const noexcept;
@@ -0,0 +1,51 @@
+#pragma once
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	#include "windows.h"
+#elif __APPLE__ || __linux__
+	#include <sys/mman.h>
+#else
+	#error "Unkown compiler!"
+#endif
+
+#include <cstddef>
+#include <filesystem>
+
+/**
+ * A read only view of the contents of a file mapped into memory.
+ * Pages are loaded from the file as they are accessed, so mapping a file is cheap and
+ * sequential reads do not need a buffer of their own.
+ */
+class Memory_Map {
+public:
+	Memory_Map();
+	Memory_Map(Memory_Map&& other) noexcept;
+	explicit Memory_Map(const std::filesystem::path& path);
+	Memory_Map(const Memory_Map& other) = delete;
+
+	~Memory_Map();
+
+	Memory_Map& operator=(Memory_Map&& other) noexcept;
+
+	const char* data() const noexcept { return m_data; }
+	std::size_t size() const noexcept { return m_size; }
+
+	explicit operator bool() const noexcept { return m_data; }
+
+	/**
+	 * Hints that the size bytes at offset will not be read again soon so their pages can be
+	 * dropped, they are reloaded from the file if they are read again
+	 */
+	void discard(std::size_t offset, std::size_t size) const noexcept;
+
+	// starts loading the size bytes at offset in the background so they are ready when they are read
+	void prefetch(std::size_t offset, std::size_t size) const noexcept;
+
+private:
+	const char* m_data = nullptr;
+	std::size_t m_size = 0;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = nullptr;
+	#endif
+};
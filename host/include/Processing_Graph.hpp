@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "Audio_Buffer.hpp"
+#include "Buffer_Plan.hpp"
+#include "plugin.hpp"
+
+/**
+ * A directed acyclic graph of plugins, mixes and merges which processes audio in memory.
+ * Value 0 is the input audio and value i+1 is the output of node i, each node reads
+ * channels of earlier values. The output of the last node is the result.
+ *
+ * Nodes run on a Task_Graph as soon as the values they read have been computed, so
+ * independent branches run concurrently. Their buffers are allocated by a Buffer_Plan.
+ */
+class Processing_Graph {
+public:
+	using Channel = Buffer_Plan::Channel;
+
+	explicit Processing_Graph(size_t input_channels);
+	Processing_Graph(Processing_Graph&& other) = default;
+	Processing_Graph(const Processing_Graph& other) = delete;
+
+	Processing_Graph& operator=(const Processing_Graph& other) = delete;
+
+	// the number of channels of value
+	size_t channels(size_t value) const;
+
+	size_t nodes() const noexcept { return m_nodes.size(); }
+
+	// the plugin of node, nullptr for mixes and merges
+	Plugin* plugin(size_t node) noexcept { return m_nodes[node].plugin.get(); }
+
+	/**
+	 * Adds a node running plugin with inputs connected to each of its audio inputs and returns
+	 * its value. Throws std::invalid_argument if the inputs do not match the plugin's audio inputs.
+	 */
+	size_t add_plugin(std::unique_ptr<Plugin> plugin, std::vector<Channel> inputs);
+
+	// adds a node summing values, which must have the same number of channels, and returns its value
+	size_t add_mix(const std::vector<size_t>& values);
+
+	// adds a node holding the channels of each of values in order and returns its value
+	size_t add_merge(const std::vector<size_t>& values);
+
+	/**
+	 * Activates the plugins, which must be loaded, and plans the buffers.
+	 * Plugins without latency which support inplace processing write their output over their input.
+	 */
+	void activate(double sample_rate);
+
+	// the frames added to the input by the tails of the plugins, available once activated
+	size_t tail() const;
+
+	/**
+	 * The number of frames to reserve for input audio of frames frames, so that in place
+	 * nodes which lengthen it do not reallocate it. Available once activated.
+	 */
+	size_t reserved_frames(size_t frames) const;
+
+	/**
+	 * An upper bound of the memory held by the buffers while processing input of frames frames.
+	 * Available once activated.
+	 */
+	size_t peak_bytes(size_t frames) const;
+
+	/**
+	 * An estimate of peak_bytes before the graph is activated, when the tails and the nodes which
+	 * process in place are not known yet. Every node is given its own buffer and the tails are ignored.
+	 */
+	size_t estimated_peak_bytes(size_t frames) const;
+
+	/**
+	 * Processes input on up to n_threads threads, n_threads = 0 uses one thread per hardware
+	 * thread. Buffers are released as soon as every node reading them has run.
+	 */
+	Audio_Buffer run(Audio_Buffer input, size_t n_threads = 0);
+
+private:
+	struct Node {
+		enum class Type {
+			plugin,
+			mix,
+			merge
+		};
+
+		Type type;
+		std::unique_ptr<Plugin> plugin;
+		Buffer_Plan::Step step;
+	};
+
+	// runs node with the values it reads in buffers, frames holds the length of every value computed
+	void run_node(size_t node, std::vector<Audio_Buffer>& buffers, std::vector<size_t>& frames);
+
+	size_t m_input_channels;
+	std::vector<Node> m_nodes;
+
+	double m_sample_rate = 0;
+	std::unique_ptr<Buffer_Plan> m_plan;
+	// the tail of each plugin and the frames each value adds to the input
+	std::vector<size_t> m_tails;
+	std::vector<size_t> m_value_tails;
+};
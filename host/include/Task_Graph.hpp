@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * Tasks which each run once every task they depend on has completed.
+ * The tasks are run by a fixed number of threads which each keep a queue of the tasks made
+ * ready by the tasks they completed. A thread runs the most recently readied task in its own
+ * queue and steals the oldest task from the queue of another thread when its own is empty,
+ * so independent branches of the graph run concurrently.
+ */
+class Task_Graph {
+public:
+	// adds a task which runs after the tasks in dependencies and returns its index
+	size_t add(std::function<void()> task, const std::vector<size_t>& dependencies = {});
+
+	size_t size() const noexcept { return m_tasks.size(); }
+
+	/**
+	 * Runs every task on up to n_threads threads including the calling thread,
+	 * n_threads = 0 uses one thread per hardware thread.
+	 * If a task throws, the tasks which have not started are skipped and the first
+	 * exception is rethrown once the running tasks have completed.
+	 */
+	void run(size_t n_threads = 0);
+
+private:
+	struct Task {
+		std::function<void()> function;
+		size_t dependencies = 0;
+		std::vector<size_t> dependents;
+	};
+
+	std::vector<Task> m_tasks;
+};
@@ -1,11 +1,177 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <filesystem>
 
+#include "Async_File.hpp"
+#include "Audio_Buffer.hpp"
+#include "Memory_Map.hpp"
+#include "wav.hpp"
+
 struct Audio_Info {
 	double sample_rate;
+	// the format of the samples in the file, files can be written as pcm16, pcm24 or float32
+	Sample_Format format = Sample_Format::float32;
+	// adds triangular dither before samples are rounded when writing pcm
+	bool dither = false;
+};
+
+// the layouts of files holding wav chunks
+enum class Wav_Container {
+	// limited to 4 GB, written as rf64 if it grows larger
+	riff,
+	// riff with 64 bit sizes stored in a ds64 chunk
+	rf64,
+	// sony wave64, every chunk has a 64 bit size
+	wave64
+};
+
+/**
+ * Reads an audio file a block of frames at a time.
+ * Wav, rf64 and wave64 files are mapped into memory, so only the frames which are read are
+ * loaded from disk, the pages ahead of the frames being read are requested in the background.
+ * If direct io is requested with the AUDIO_DIRECT_IO environment variable the samples are
+ * instead read with large asynchronous requests which bypass the page cache. Large reads are
+ * decoded by several threads, AUDIO_THREADS sets their number.
+ */
+class Audio_Reader {
+public:
+	explicit Audio_Reader(const std::filesystem::path& path);
+
+	/**
+	 * Reads the format, channels and length of a file from its header without mapping it or
+	 * allocating buffers, so the memory needed to process it can be planned before it is opened
+	 */
+	static Wav_Layout probe(const std::filesystem::path& path);
+
+	// the memory held by the io buffers of a reader, which are only allocated for direct io
+	static size_t buffer_bytes();
+
+	const Audio_Info& info() const noexcept { return m_info; }
+	size_t channels() const noexcept { return m_channels; }
+	size_t frames() const noexcept { return m_frames; }
+	// the index of the next frame to be read
+	size_t position() const noexcept { return m_position; }
+
+	/**
+	 * Starts loading the next frames frames in the background without waiting for them,
+	 * so the file can be read ahead of being decoded
+	 */
+	void prefetch(size_t frames);
+
+	/**
+	 * Reads up to frames frames into the channels() arrays of channels
+	 * and returns the number of frames read, which is 0 at the end of the file
+	 */
+	size_t read(float* const* channels, size_t frames);
+
+	/**
+	 * Reads every remaining frame, single channel 32 bit floating point audio refers to the
+	 * mapped file instead of being copied unless direct io is used. No more frames can be read afterwards.
+	 */
+	Audio_Buffer read_all();
+
+	/**
+	 * Reads the remaining frames into audio with channels channels and frames frames.
+	 * Channels and frames past the end of the file are silent and are allocated along with the
+	 * audio, so padding does not copy the samples. Extra channels in the file are dropped and
+	 * frames past frames are not read.
+	 */
+	Audio_Buffer read_all(size_t channels, size_t frames);
+
+private:
+	// a block of the file read with direct io
+	struct Read_Block {
+		Io_Buffer buffer;
+		// the index of the block in the file, or SIZE_MAX if none was read
+		size_t index = SIZE_MAX;
+		Async_File::Request request = 0;
+	};
+
+	// converts frames frames starting at in, which points into the file data, into channels
+	void decode(const char* in, float* const* channels, size_t frames) const;
+	// returns the size bytes of the file at offset
+	const char* file_data(size_t offset, size_t size);
+	// waits for a block and requests the blocks following it
+	const char* load_block(size_t index);
+	void request_block(size_t index);
+
+	Audio_Info m_info;
+	size_t m_channels;
+	size_t m_frames;
+	size_t m_position = 0;
+
+	size_t m_sample_bytes;
+	size_t m_offset;
+	Memory_Map m_map;
+
+	// with direct io the samples are read into a ring of blocks ahead of being decoded,
+	// reads which cross a block boundary are gathered in m_straddle
+	size_t m_blocks_offset = 0;
+	std::vector<Read_Block> m_blocks;
+	std::vector<char> m_straddle;
+	std::unique_ptr<Async_File> m_file;
+};
+
+/**
+ * Writes an audio file a block of frames at a time.
+ * The header is written with the final sizes by finalize, or by the destructor if finalize
+ * was not called. The container is chosen by the extension, .w64 files are written as wave64,
+ * .rf64 files as rf64 and .wav files as riff, switching to rf64 if the data exceeds 4 GB.
+ * Encoded samples are gathered into large buffers which are written asynchronously at their
+ * offsets in the file while the following frames are encoded by several threads, with direct
+ * io if it was requested.
+ */
+class Audio_Writer {
+public:
+	Audio_Writer(const std::filesystem::path& path, size_t channels, const Audio_Info& info);
+	Audio_Writer(const Audio_Writer& other) = delete;
+
+	// the memory held by the io buffers of a writer
+	static size_t buffer_bytes();
+
+	~Audio_Writer();
+
+	size_t channels() const noexcept { return m_channels; }
+	// the number of frames written so far
+	size_t frames() const noexcept { return m_frames; }
+
+	// appends frames frames from the channels() arrays of channels
+	void write(const float* const* channels, size_t frames);
+
+	// writes the final sizes to the header and closes the file
+	void finalize();
+
+private:
+	/**
+	 * Encodes frames frames starting at frame first of channels into the buffers,
+	 * position bytes after the start of the current buffer
+	 */
+	void encode(const float* const* channels, size_t first, size_t frames, size_t position);
+	// appends size bytes to the output
+	void append(const char* data, size_t size);
+	// writes the first size bytes of the current buffer and moves to the next one
+	void flush(size_t size);
+
+	size_t m_channels;
+	size_t m_frames = 0;
+	Audio_Info m_info;
+	Wav_Container m_container;
+
+	// a full buffer is written while the next ones are filled
+	std::vector<Io_Buffer> m_buffers;
+	std::vector<Async_File::Request> m_requests;
+	size_t m_buffer = 0;
+	size_t m_filled = 0;
+	// the offset in the file of the current buffer
+	uint64_t m_buffer_offset = 0;
+	// a copy of the start of the file, so the header can be rewritten with aligned direct io
+	Io_Buffer m_first_block;
+	// declared last so outstanding writes finish before the buffers are released
+	std::unique_ptr<Async_File> m_file;
 };
 
-std::vector<std::vector<float>> read_audio_file(const std::filesystem::path& path, Audio_Info& info);
-void write_audio_file(const std::filesystem::path& path, const std::vector<std::vector<float>>& data, const Audio_Info& info);
+Audio_Buffer read_audio_file(const std::filesystem::path& path, Audio_Info& info);
+void write_audio_file(const std::filesystem::path& path, const Audio_Buffer& data, const Audio_Info& info);
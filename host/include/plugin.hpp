@@ -1,10 +1,12 @@
 #pragma once
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
 #include <filesystem>
 
 #include "api.h"
+#include "Audio_Buffer.hpp"
 #include "Dynamic_Library.hpp"
 
 struct Port {
@@ -17,7 +19,12 @@ struct Port {
 		/**
 		 * The parameter port is used to control the value of a plugin parameter
 		 */
-		parameter
+		parameter,
+		/**
+		 * The path port passes a file path as a null terminated string,
+		 * the plugin casts the port pointer to const char*
+		 */
+		path
 	};
 
 	enum Properties : int {
@@ -42,6 +49,9 @@ struct Port {
 	const float* value_arr;
 	float value = 0.5f;
 	bool automated = false;
+	// path specific options
+	std::string default_text;
+	std::string text;
 };
 
 inline Port::Properties operator&(Port::Properties lhs, Port::Properties rhs) {
@@ -85,8 +95,42 @@ struct Plugin {
 
 	// Plugin Binary
 
-	Dynamic_Library plugin_library;
-	Process_Function pfn_process;
+	// shared by the copies of the plugin
+	std::shared_ptr<Dynamic_Library> plugin_library;
+	// 1 for plugins which process the whole signal at once, 2 for plugins which process blocks
+	unsigned int api_version = 1;
+	Process_Function pfn_process = nullptr;
+	Instantiate_Function pfn_instantiate = nullptr;
+	Activate_Function pfn_activate = nullptr;
+	Process_Block_Function pfn_process_block = nullptr;
+	Deactivate_Function pfn_deactivate = nullptr;
+	Destroy_Function pfn_destroy = nullptr;
+	// optional, the latency and tail length are 0 if they are not exported
+	Latency_Function pfn_latency = nullptr;
+	Tail_Length_Function pfn_tail_length = nullptr;
+
+	// the instance of a version 2 plugin
+	void* instance = nullptr;
+	bool active = false;
+	size_t max_block_size = 0;
+	// the arrays for automatable parameters which are not automated, one block long
+	Audio_Buffer block_automation;
+
+	// the number of samples processed at once by run for version 2 plugins
+	static constexpr size_t default_block_size = 8192;
+
+	Plugin() = default;
+
+	/**
+	 * Copies the description, parameters and loaded binary of other without its instance,
+	 * so that copies of a loaded plugin can process audio concurrently
+	 */
+	Plugin(const Plugin& other);
+
+	Plugin& operator=(const Plugin& other) = delete;
+
+	// deactivates and destroys the instance
+	~Plugin();
 
 	// Member Functions
 
@@ -94,15 +138,60 @@ struct Plugin {
 
 	void set_parameter(const std::string& parameter_name, float new_value);
 
+	// Sets a parameter port from a string or a path port to the string
+	void set_parameter(const std::string& parameter_name, const std::string& new_value);
+
 	void reset_parameter(const std::string& parameter_name);
 
 	void set_automation(const std::string& parameter_name, const float* automation);
 
 	void clear_automation(const std::string& parameter_name);
 
+	/**
+	 * Loads the binary and finds the entry points it exports. Plugins which export
+	 * plugin_api_version 2 must export the block processing functions, plugins without it
+	 * are version 1 and must export process.
+	 */
 	void load_plugin();
 
-	void run(size_t n_samples, double sample_rate);
+	size_t audio_input_count() const;
+	size_t audio_output_count() const;
+
+	/**
+	 * Creates an instance of a version 2 plugin if there is none and activates it for blocks
+	 * of up to max_block_size samples. Does nothing for version 1 plugins or if it is already active.
+	 */
+	void activate(double sample_rate, size_t max_block_size);
+
+	// deactivates and destroys the instance of a version 2 plugin
+	void deactivate();
+
+	// the latency and tail length of the active instance, 0 for version 1 plugins
+	size_t latency() const;
+	size_t tail_length() const;
+
+	/**
+	 * Processes the next n_samples samples with the active instance, the audio ports are
+	 * connected to the arrays of inputs and outputs in order. Automated parameters are read
+	 * from position samples into their automation.
+	 */
+	void process_block(const float* const* inputs, float* const* outputs, size_t n_samples, size_t position);
+
+	/**
+	 * Connects the audio ports to the channels of input and output in order and runs the plugin
+	 * over every frame of input. output must have a channel for each output audio port and at
+	 * least as many frames as input, the frames past the end of input are silent input.
+	 * Version 2 plugins are run a block at a time and their output is shifted back by their
+	 * latency, so frames past the input hold the tail if output is long enough.
+	 */
+	void run(const Audio_Buffer& input, Audio_Buffer& output, double sample_rate);
+
+	/**
+	 * Runs the plugin with the audio inputs connected to input_frames frames of the arrays of
+	 * inputs and the audio outputs to output_frames frames of the arrays of outputs
+	 */
+	void run(const float* const* inputs, size_t input_frames,
+	         float* const* outputs, size_t output_frames, double sample_rate);
 
 	operator bool() const { return !path.empty(); };
 };
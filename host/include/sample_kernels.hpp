@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Kernels which convert between the sample formats stored in audio files and planar floats.
+ * The kernels are compiled once for each supported instruction set and the best set
+ * supported by the cpu is selected at runtime.
+ *
+ * Integer samples are little endian and scaled so that full scale is [-1, 1),
+ * so a 16 bit sample s becomes s/32768.
+ */
+struct Sample_Kernels {
+	const char* name;
+
+	// convert n samples to floats
+	void (*pcm16_to_float)(const char* in, float* out, std::size_t n);
+	void (*pcm24_to_float)(const char* in, float* out, std::size_t n);
+	void (*pcm32_to_float)(const char* in, float* out, std::size_t n);
+	void (*float64_to_float)(const char* in, float* out, std::size_t n);
+
+	/**
+	 * Scale n floats to the integer range, add dither[i] if dither is not null, then round
+	 * to the nearest integer and clamp. The dither is in units of the least significant bit.
+	 */
+	void (*float_to_pcm16)(const float* in, const float* dither, char* out, std::size_t n);
+	void (*float_to_pcm24)(const float* in, const float* dither, char* out, std::size_t n);
+
+	// split frames frames of channels interleaved channels into the arrays of out
+	void (*deinterleave)(const float* in, float* const* out, std::size_t channels, std::size_t frames);
+
+	// interleave frames frames from the channels arrays of in
+	void (*interleave)(const float* const* in, float* out, std::size_t channels, std::size_t frames);
+};
+
+extern const Sample_Kernels scalar_sample_kernels;
+#if defined(__x86_64__) || defined(__i386__)
+extern const Sample_Kernels sse4_sample_kernels;
+extern const Sample_Kernels avx2_sample_kernels;
+#endif
+
+/**
+ * Returns the fastest kernels supported by the cpu.
+ * The SAMPLE_KERNELS environment variable can be set to scalar, sse4 or avx2
+ * to force a specific set.
+ */
+const Sample_Kernels& sample_kernels();
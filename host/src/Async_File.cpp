@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if __APPLE__ || __linux__
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#if __linux__ && __has_include(<linux/io_uring.h>)
+		#include <linux/io_uring.h>
+		#include <sys/syscall.h>
+		// IORING_OP_READ and IORING_OP_WRITE were added along with IORING_FEAT_RW_CUR_POS
+		#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_FEAT_RW_CUR_POS)
+			#define HAVE_IO_URING
+		#endif
+	#endif
+#endif
+
+#include "Async_File.hpp"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	using Native_File = HANDLE;
+#elif __APPLE__ || __linux__
+	using Native_File = int;
+#endif
+
+using Request = Async_File::Request;
+
+enum class Operation {
+	read,
+	write
+};
+
+// the number of requests in flight at once, and the number of threads used without io_uring
+static constexpr unsigned queue_depth = 32;
+static constexpr unsigned io_threads = 4;
+
+// a single request transfers at most this many bytes, larger requests are split
+static constexpr size_t max_transfer = size_t(1) << 30;
+
+static std::runtime_error io_error(Operation op, int error) {
+	std::string message = op == Operation::read ? "failed to read file" : "failed to write file";
+	#if __APPLE__ || __linux__
+		message += std::string(": ") + std::strerror(error);
+	#else
+		(void) error;
+	#endif
+	return std::runtime_error(message);
+}
+
+struct Async_File::Backend {
+	struct Result {
+		Operation op;
+		size_t bytes = 0;
+		int error = 0;
+		bool done = false;
+	};
+
+	explicit Backend(Native_File file) : m_file(file) {}
+	virtual ~Backend() = default;
+
+	virtual const char* name() const noexcept = 0;
+	virtual Request submit(Operation op, char* buffer, size_t size, uint64_t offset) = 0;
+	virtual size_t wait(Request request) = 0;
+	virtual void wait_all() = 0;
+
+protected:
+	// removes a completed request, returning the bytes transferred or throwing its error
+	size_t finish(std::unordered_map<Request, Result>::iterator result) {
+		const Result finished = result->second;
+		m_results.erase(result);
+		if (finished.error) throw io_error(finished.op, finished.error);
+		return finished.bytes;
+	}
+
+	// removes every request once they have all completed and throws the first error
+	void finish_all() {
+		const auto failed = std::find_if(m_results.begin(), m_results.end(),
+		                                 [](const auto& result) { return result.second.error != 0; });
+		const Result first = failed != m_results.end() ? failed->second : Result{};
+		m_results.clear();
+		if (first.error) throw io_error(first.op, first.error);
+	}
+
+	Native_File m_file;
+	std::unordered_map<Request, Result> m_results;
+	Request m_next_request = 1;
+};
+
+using Result = Async_File::Backend::Result;
+
+/**
+ * Transfers size bytes at offset with blocking calls, stopping early at the end of the file
+ */
+static Result transfer(Native_File file, Operation op, char* buffer, size_t size, uint64_t offset) {
+	Result result{op};
+	while (result.bytes < size) {
+		const size_t chunk = std::min(size-result.bytes, max_transfer);
+		#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+			// the offset of an overlapped structure positions synchronous transfers too
+			OVERLAPPED position = {};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD count = 0;
+			const BOOL success = op == Operation::read
+				? ReadFile(file, buffer + result.bytes, static_cast<DWORD>(chunk), &count, &position)
+				: WriteFile(file, buffer + result.bytes, static_cast<DWORD>(chunk), &count, &position);
+			if (!success) {
+				if (GetLastError() != ERROR_HANDLE_EOF) result.error = static_cast<int>(GetLastError());
+				break;
+			}
+		#elif __APPLE__ || __linux__
+			const ssize_t count = op == Operation::read
+				? pread(file, buffer + result.bytes, chunk, static_cast<off_t>(offset))
+				: pwrite(file, buffer + result.bytes, chunk, static_cast<off_t>(offset));
+			if (count < 0) {
+				if (errno == EINTR) continue;
+				result.error = errno;
+				break;
+			}
+		#endif
+		if (count == 0 && op == Operation::write) result.error = EIO;
+		result.bytes += count;
+		offset += count;
+		// reads of regular files only return fewer bytes at the end of the file
+		if (static_cast<size_t>(count) < chunk) break;
+	}
+	return result;
+}
+
+/**
+ * Runs each request on one of a few threads with blocking calls
+ */
+class Thread_Backend final : public Async_File::Backend {
+public:
+	explicit Thread_Backend(Native_File file) : Backend(file) {
+		for (unsigned i = 0; i < io_threads; ++i)
+			m_workers.emplace_back(&Thread_Backend::worker_loop, this);
+	}
+
+	~Thread_Backend() override {
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_job_available.notify_all();
+		for (std::thread& worker : m_workers) worker.join();
+	}
+
+	const char* name() const noexcept override { return "threads"; }
+
+	Request submit(Operation op, char* buffer, size_t size, uint64_t offset) override {
+		std::lock_guard lock(m_mutex);
+		const Request request = m_next_request++;
+		m_results[request].op = op;
+		m_jobs.push_back({request, op, buffer, size, offset});
+		++m_pending;
+		m_job_available.notify_one();
+		return request;
+	}
+
+	size_t wait(Request request) override {
+		std::unique_lock lock(m_mutex);
+		const auto result = m_results.find(request);
+		if (result == m_results.end()) throw std::invalid_argument("unknown io request");
+		m_job_done.wait(lock, [&] { return result->second.done; });
+		return finish(result);
+	}
+
+	void wait_all() override {
+		std::unique_lock lock(m_mutex);
+		m_job_done.wait(lock, [&] { return m_pending == 0; });
+		finish_all();
+	}
+
+private:
+	struct Job {
+		Request request;
+		Operation op;
+		char* buffer;
+		size_t size;
+		uint64_t offset;
+	};
+
+	void worker_loop() {
+		std::unique_lock lock(m_mutex);
+		while (true) {
+			m_job_available.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+			if (m_jobs.empty()) return;
+			const Job job = m_jobs.front();
+			m_jobs.pop_front();
+
+			lock.unlock();
+			Result result = transfer(m_file, job.op, job.buffer, job.size, job.offset);
+			result.done = true;
+			lock.lock();
+
+			m_results[job.request] = result;
+			--m_pending;
+			m_job_done.notify_all();
+		}
+	}
+
+	std::vector<std::thread> m_workers;
+	std::deque<Job> m_jobs;
+	size_t m_pending = 0;
+	std::mutex m_mutex;
+	std::condition_variable m_job_available;
+	std::condition_variable m_job_done;
+	bool m_stop = false;
+};
+
+#ifdef HAVE_IO_URING
+
+/**
+ * Submits requests to an io_uring, the kernel completes them in the background without
+ * any threads of our own. The rings are shared with the kernel through mapped memory.
+ */
+class Uring_Backend final : public Async_File::Backend {
+public:
+	explicit Uring_Backend(Native_File file) : Backend(file) {
+		io_uring_params params = {};
+		m_ring = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &params));
+		if (m_ring < 0) throw std::runtime_error("io_uring is not available");
+		if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+			release();
+			throw std::runtime_error("io_uring does not support read and write requests");
+		}
+
+		m_sq_bytes = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+		m_cq_bytes = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+		const bool single_mapping = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (single_mapping) m_sq_bytes = m_cq_bytes = std::max(m_sq_bytes, m_cq_bytes);
+
+		m_sq = map(m_sq_bytes, IORING_OFF_SQ_RING);
+		m_cq = single_mapping ? m_sq : map(m_cq_bytes, IORING_OFF_CQ_RING);
+		m_sqe_bytes = params.sq_entries*sizeof(io_uring_sqe);
+		m_sqes = static_cast<io_uring_sqe*>(map(m_sqe_bytes, IORING_OFF_SQES));
+		if (!m_sq || !m_cq || !m_sqes) {
+			release();
+			throw std::runtime_error("unable to map io_uring");
+		}
+
+		char* sq = static_cast<char*>(m_sq);
+		char* cq = static_cast<char*>(m_cq);
+		m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		m_entries = params.sq_entries;
+	}
+
+	~Uring_Backend() override {
+		// the buffers of requests in flight must not be released before they complete
+		try {
+			while (m_in_flight) reap(true);
+		} catch (...) {}
+		release();
+	}
+
+	const char* name() const noexcept override { return "io_uring"; }
+
+	Request submit(Operation op, char* buffer, size_t size, uint64_t offset) override {
+		const Request request = m_next_request++;
+		m_results[request].op = op;
+		m_transfers[request] = {buffer, size, offset, 0};
+		queue(request);
+		return request;
+	}
+
+	size_t wait(Request request) override {
+		const auto result = m_results.find(request);
+		if (result == m_results.end()) throw std::invalid_argument("unknown io request");
+		while (!result->second.done) reap(true);
+		return finish(result);
+	}
+
+	void wait_all() override {
+		while (m_in_flight) reap(true);
+		finish_all();
+	}
+
+private:
+	// the part of a request which has not been transferred yet
+	struct Transfer {
+		char* buffer;
+		size_t size;
+		uint64_t offset;
+		size_t submitted;
+	};
+
+	void* map(size_t bytes, uint64_t offset) {
+		void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, offset);
+		return memory == MAP_FAILED ? nullptr : memory;
+	}
+
+	void release() noexcept {
+		if (m_sqes) munmap(m_sqes, m_sqe_bytes);
+		if (m_cq && m_cq != m_sq) munmap(m_cq, m_cq_bytes);
+		if (m_sq) munmap(m_sq, m_sq_bytes);
+		if (m_ring >= 0) close(m_ring);
+		m_sqes = nullptr;
+		m_sq = m_cq = nullptr;
+		m_ring = -1;
+	}
+
+	void enter(unsigned submit, unsigned complete, unsigned flags) {
+		while (syscall(__NR_io_uring_enter, m_ring, submit, complete, flags, nullptr, 0) < 0) {
+			if (errno != EINTR) throw std::runtime_error(std::string("io_uring failed: ") + std::strerror(errno));
+		}
+	}
+
+	// submits the remainder of a request
+	void queue(Request request) {
+		while (m_in_flight >= m_entries) reap(true);
+
+		Transfer& transfer = m_transfers[request];
+		transfer.submitted = std::min(transfer.size, max_transfer);
+
+		// only this thread adds entries, so the tail is read without synchronisation
+		const unsigned tail = *m_sq_tail;
+		const unsigned index = tail & m_sq_mask;
+		io_uring_sqe& entry = m_sqes[index];
+		std::memset(&entry, 0, sizeof(entry));
+		entry.opcode = m_results[request].op == Operation::read ? IORING_OP_READ : IORING_OP_WRITE;
+		entry.fd = m_file;
+		entry.addr = reinterpret_cast<uint64_t>(transfer.buffer);
+		entry.len = static_cast<uint32_t>(transfer.submitted);
+		entry.off = transfer.offset;
+		entry.user_data = request;
+		m_sq_array[index] = index;
+		__atomic_store_n(m_sq_tail, tail+1, __ATOMIC_RELEASE);
+		++m_in_flight;
+		enter(1, 0, 0);
+	}
+
+	// handles the completed requests, waiting for at least one if wait is true
+	void reap(bool wait) {
+		if (wait) enter(0, 1, IORING_ENTER_GETEVENTS);
+
+		std::vector<io_uring_cqe> completed;
+		unsigned head = *m_cq_head;
+		const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) completed.push_back(m_cqes[head & m_cq_mask]);
+		__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+		m_in_flight -= completed.size();
+
+		for (const io_uring_cqe& completion : completed) {
+			const Request request = completion.user_data;
+			Result& result = m_results[request];
+			Transfer& transfer = m_transfers[request];
+			if (completion.res == -EINTR || completion.res == -EAGAIN) {
+				queue(request);
+				continue;
+			}
+
+			if (completion.res < 0) result.error = -completion.res;
+			else if (completion.res == 0 && result.op == Operation::write) result.error = EIO;
+
+			const size_t count = std::max(completion.res, 0);
+			result.bytes += count;
+			// short reads only happen at the end of the file
+			if (!result.error && count < transfer.size && (result.op == Operation::write || count == transfer.submitted)) {
+				transfer.buffer += count;
+				transfer.size -= count;
+				transfer.offset += count;
+				queue(request);
+			} else {
+				result.done = true;
+				m_transfers.erase(request);
+			}
+		}
+	}
+
+	int m_ring = -1;
+	void* m_sq = nullptr;
+	void* m_cq = nullptr;
+	io_uring_sqe* m_sqes = nullptr;
+	size_t m_sq_bytes = 0, m_cq_bytes = 0, m_sqe_bytes = 0;
+
+	unsigned* m_sq_tail;
+	unsigned m_sq_mask;
+	unsigned* m_sq_array;
+	unsigned* m_cq_head;
+	unsigned* m_cq_tail;
+	unsigned m_cq_mask;
+	io_uring_cqe* m_cqes;
+	unsigned m_entries;
+
+	unsigned m_in_flight = 0;
+	std::unordered_map<Request, Transfer> m_transfers;
+};
+
+#endif
+
+/**
+ * Opens the file for direct io if requested and supported, direct is cleared if it is not
+ */
+static Native_File open_file(const std::filesystem::path& path, Async_File::Mode mode, bool& direct) {
+	const bool write = mode == Async_File::Mode::write;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		const DWORD access = write ? GENERIC_WRITE : GENERIC_READ;
+		const DWORD creation = write ? CREATE_ALWAYS : OPEN_EXISTING;
+		HANDLE file = INVALID_HANDLE_VALUE;
+		if (direct) {
+			file = CreateFileW(path.c_str(), access, FILE_SHARE_READ, nullptr, creation,
+			                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr);
+		}
+		if (file == INVALID_HANDLE_VALUE) {
+			direct = false;
+			file = CreateFileW(path.c_str(), access, FILE_SHARE_READ, nullptr, creation, FILE_ATTRIBUTE_NORMAL, nullptr);
+		}
+		if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("unable to open " + path.string());
+	#elif __APPLE__ || __linux__
+		const int flags = write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+		int file = -1;
+		#ifdef O_DIRECT
+			// file systems without direct io reject the flag
+			if (direct) file = open(path.c_str(), flags | O_DIRECT, 0666);
+		#endif
+		if (file < 0) {
+			#ifdef O_DIRECT
+				direct = false;
+			#endif
+			file = open(path.c_str(), flags, 0666);
+		}
+		if (file < 0) throw std::runtime_error("unable to open " + path.string());
+		#if __APPLE__
+			if (direct) direct = fcntl(file, F_NOCACHE, 1) != -1;
+		#endif
+	#endif
+	return file;
+}
+
+static void close_file(Native_File file) {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		CloseHandle(file);
+	#elif __APPLE__ || __linux__
+		close(file);
+	#endif
+}
+
+Async_File::Async_File(const std::filesystem::path& path, Mode mode, bool direct) : m_direct(direct) {
+	m_file = open_file(path, mode, m_direct);
+	try {
+		#ifdef HAVE_IO_URING
+			const char* setting = std::getenv("AUDIO_IO_BACKEND");
+			if (!setting || std::strcmp(setting, "threads") != 0) {
+				try {
+					m_backend = std::make_unique<Uring_Backend>(m_file);
+				} catch (const std::runtime_error&) {}
+			}
+		#endif
+		if (!m_backend) m_backend = std::make_unique<Thread_Backend>(m_file);
+	} catch (...) {
+		close_file(m_file);
+		throw;
+	}
+}
+
+Async_File::~Async_File() {
+	m_backend.reset();
+	close_file(m_file);
+}
+
+const char* Async_File::backend() const noexcept {
+	return m_backend->name();
+}
+
+Async_File::Request Async_File::read(void* buffer, std::size_t size, std::uint64_t offset) {
+	return m_backend->submit(Operation::read, static_cast<char*>(buffer), size, offset);
+}
+
+Async_File::Request Async_File::write(const void* buffer, std::size_t size, std::uint64_t offset) {
+	// the buffer is only read from
+	return m_backend->submit(Operation::write, static_cast<char*>(const_cast<void*>(buffer)), size, offset);
+}
+
+std::size_t Async_File::wait(Request request) {
+	return m_backend->wait(request);
+}
+
+void Async_File::wait_all() {
+	m_backend->wait_all();
+}
+
+void Async_File::truncate(std::uint64_t size) {
+	m_backend->wait_all();
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(size);
+		if (!SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+			throw std::runtime_error("failed to resize file");
+	#elif __APPLE__ || __linux__
+		if (ftruncate(m_file, static_cast<off_t>(size)))
+			throw std::runtime_error(std::string("failed to resize file: ") + std::strerror(errno));
+	#endif
+}
+
+bool direct_io_requested() {
+	static const bool requested = [] {
+		const char* setting = std::getenv("AUDIO_DIRECT_IO");
+		return setting && std::strcmp(setting, "1") == 0;
+	}();
+	return requested;
+}
+
+Io_Buffer::Io_Buffer(Io_Buffer&& other) noexcept {
+	*this = std::move(other);
+}
+
+Io_Buffer::Io_Buffer(std::size_t size)
+	: m_size((size + Async_File::direct_alignment - 1)/Async_File::direct_alignment*Async_File::direct_alignment) {
+	if (!m_size) return;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		// virtual allocations are page aligned and zeroed
+		m_data = static_cast<char*>(VirtualAlloc(nullptr, m_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+		if (!m_data) throw std::bad_alloc();
+	#elif __APPLE__ || __linux__
+		// mapped pages are zeroed as they are first touched, so the parts of the buffer which are never used cost nothing
+		void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED) throw std::bad_alloc();
+		m_data = static_cast<char*>(data);
+	#endif
+}
+
+Io_Buffer::~Io_Buffer() {
+	if (!m_data) return;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		VirtualFree(m_data, 0, MEM_RELEASE);
+	#elif __APPLE__ || __linux__
+		munmap(m_data, m_size);
+	#endif
+}
+
+Io_Buffer& Io_Buffer::operator=(Io_Buffer&& other) noexcept {
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	return *this;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#if __APPLE__ || __linux__
+	#include <sys/mman.h>
+#endif
+
+#include "Audio_Buffer.hpp"
+
+// allocations of at least this many bytes are mapped directly from the system
+static constexpr size_t large_allocation = size_t(1) << 20;
+// the size of a transparent huge page
+static constexpr size_t huge_page = size_t(2) << 20;
+
+static bool use_huge_pages() {
+	static const bool enabled = [] {
+		const char* setting = std::getenv("AUDIO_HUGE_PAGES");
+		return !setting || std::strcmp(setting, "0") != 0;
+	}();
+	return enabled;
+}
+
+// returns bytes zeroed bytes aligned to Audio_Buffer::alignment
+static float* allocate(size_t bytes) {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		void* memory = VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (!memory) throw std::bad_alloc();
+	#elif __APPLE__ || __linux__
+		void* memory;
+		if (bytes >= large_allocation) {
+			// anonymous mappings are zeroed a page at a time as they are first written
+			memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED) throw std::bad_alloc();
+			#ifdef MADV_HUGEPAGE
+				if (bytes >= huge_page && use_huge_pages()) madvise(memory, bytes, MADV_HUGEPAGE);
+			#endif
+		} else {
+			memory = std::aligned_alloc(Audio_Buffer::alignment, bytes);
+			if (!memory) throw std::bad_alloc();
+			std::memset(memory, 0, bytes);
+		}
+	#endif
+	return static_cast<float*>(memory);
+}
+
+static void deallocate(float* samples, size_t bytes) {
+	if (!samples) return;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		VirtualFree(samples, 0, MEM_RELEASE);
+	#elif __APPLE__ || __linux__
+		if (bytes >= large_allocation) munmap(samples, bytes);
+		else std::free(samples);
+	#endif
+}
+
+Audio_Buffer::Audio_Buffer(Audio_Buffer&& other) noexcept {
+	*this = std::move(other);
+}
+
+Audio_Buffer::Audio_Buffer(size_t channels, size_t frames) {
+	resize(channels, frames);
+}
+
+Audio_Buffer::Audio_Buffer(Memory_Map map, size_t offset, size_t frames)
+	: m_channels(1), m_frames(frames), m_map(std::move(map)),
+	  m_mapped(reinterpret_cast<const float*>(m_map.data() + offset)) {}
+
+Audio_Buffer::~Audio_Buffer() {
+	deallocate(m_samples, m_bytes);
+}
+
+Audio_Buffer& Audio_Buffer::operator=(Audio_Buffer&& other) noexcept {
+	std::swap(m_channels, other.m_channels);
+	std::swap(m_frames, other.m_frames);
+	std::swap(m_channel_capacity, other.m_channel_capacity);
+	std::swap(m_capacity, other.m_capacity);
+	std::swap(m_stride, other.m_stride);
+	std::swap(m_samples, other.m_samples);
+	std::swap(m_bytes, other.m_bytes);
+	std::swap(m_used_channels, other.m_used_channels);
+	std::swap(m_used_frames, other.m_used_frames);
+	std::swap(m_map, other.m_map);
+	std::swap(m_mapped, other.m_mapped);
+	return *this;
+}
+
+float* Audio_Buffer::channel(size_t channel) {
+	if (m_mapped) throw std::logic_error("attempted to write to mapped audio");
+	return m_samples + channel*m_stride;
+}
+
+void Audio_Buffer::reserve(size_t channels, size_t frames) {
+	if (!m_mapped && channels <= m_channel_capacity && frames <= m_capacity) return;
+
+	const size_t channel_capacity = std::max(channels, m_channel_capacity);
+	const size_t capacity = std::max(frames, m_capacity);
+	constexpr size_t floats_per_line = alignment/sizeof(float);
+	const size_t stride = (capacity + floats_per_line - 1)/floats_per_line*floats_per_line;
+	const size_t bytes = std::max<size_t>(channel_capacity*stride*sizeof(float), alignment);
+
+	float* samples = allocate(bytes);
+	for (size_t channel = 0; channel < m_channels; ++channel)
+		std::copy_n(std::as_const(*this).channel(channel), m_frames, samples + channel*stride);
+
+	deallocate(m_samples, m_bytes);
+	m_samples = samples;
+	m_bytes = bytes;
+	m_channel_capacity = channel_capacity;
+	m_capacity = capacity;
+	m_stride = stride;
+	m_used_channels = m_channels;
+	m_used_frames = m_frames;
+	m_mapped = nullptr;
+	m_map = Memory_Map();
+}
+
+void Audio_Buffer::resize(size_t channels, size_t frames) {
+	if (channels == m_channels && frames == m_frames) return;
+	reserve(channels, frames);
+
+	// clear the samples which become part of the audio and may have been written before
+	for (size_t channel = 0; channel < std::min(channels, m_used_channels); ++channel) {
+		const size_t from = channel < m_channels ? m_frames : 0;
+		const size_t to = std::min(frames, m_used_frames);
+		if (from < to) std::fill(this->channel(channel) + from, this->channel(channel) + to, 0.f);
+	}
+
+	m_channels = channels;
+	m_frames = frames;
+	m_used_channels = std::max(m_used_channels, channels);
+	m_used_frames = std::max(m_used_frames, frames);
+}
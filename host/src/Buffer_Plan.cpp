@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include "Buffer_Plan.hpp"
+
+// true if every step in steps other than step runs before it
+static bool run_before(const std::vector<size_t>& steps, size_t step, const std::vector<std::vector<bool>>& ancestors) {
+	return std::all_of(steps.begin(), steps.end(), [&](size_t other) { return other == step || ancestors[step][other]; });
+}
+
+// the output of step can overwrite the value read by its first input
+static bool can_alias(const Buffer_Plan::Step& step, size_t index, const std::vector<std::vector<size_t>>& readers,
+                      const std::vector<std::vector<bool>>& ancestors) {
+	if (!step.inplace || step.inputs.empty() || step.outputs > step.inputs.size()) return false;
+
+	const size_t value = step.inputs.front().value;
+	if (!run_before(readers[value], index, ancestors)) return false;
+	for (size_t input = 0; input < step.inputs.size(); ++input) {
+		const Buffer_Plan::Channel& channel = step.inputs[input];
+		// an output may only overwrite the channel read by the input of the same index
+		if (input < step.outputs && (channel.value != value || channel.channel != input)) return false;
+		if (channel.value == value && channel.channel < step.outputs && channel.channel != input) return false;
+	}
+	return true;
+}
+
+Buffer_Plan::Buffer_Plan(const std::vector<Step>& steps)
+	: m_steps(steps.size()), m_value_buffers(steps.size()+1), m_freed(steps.size()+1, true) {
+	// the steps reading each value and the steps each step runs after
+	std::vector<std::vector<size_t>> readers(steps.size()+1);
+	std::vector<std::vector<bool>> ancestors(steps.size(), std::vector<bool>(steps.size(), false));
+	for (size_t index = 0; index < steps.size(); ++index) {
+		for (const Channel& channel : steps[index].inputs) {
+			if (channel.value > index)
+				throw std::invalid_argument("step " + std::to_string(index) + " reads value "
+				                            + std::to_string(channel.value) + " before it is computed");
+			if (std::find(readers[channel.value].begin(), readers[channel.value].end(), index) == readers[channel.value].end())
+				readers[channel.value].push_back(index);
+			if (channel.value == 0) continue;
+			const size_t producer = channel.value-1;
+			ancestors[index][producer] = true;
+			for (size_t ancestor = 0; ancestor < producer; ++ancestor)
+				if (ancestors[producer][ancestor]) ancestors[index][ancestor] = true;
+		}
+	}
+	m_freed.back() = false;
+
+	// the values whose buffers are no longer needed once their readers, or producer if they are unread, have run
+	std::vector<size_t> released;
+	const auto release = [&](size_t value) {
+		if (value != steps.size()) released.push_back(value);
+	};
+	if (readers[0].empty()) release(0);
+	for (size_t index = 0; index < steps.size(); ++index) {
+		const Step& step = steps[index];
+		Allocation& allocation = m_steps[index];
+
+		// reuse the most recently released buffer whose value is no longer read when this step runs
+		auto reusable = std::find_if(released.rbegin(), released.rend(), [&](size_t value) {
+			return readers[value].empty() ? value == 0 || ancestors[index][value-1] : run_before(readers[value], index, ancestors);
+		});
+		if (can_alias(step, index, readers, ancestors)) {
+			const size_t value = step.inputs.front().value;
+			allocation.buffer = m_value_buffers[value];
+			allocation.aliased = true;
+			m_freed[value] = false;
+		} else if (reusable != released.rend()) {
+			allocation.buffer = m_value_buffers[*reusable];
+			m_freed[*reusable] = false;
+			released.erase(std::next(reusable).base());
+		} else {
+			allocation.buffer = m_buffers++;
+		}
+		m_value_buffers[index+1] = allocation.buffer;
+
+		// the values last read by this step, in the order of the steps, are released
+		for (size_t value = 0; value <= index; ++value) {
+			if (readers[value].empty() || readers[value].back() != index) continue;
+			if (allocation.aliased && value == step.inputs.front().value) continue;
+			release(value);
+		}
+		if (readers[index+1].empty()) release(index+1);
+	}
+}
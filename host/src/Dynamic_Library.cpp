@@ -53,6 +53,15 @@ void* Dynamic_Library::get_function_address(const char* symbol) {
 	return function_ptr;
 }
 
+void* Dynamic_Library::find_function_address(const char* symbol) noexcept {
+	if (!m_initialized) return nullptr;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		return reinterpret_cast<void*>(GetProcAddress(m_handle, symbol));
+	#elif __APPLE__ || __linux__
+		return dlsym(m_handle, symbol);
+	#endif
+}
+
 Dynamic_Library::native_handle_type Dynamic_Library::native_handle() { return m_handle; }
 
 
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#if __APPLE__ || __linux__
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "Memory_Map.hpp"
+
+Memory_Map::Memory_Map() {}
+
+Memory_Map::Memory_Map(Memory_Map&& other) noexcept {
+	*this = std::move(other);
+}
+
+Memory_Map::Memory_Map(const std::filesystem::path& path) {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("unable to open " + path.string());
+
+		LARGE_INTEGER size;
+		GetFileSizeEx(m_file, &size);
+		m_size = static_cast<std::size_t>(size.QuadPart);
+		// empty files can not be mapped
+		if (!m_size) return;
+
+		m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping) m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_data) {
+			if (m_mapping) CloseHandle(m_mapping);
+			CloseHandle(m_file);
+			throw std::runtime_error("unable to map " + path.string() + " into memory");
+		}
+	#elif __APPLE__ || __linux__
+		const int file = open(path.c_str(), O_RDONLY);
+		if (file < 0) throw std::runtime_error("unable to open " + path.string());
+
+		struct stat status;
+		if (fstat(file, &status)) {
+			close(file);
+			throw std::runtime_error("unable to read the size of " + path.string());
+		}
+		m_size = static_cast<std::size_t>(status.st_size);
+		// empty files can not be mapped
+		if (!m_size) {
+			close(file);
+			return;
+		}
+
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		// the mapping keeps its own reference to the file
+		close(file);
+		if (data == MAP_FAILED) throw std::runtime_error("unable to map " + path.string() + " into memory");
+		m_data = static_cast<const char*>(data);
+		madvise(data, m_size, MADV_SEQUENTIAL);
+	#endif
+}
+
+Memory_Map::~Memory_Map() {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		if (m_data) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+	#elif __APPLE__ || __linux__
+		if (m_data) munmap(const_cast<char*>(m_data), m_size);
+	#endif
+}
+
+void Memory_Map::discard(std::size_t offset, std::size_t size) const noexcept {
+	#if __APPLE__ || __linux__
+		// only whole pages inside the range are dropped
+		const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		const std::size_t begin = (offset + page - 1)/page*page;
+		const std::size_t end = std::min(offset + size, m_size)/page*page;
+		if (m_data && begin < end) madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_DONTNEED);
+	#else
+		(void) offset;
+		(void) size;
+	#endif
+}
+
+void Memory_Map::prefetch(std::size_t offset, std::size_t size) const noexcept {
+	#if __APPLE__ || __linux__
+		const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		const std::size_t begin = offset/page*page;
+		const std::size_t end = std::min(offset + size, m_size);
+		if (m_data && begin < end) madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_WILLNEED);
+	#else
+		(void) offset;
+		(void) size;
+	#endif
+}
+
+Memory_Map& Memory_Map::operator=(Memory_Map&& other) noexcept {
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		std::swap(m_file, other.m_file);
+		std::swap(m_mapping, other.m_mapping);
+	#endif
+	return *this;
+}
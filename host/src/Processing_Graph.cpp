@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Processing_Graph.hpp"
+#include "Task_Graph.hpp"
+
+// the distinct values read by step
+static std::vector<size_t> values_read(const Buffer_Plan::Step& step) {
+	std::vector<size_t> values;
+	for (const Buffer_Plan::Channel& channel : step.inputs)
+		if (std::find(values.begin(), values.end(), channel.value) == values.end()) values.push_back(channel.value);
+	return values;
+}
+
+Processing_Graph::Processing_Graph(size_t input_channels) : m_input_channels(input_channels) {}
+
+size_t Processing_Graph::channels(size_t value) const {
+	if (value > m_nodes.size()) throw std::out_of_range("value " + std::to_string(value) + " does not exist");
+	return value ? m_nodes[value-1].step.outputs : m_input_channels;
+}
+
+size_t Processing_Graph::add_plugin(std::unique_ptr<Plugin> plugin, std::vector<Channel> inputs) {
+	if (inputs.size() != plugin->audio_input_count())
+		throw std::invalid_argument(plugin->name + " has " + std::to_string(plugin->audio_input_count())
+		                            + " audio inputs but is connected to " + std::to_string(inputs.size()) + " channels");
+	for (const Channel& channel : inputs) {
+		if (channel.channel >= channels(channel.value))
+			throw std::invalid_argument(plugin->name + " reads channel " + std::to_string(channel.channel)
+			                            + " of a value with " + std::to_string(channels(channel.value)) + " channels");
+	}
+
+	Node node{Node::Type::plugin, std::move(plugin), {std::move(inputs), 0, false}};
+	node.step.outputs = node.plugin->audio_output_count();
+	m_nodes.push_back(std::move(node));
+	m_plan.reset();
+	return m_nodes.size();
+}
+
+size_t Processing_Graph::add_mix(const std::vector<size_t>& values) {
+	if (values.empty()) throw std::invalid_argument("a mix needs at least one input");
+
+	Node node{Node::Type::mix, nullptr, {{}, channels(values.front()), true}};
+	for (const size_t value : values) {
+		if (channels(value) != node.step.outputs)
+			throw std::invalid_argument("mixed values have " + std::to_string(node.step.outputs) + " and "
+			                            + std::to_string(channels(value)) + " channels");
+		for (size_t channel = 0; channel < node.step.outputs; ++channel)
+			node.step.inputs.push_back({value, channel});
+	}
+	m_nodes.push_back(std::move(node));
+	m_plan.reset();
+	return m_nodes.size();
+}
+
+size_t Processing_Graph::add_merge(const std::vector<size_t>& values) {
+	if (values.empty()) throw std::invalid_argument("a merge needs at least one input");
+
+	Node node{Node::Type::merge, nullptr, {}};
+	for (const size_t value : values)
+		for (size_t channel = 0; channel < channels(value); ++channel)
+			node.step.inputs.push_back({value, channel});
+	node.step.outputs = node.step.inputs.size();
+	m_nodes.push_back(std::move(node));
+	m_plan.reset();
+	return m_nodes.size();
+}
+
+void Processing_Graph::activate(double sample_rate) {
+	m_sample_rate = sample_rate;
+	m_tails.assign(m_nodes.size(), 0);
+	m_value_tails.assign(m_nodes.size()+1, 0);
+
+	std::vector<Buffer_Plan::Step> steps;
+	for (size_t index = 0; index < m_nodes.size(); ++index) {
+		Node& node = m_nodes[index];
+		if (node.plugin) {
+			node.plugin->activate(sample_rate, Plugin::default_block_size);
+			m_tails[index] = node.plugin->tail_length();
+			// the output of a plugin with latency is behind its input so it cannot be written over it
+			node.step.inplace = (node.plugin->supports & Plugin::Supports::inplace) && node.plugin->latency() == 0;
+		}
+
+		for (const size_t value : values_read(node.step))
+			m_value_tails[index+1] = std::max(m_value_tails[index+1], m_value_tails[value]);
+		m_value_tails[index+1] += m_tails[index];
+		steps.push_back(node.step);
+	}
+	m_plan = std::make_unique<Buffer_Plan>(steps);
+}
+
+size_t Processing_Graph::tail() const {
+	if (!m_plan) throw std::logic_error("the graph has not been activated");
+	return m_value_tails.back();
+}
+
+size_t Processing_Graph::reserved_frames(size_t frames) const {
+	if (!m_plan) throw std::logic_error("the graph has not been activated");
+
+	size_t reserved = frames;
+	for (size_t node = 0; node < m_nodes.size(); ++node)
+		if (m_plan->step(node).aliased && m_plan->step(node).buffer == 0)
+			reserved = std::max(reserved, frames + m_value_tails[node+1]);
+	return reserved;
+}
+
+size_t Processing_Graph::peak_bytes(size_t frames) const {
+	if (!m_plan) throw std::logic_error("the graph has not been activated");
+
+	size_t channels = m_input_channels;
+	for (const Node& node : m_nodes)
+		channels = std::max(channels, node.step.outputs);
+	return m_plan->buffers()*channels*(frames + tail())*sizeof(float);
+}
+
+size_t Processing_Graph::estimated_peak_bytes(size_t frames) const {
+	size_t channels = m_input_channels;
+	for (const Node& node : m_nodes)
+		channels = std::max(channels, node.step.outputs);
+	return (m_nodes.size()+1)*channels*frames*sizeof(float);
+}
+
+void Processing_Graph::run_node(size_t index, std::vector<Audio_Buffer>& buffers, std::vector<size_t>& frames) {
+	Node& node = m_nodes[index];
+	const Buffer_Plan::Step& step = node.step;
+	const Buffer_Plan::Allocation& allocation = m_plan->step(index);
+
+	size_t input_frames = 0;
+	for (const Channel& channel : step.inputs)
+		input_frames = std::max(input_frames, frames[channel.value]);
+	const size_t output_frames = input_frames + m_tails[index];
+	frames[index+1] = output_frames;
+
+	Audio_Buffer& output = buffers[allocation.buffer];
+	if (allocation.aliased) {
+		// makes mapped audio writable
+		output.reserve(output.channels(), output_frames);
+		output.resize(output.channels(), output_frames);
+	} else {
+		// reused buffers are cleared like new ones
+		if (output.mapped()) output = Audio_Buffer();
+		output.resize(0, 0);
+		output.resize(step.outputs, output_frames);
+	}
+
+	std::vector<const float*> inputs(step.inputs.size());
+	for (size_t input = 0; input < inputs.size(); ++input) {
+		const Channel& channel = step.inputs[input];
+		inputs[input] = std::as_const(buffers[m_plan->buffer(channel.value)]).channel(channel.channel);
+	}
+	std::vector<float*> outputs(step.outputs);
+	for (size_t channel = 0; channel < outputs.size(); ++channel)
+		outputs[channel] = output.channel(channel);
+
+	// the inputs which are not written over start in the output
+	const size_t first_input = allocation.aliased ? step.outputs : 0;
+	switch (node.type) {
+		case Node::Type::plugin: {
+			// plugins read every input for the same number of frames, so shorter inputs are padded with silence
+			const auto short_input = [&](size_t input) {
+				const Channel& channel = step.inputs[input];
+				if (allocation.aliased && channel.value == step.inputs.front().value) return false;
+				return frames[channel.value] < input_frames;
+			};
+			size_t padded_channels = 0;
+			for (size_t input = 0; input < inputs.size(); ++input)
+				padded_channels += short_input(input);
+
+			Audio_Buffer padded(padded_channels, input_frames);
+			for (size_t input = 0, channel = 0; input < inputs.size(); ++input) {
+				if (!short_input(input)) continue;
+				float* samples = padded.channel(channel++);
+				std::copy_n(inputs[input], frames[step.inputs[input].value], samples);
+				inputs[input] = samples;
+			}
+			node.plugin->run(inputs.data(), input_frames, outputs.data(), output_frames, m_sample_rate);
+			break;
+		}
+		case Node::Type::mix:
+			for (size_t input = first_input; input < inputs.size(); ++input) {
+				float* samples = outputs[input % step.outputs];
+				const size_t available = frames[step.inputs[input].value];
+				for (size_t frame = 0; frame < available; ++frame)
+					samples[frame] += inputs[input][frame];
+			}
+			break;
+		case Node::Type::merge:
+			for (size_t input = first_input; input < inputs.size(); ++input)
+				std::copy_n(inputs[input], frames[step.inputs[input].value], outputs[input]);
+			break;
+	}
+
+	output.resize(step.outputs, output_frames);
+}
+
+Audio_Buffer Processing_Graph::run(Audio_Buffer input, size_t n_threads) {
+	if (!m_plan) throw std::logic_error("the graph has not been activated");
+	if (input.channels() != m_input_channels)
+		throw std::invalid_argument("the graph reads " + std::to_string(m_input_channels) + " channels but the input has "
+		                            + std::to_string(input.channels()));
+
+	std::vector<Audio_Buffer> buffers(m_plan->buffers());
+	// the length of each value, set by the node computing it before the nodes reading it run
+	std::vector<size_t> frames(m_nodes.size()+1);
+	frames[0] = input.frames();
+	buffers[0] = std::move(input);
+
+	// the number of nodes which have not yet read each value
+	const std::unique_ptr<std::atomic<size_t>[]> readers(new std::atomic<size_t>[m_nodes.size()+1]());
+	for (const Node& node : m_nodes)
+		for (const size_t value : values_read(node.step)) ++readers[value];
+	const auto release = [&](size_t value) {
+		if (m_plan->freed(value)) buffers[m_plan->buffer(value)] = Audio_Buffer();
+	};
+	if (!readers[0]) release(0);
+
+	Task_Graph tasks;
+	for (size_t node = 0; node < m_nodes.size(); ++node) {
+		const std::vector<size_t> values = values_read(m_nodes[node].step);
+		std::vector<size_t> dependencies;
+		for (const size_t value : values)
+			if (value) dependencies.push_back(value-1);
+
+		tasks.add([&, node, values] {
+			run_node(node, buffers, frames);
+			for (const size_t value : values)
+				if (--readers[value] == 0) release(value);
+			if (!readers[node+1]) release(node+1);
+		}, dependencies);
+	}
+	tasks.run(n_threads);
+
+	return std::move(buffers[m_plan->buffer(m_nodes.size())]);
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "Task_Graph.hpp"
+
+size_t Task_Graph::add(std::function<void()> task, const std::vector<size_t>& dependencies) {
+	const size_t index = m_tasks.size();
+	for (const size_t dependency : dependencies)
+		if (dependency >= index) throw std::invalid_argument("a task may only depend on the tasks added before it");
+
+	m_tasks.push_back({std::move(task), dependencies.size(), {}});
+	for (const size_t dependency : dependencies)
+		m_tasks[dependency].dependents.push_back(index);
+	return index;
+}
+
+namespace {
+	// the tasks readied by one thread
+	struct Task_Queue {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+}
+
+void Task_Graph::run(size_t n_threads) {
+	if (m_tasks.empty()) return;
+	if (n_threads == 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	n_threads = std::min(n_threads, m_tasks.size());
+
+	const std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[m_tasks.size()]);
+	std::vector<Task_Queue> queues(n_threads);
+	size_t next_queue = 0;
+	for (size_t task = 0; task < m_tasks.size(); ++task) {
+		remaining[task] = m_tasks[task].dependencies;
+		if (!m_tasks[task].dependencies) queues[next_queue++ % n_threads].tasks.push_back(task);
+	}
+
+	// queued and unfinished are only changed while holding mutex so that waiting threads are woken,
+	// a task can be taken before it is counted as queued so queued may briefly be negative
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::ptrdiff_t queued = static_cast<std::ptrdiff_t>(next_queue);
+	size_t unfinished = m_tasks.size();
+	std::atomic<bool> failed = false;
+	std::exception_ptr exception;
+
+	const auto pop = [&](size_t thread, size_t& task) {
+		for (size_t i = 0; i < n_threads; ++i) {
+			Task_Queue& queue = queues[(thread+i) % n_threads];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) continue;
+			// the newest task of this thread's queue or the oldest task of another thread's
+			if (i == 0) {
+				task = queue.tasks.back();
+				queue.tasks.pop_back();
+			} else {
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+			}
+			return true;
+		}
+		return false;
+	};
+
+	const auto work = [&](size_t thread) {
+		while (true) {
+			size_t task;
+			if (!pop(thread, task)) {
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&] { return queued > 0 || !unfinished; });
+				if (!unfinished) return;
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				--queued;
+			}
+
+			if (!failed) {
+				try {
+					m_tasks[task].function();
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!exception) exception = std::current_exception();
+					failed = true;
+				}
+			}
+
+			size_t readied = 0;
+			for (const size_t dependent : m_tasks[task].dependents) {
+				if (--remaining[dependent]) continue;
+				std::lock_guard<std::mutex> lock(queues[thread].mutex);
+				queues[thread].tasks.push_back(dependent);
+				++readied;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			queued += static_cast<std::ptrdiff_t>(readied);
+			--unfinished;
+			if (readied > 1 || !unfinished) changed.notify_all();
+			else if (readied) changed.notify_one();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(n_threads-1);
+	for (size_t thread = 1; thread < n_threads; ++thread)
+		threads.emplace_back(work, thread);
+	work(0);
+	for (auto& thread : threads) thread.join();
+
+	if (exception) std::rethrow_exception(exception);
+}
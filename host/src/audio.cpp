@@ -1,147 +1,552 @@
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
 
 #include "audio.hpp"
+#include "sample_kernels.hpp"
+#include "thread_pool.hpp"
 
-struct Wav_Header {
-	// riff header
-	char chunk_id[4] = {'R', 'I', 'F', 'F'};
-	uint32_t chunk_size;
-	char wave_id[4] = {'W', 'A', 'V', 'E'};
-	// fmt
-	char subchunk_1_id[4] = {'f', 'm', 't', ' '};
-	uint32_t subchunk_1_size = 16;
-	uint16_t audio_format = 3;
-	uint16_t num_channels;
-	uint32_t sample_rate;
-	uint32_t byte_rate;
-	uint16_t block_align;
-	uint16_t bits_per_sample = 32;
-	// fact
-	char subchunk_2_id[4] = {'f', 'a', 'c', 't'};
-	uint32_t subchunk_2_size = 4;
-	uint32_t sample_length;
-	// data
-	char subchunk_3_id[4] = {'d', 'a', 't', 'a'};
-	uint32_t subchunk_3_size;
-};
-
-static void write_wav(const std::filesystem::path& path, const std::vector<std::vector<float>>& audio, const Audio_Info& info) {
-	std::ofstream wav_file(path, std::ios::out | std::ios::binary);
-
-	Wav_Header header;
-	header.num_channels = audio.size();
-	header.sample_rate = info.sample_rate;
-	header.byte_rate = header.sample_rate*header.num_channels*sizeof(float);
-	header.block_align = header.num_channels*sizeof(float);
-	header.bits_per_sample = 8*sizeof(float);
-
-	header.sample_length = audio.front().size()*header.num_channels;
-
-	header.subchunk_3_size = header.sample_length*sizeof(float);
-
-	header.chunk_size = 4 +
-	                    8 + header.subchunk_1_size +
-	                    8 + header.subchunk_2_size +
-	                    8 + header.subchunk_3_size +
-	                    (header.subchunk_3_size & 1);
-
-	wav_file.write(reinterpret_cast<char*>(&header), sizeof(header));
-
-	std::vector<float> interleaved_audio;
-	interleaved_audio.reserve(header.sample_length);
-	for (size_t i = 0; i < header.sample_length/header.num_channels; ++i)
-		for (const auto& channel : audio)
-			interleaved_audio.push_back(channel[i]);
-
-	wav_file.write(reinterpret_cast<char*>(interleaved_audio.data()), interleaved_audio.size()*sizeof(float));
-
-	wav_file.close();
-}
-
-struct Fmt_Chunk {
-	char chunk_id[4];
-	uint32_t chunk_size;
-	uint16_t audio_format;
-	uint16_t num_channels;
-	uint32_t sample_rate;
-	uint32_t byte_rate;
-	uint16_t block_align;
-	uint16_t bits_per_sample;
-};
-
-static std::vector<std::vector<float>> read_wav(const std::filesystem::path& path, Audio_Info& info) {
-	std::ifstream wav_file(path, std::ios::in | std::ios::binary);
-
-	char riff_header[8];
-	wav_file.read(riff_header, sizeof(riff_header));
-	if (riff_header[0] != 'R' || riff_header[1] != 'I' || riff_header[2] != 'F' || riff_header[3] != 'F')
-		throw std::runtime_error("input file is not a valid wav file: incorrect chunk id");
-
-	uint32_t chunk_size = *reinterpret_cast<uint32_t*>(riff_header+4);
-	char* data = new char[chunk_size];
-	wav_file.read(data, chunk_size);
-	wav_file.close();
-
-	if (data[0] != 'W' || data[1] != 'A' || data[2] != 'V' || data[3] != 'E')
-		throw std::runtime_error("input file is not a valid wav file: incorrect wave id");
-
-
-	// read fmt chunk
-	const char* fmt_chunk_id = "fmt ";
-
-	char* p_fmt_chunk = std::search(data+4, data+chunk_size, fmt_chunk_id, fmt_chunk_id+4);
-	if (p_fmt_chunk == data+chunk_size)
-		throw std::runtime_error("wav file is missing fmt chunk");
-
-	Fmt_Chunk fmt_chunk = *reinterpret_cast<Fmt_Chunk*>(p_fmt_chunk);
-	if ((fmt_chunk.audio_format != 1 || fmt_chunk.bits_per_sample != 32)
-		&& !(fmt_chunk.audio_format != 3 || fmt_chunk.bits_per_sample != 16))
-		throw std::runtime_error("only wav files with 32 bit IEEE floating point or 16 bit pcm data are supported!");
-
-	info.sample_rate = fmt_chunk.sample_rate;
-
-	std::vector<std::vector<float>> audio(fmt_chunk.num_channels);
-
-	// get audio data
-	const char* data_chunk_id = "data";
-	char* data_chunk = std::search(p_fmt_chunk+fmt_chunk.chunk_size, data+chunk_size, data_chunk_id, data_chunk_id+4);
-
-	uint32_t data_chunk_size = *reinterpret_cast<uint32_t*>(data_chunk+4);
-
-	for (auto& channel : audio)
-		channel.reserve(8*data_chunk_size/(fmt_chunk.num_channels*fmt_chunk.bits_per_sample));
-
-	switch (fmt_chunk.audio_format) {
-		case 1: {
-			int16_t* audio_data = reinterpret_cast<int16_t*>(data_chunk+8);
+template <typename T>
+static void append_le(std::vector<char>& data, T value) {
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+static void append_id(std::vector<char>& data, const char* id, size_t size = 4) {
+	data.insert(data.end(), id, id + size);
+}
+
+// frames converted per pass, small enough for a block of every channel to stay in cache
+static constexpr size_t block_frames = 4096;
+
+// the decoded part of the mapped file is discarded every time this many bytes have been read,
+// and the same amount past the next part is prefetched
+static constexpr size_t discard_bytes = size_t(1) << 24;
+
+// files are read and written asynchronously in blocks of this many bytes, with up to io_blocks in flight
+static constexpr size_t io_block_bytes = size_t(1) << 22;
+static constexpr size_t io_blocks = 8;
+
+// samples are converted by several threads in tasks of at least this many bytes of the file
+static constexpr size_t task_bytes = size_t(1) << 18;
+
+static size_t default_conversion_threads() {
+	if (const char* threads = std::getenv("AUDIO_THREADS")) return std::strtoull(threads, nullptr, 10);
+	return 0;
+}
+
+static Thread_Pool& conversion_pool() {
+	static Thread_Pool pool(default_conversion_threads());
+	return pool;
+}
+
+// converts n samples in format to floats
+static void convert_samples(Sample_Format format, const char* in, float* out, size_t n) {
+	const Sample_Kernels& kernels = sample_kernels();
+	switch (format) {
+		case Sample_Format::pcm16: kernels.pcm16_to_float(in, out, n); break;
+		case Sample_Format::pcm24: kernels.pcm24_to_float(in, out, n); break;
+		case Sample_Format::pcm32: kernels.pcm32_to_float(in, out, n); break;
+		case Sample_Format::float32: std::memcpy(out, in, n*sizeof(float)); break;
+		case Sample_Format::float64: kernels.float64_to_float(in, out, n); break;
+	}
+}
+
+Audio_Reader::Audio_Reader(const std::filesystem::path& path) {
+	if (path.extension() != ".wav" && path.extension() != ".rf64" && path.extension() != ".w64")
+		throw std::invalid_argument("input file type is not supported!");
+
+	m_map = Memory_Map(path);
+	const char* file = m_map.data();
+
+	Wav_Layout layout;
+	parse_wav_header(file, m_map.size(), m_map.size(), layout);
+	m_info.format = layout.format;
+	m_info.sample_rate = layout.sample_rate;
+	m_channels = layout.channels;
+	m_sample_bytes = sample_bytes(layout.format);
+	m_frames = layout.frames();
+	m_offset = layout.data_offset;
+
+	if (direct_io_requested()) {
+		m_file = std::make_unique<Async_File>(path, Async_File::Mode::read, true);
+		m_blocks_offset = m_offset/Async_File::direct_alignment*Async_File::direct_alignment;
+		m_blocks.resize(io_blocks);
+		for (Read_Block& block : m_blocks) block.buffer = Io_Buffer(io_block_bytes);
+		// the header has been parsed so the mapping is no longer needed
+		m_map = Memory_Map();
+	}
+}
+
+Wav_Layout Audio_Reader::probe(const std::filesystem::path& path) {
+	if (path.extension() != ".wav" && path.extension() != ".rf64" && path.extension() != ".w64")
+		throw std::invalid_argument("input file type is not supported!");
+
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file) throw std::runtime_error("unable to open " + path.string());
+	return read_wav_layout(file);
+}
+
+size_t Audio_Reader::buffer_bytes() {
+	return direct_io_requested() ? io_blocks*io_block_bytes : 0;
+}
+
+void Audio_Reader::prefetch(size_t frames) {
+	const size_t stride = m_sample_bytes*m_channels;
+	const size_t offset = m_offset + m_position*stride;
+	const size_t size = std::min(frames, m_frames-m_position)*stride;
+	if (!size) return;
+	if (!m_file) {
+		m_map.prefetch(offset, size);
+		return;
+	}
 
-			for (size_t sample = 0; sample < 8*data_chunk_size/fmt_chunk.bits_per_sample; sample += fmt_chunk.num_channels)
-				for (size_t channel = 0; channel < fmt_chunk.num_channels; ++channel)
-					audio[channel].push_back(static_cast<float>(audio_data[sample + channel])/32768.f);
-			break;
+	const size_t first = (offset - m_blocks_offset)/io_block_bytes;
+	const size_t last = (offset + size - 1 - m_blocks_offset)/io_block_bytes;
+	for (size_t index = first; index <= last && index < first + m_blocks.size(); ++index)
+		request_block(index);
+}
+
+const char* Audio_Reader::file_data(size_t offset, size_t size) {
+	if (!m_file) return m_map.data() + offset;
+
+	const size_t position = offset - m_blocks_offset;
+	if (position/io_block_bytes == (position + size - 1)/io_block_bytes)
+		return load_block(position/io_block_bytes) + position%io_block_bytes;
+
+	m_straddle.resize(size);
+	for (size_t copied = 0; copied < size;) {
+		const size_t index = (position + copied)/io_block_bytes;
+		const size_t start = (position + copied)%io_block_bytes;
+		const size_t count = std::min(size-copied, io_block_bytes-start);
+		std::memcpy(m_straddle.data() + copied, load_block(index) + start, count);
+		copied += count;
+	}
+	return m_straddle.data();
+}
+
+const char* Audio_Reader::load_block(size_t index) {
+	// the blocks are used in order, so the following blocks are read while this one is decoded
+	for (size_t ahead = index; ahead < index + m_blocks.size(); ++ahead)
+		request_block(ahead);
+
+	Read_Block& block = m_blocks[index % m_blocks.size()];
+	if (block.request) {
+		m_file->wait(block.request);
+		block.request = 0;
+	}
+	return block.buffer.data();
+}
+
+void Audio_Reader::request_block(size_t index) {
+	Read_Block& block = m_blocks[index % m_blocks.size()];
+	if (block.index == index) return;
+	if (block.request) {
+		m_file->wait(block.request);
+		block.request = 0;
+	}
+
+	block.index = index;
+	const uint64_t offset = m_blocks_offset + static_cast<uint64_t>(index)*io_block_bytes;
+	if (offset < m_offset + static_cast<uint64_t>(m_frames)*m_sample_bytes*m_channels)
+		block.request = m_file->read(block.buffer.data(), io_block_bytes, offset);
+}
+
+void Audio_Reader::decode(const char* in, float* const* channels, size_t frames) const {
+	const Sample_Kernels& kernels = sample_kernels();
+	const size_t stride = m_sample_bytes*m_channels;
+	const bool mapped = !m_file;
+	const size_t start = mapped ? in - m_map.data() : 0;
+
+	std::vector<float*> block(m_channels);
+	// holds a block of converted interleaved samples before they are deinterleaved
+	std::vector<float> converted(m_channels > 1 ? block_frames*m_channels : 0);
+	size_t discarded = 0;
+	if (mapped) m_map.prefetch(start, std::min(frames*stride, 2*discard_bytes));
+	for (size_t first = 0; first < frames; first += block_frames) {
+		const size_t count = std::min(block_frames, frames-first);
+		const char* samples = in + first*stride;
+		for (size_t channel = 0; channel < m_channels; ++channel)
+			block[channel] = channels[channel] + first;
+
+		if (m_channels == 1) {
+			convert_samples(m_info.format, samples, block[0], count);
+		} else if (m_info.format == Sample_Format::float32 && reinterpret_cast<uintptr_t>(samples) % alignof(float) == 0) {
+			// floating point samples are deinterleaved straight from the file
+			kernels.deinterleave(reinterpret_cast<const float*>(samples), block.data(), m_channels, count);
+		} else {
+			convert_samples(m_info.format, samples, converted.data(), count*m_channels);
+			kernels.deinterleave(converted.data(), block.data(), m_channels, count);
 		}
-		case 3: {
-			float* audio_data = reinterpret_cast<float*>(data_chunk+8);
 
-			for (size_t sample = 0; sample < 8*data_chunk_size/fmt_chunk.bits_per_sample; sample += fmt_chunk.num_channels)
-				for (size_t channel = 0; channel < fmt_chunk.num_channels; ++channel)
-					audio[channel].push_back(audio_data[sample + channel]);
-			break;
+		// drop the pages of the file which have been decoded so they do not add to the memory in use,
+		// and request the pages after those which are already being loaded
+		const size_t decoded = (first+count)*stride;
+		if (mapped && (decoded - discarded >= discard_bytes || first+count == frames)) {
+			m_map.discard(start + discarded, decoded - discarded);
+			if (decoded + discard_bytes < frames*stride)
+				m_map.prefetch(start + decoded + discard_bytes, std::min(discard_bytes, frames*stride - decoded - discard_bytes));
+			discarded = decoded;
+		}
+	}
+}
+
+size_t Audio_Reader::read(float* const* channels, size_t frames) {
+	frames = std::min(frames, m_frames-m_position);
+	const size_t stride = m_sample_bytes*m_channels;
+	const size_t start = m_offset + m_position*stride;
+	const size_t grain = std::max<size_t>(1, task_bytes/stride);
+
+	for (size_t done = 0; done < frames;) {
+		size_t count = frames-done;
+		if (m_file) {
+			// with direct io the frames inside a block are decoded together once it has been read,
+			// frames which straddle two blocks are gathered one at a time
+			const size_t position = start + done*stride - m_blocks_offset;
+			count = std::clamp<size_t>((io_block_bytes - position%io_block_bytes)/stride, 1, count);
 		}
+
+		// every task decodes a disjoint range of frames into the channels
+		const char* in = file_data(start + done*stride, count*stride);
+		conversion_pool().parallel_for(count, grain, [&](size_t begin, size_t end) {
+			std::vector<float*> out(m_channels);
+			for (size_t channel = 0; channel < m_channels; ++channel)
+				out[channel] = channels[channel] + done + begin;
+			decode(in + begin*stride, out.data(), end-begin);
+		});
+		done += count;
 	}
+	m_position += frames;
+	return frames;
+}
 
-	delete[] data;
+Audio_Buffer Audio_Reader::read_all() {
+	return read_all(m_channels, m_frames-m_position);
+}
+
+Audio_Buffer Audio_Reader::read_all(size_t channels, size_t frames) {
+	const size_t remaining = m_frames-m_position;
+	const size_t offset = m_offset + m_position*m_sample_bytes*m_channels;
 
+	// single channel floating point samples are already planar
+	if (!m_file && m_info.format == Sample_Format::float32 && m_channels == 1 && channels == 1 && frames == remaining
+	    && offset % alignof(float) == 0) {
+		m_position = m_frames;
+		return Audio_Buffer(std::move(m_map), offset, frames);
+	}
+
+	const size_t count = std::min(frames, remaining);
+	Audio_Buffer audio;
+	audio.reserve(std::max(channels, m_channels), frames);
+	audio.resize(m_channels, count);
+	std::vector<float*> pointers(m_channels);
+	for (size_t channel = 0; channel < m_channels; ++channel)
+		pointers[channel] = audio.channel(channel);
+	read(pointers.data(), count);
+	audio.resize(channels, frames);
 	return audio;
 }
 
-std::vector<std::vector<float>> read_audio_file(const std::filesystem::path& path, Audio_Info& info) {
-	if (path.extension() == ".wav") return read_wav(path, info);
-	else throw std::invalid_argument("input file type is not supported!");
+// the starting state of the dither generator for a block of frames
+static uint32_t dither_seed(uint64_t block) {
+	uint64_t x = block + 0x9E3779B97F4A7C15;
+	x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9;
+	x = (x ^ (x >> 27))*0x94D049BB133111EB;
+	// the xorshift state must not be 0
+	return static_cast<uint32_t>(x ^ (x >> 31)) | 1;
+}
+
+// uniformly distributed in [0, 1), from a xorshift generator
+static float uniform_random(uint32_t& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return static_cast<float>(state >> 8)*(1.f/16777216.f);
+}
+
+// the sub format guid of WAVE_FORMAT_EXTENSIBLE follows the 2 byte format tag
+static constexpr char extensible_guid_tail[] = "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71";
+static constexpr size_t extensible_guid_tail_size = 14;
+
+// the speaker positions of the usual layouts of up to 8 channels, 0 leaves them unassigned
+static uint32_t channel_mask(size_t channels) {
+	static constexpr uint32_t masks[] = {0, 0x4, 0x3, 0x7, 0x33, 0x37, 0x3F, 0x13F, 0x63F};
+	return channels < std::size(masks) ? masks[channels] : 0;
+}
+
+/**
+ * The header of a wav file which holds frames frames, its size does not depend on frames.
+ * Wav files hold up to 4 GB, the header has a 28 byte junk chunk which is replaced by a ds64
+ * chunk to convert the file to rf64 once the data does not fit. Files with more than 2 channels
+ * or more than 16 bits per sample use WAVE_FORMAT_EXTENSIBLE.
+ */
+static std::vector<char> wav_header(Wav_Container container, const Audio_Info& info, size_t channels, uint64_t frames) {
+	const uint16_t bytes = sample_bytes(info.format);
+	const uint64_t data_size = frames*channels*bytes;
+	const uint16_t format = info.format == Sample_Format::float32 ? 3 : 1;
+	const bool extensible = channels > 2 || bytes > 2;
+
+	std::vector<char> fmt;
+	append_le<uint16_t>(fmt, extensible ? 0xFFFE : format);
+	append_le<uint16_t>(fmt, channels);
+	append_le<uint32_t>(fmt, info.sample_rate);
+	append_le<uint32_t>(fmt, info.sample_rate*channels*bytes);
+	append_le<uint16_t>(fmt, channels*bytes);
+	append_le<uint16_t>(fmt, 8*bytes);
+	if (extensible) {
+		append_le<uint16_t>(fmt, 22);
+		// every bit of the samples is valid
+		append_le<uint16_t>(fmt, 8*bytes);
+		append_le<uint32_t>(fmt, channel_mask(channels));
+		append_le<uint16_t>(fmt, format);
+		append_id(fmt, extensible_guid_tail, extensible_guid_tail_size);
+	}
+
+	std::vector<char> header;
+	if (container == Wav_Container::wave64) {
+		const uint64_t padded_data_size = (data_size + 7)/8*8;
+		append_id(header, w64_riff, w64_guid_size);
+		append_le<uint64_t>(header, 40 + 24 + fmt.size() + 32 + 24 + padded_data_size);
+		append_id(header, w64_wave, w64_guid_size);
+		append_id(header, w64_fmt, w64_guid_size);
+		append_le<uint64_t>(header, 24 + fmt.size());
+		header.insert(header.end(), fmt.begin(), fmt.end());
+		append_id(header, w64_fact, w64_guid_size);
+		append_le<uint64_t>(header, 24 + 4);
+		append_le<uint32_t>(header, std::min<uint64_t>(frames, UINT32_MAX));
+		append_le<uint32_t>(header, 0);
+		append_id(header, w64_data, w64_guid_size);
+		append_le<uint64_t>(header, 24 + data_size);
+		return header;
+	}
+
+	const uint64_t riff_size = 4 + 36 + 8 + fmt.size() + 12 + 8 + data_size + (data_size & 1);
+	const bool rf64 = container == Wav_Container::rf64 || riff_size > riff_size_limit;
+	append_id(header, rf64 ? "RF64" : "RIFF");
+	append_le<uint32_t>(header, rf64 ? UINT32_MAX : riff_size);
+	append_id(header, "WAVE");
+	if (rf64) {
+		append_id(header, "ds64");
+		append_le<uint32_t>(header, 28);
+		append_le<uint64_t>(header, riff_size);
+		append_le<uint64_t>(header, data_size);
+		append_le<uint64_t>(header, frames);
+		// no table of other large chunks
+		append_le<uint32_t>(header, 0);
+	} else {
+		append_id(header, "JUNK");
+		append_le<uint32_t>(header, 28);
+		header.resize(header.size() + 28);
+	}
+	append_id(header, "fmt ");
+	append_le<uint32_t>(header, fmt.size());
+	header.insert(header.end(), fmt.begin(), fmt.end());
+	append_id(header, "fact");
+	append_le<uint32_t>(header, 4);
+	append_le<uint32_t>(header, rf64 ? UINT32_MAX : frames);
+	append_id(header, "data");
+	append_le<uint32_t>(header, rf64 ? UINT32_MAX : data_size);
+	return header;
 }
 
-void write_audio_file(const std::filesystem::path& path, const std::vector<std::vector<float>>& data, const Audio_Info& info) {
-	if (path.extension() == ".wav") write_wav(path, data, info);
+Audio_Writer::Audio_Writer(const std::filesystem::path& path, size_t channels, const Audio_Info& info)
+	: m_channels(channels), m_info(info) {
+	if (path.extension() == ".wav") m_container = Wav_Container::riff;
+	else if (path.extension() == ".rf64") m_container = Wav_Container::rf64;
+	else if (path.extension() == ".w64") m_container = Wav_Container::wave64;
 	else throw std::invalid_argument("output file type is not supported!");
+	if (info.format != Sample_Format::pcm16 && info.format != Sample_Format::pcm24 && info.format != Sample_Format::float32)
+		throw std::invalid_argument("wav files can only be written with 16 or 24 bit pcm or 32 bit floating point samples!");
+
+	m_file = std::make_unique<Async_File>(path, Async_File::Mode::write, direct_io_requested());
+	for (size_t i = 0; i < io_blocks; ++i) m_buffers.emplace_back(io_block_bytes);
+	m_requests.resize(io_blocks);
+	if (m_file->direct()) m_first_block = Io_Buffer(Async_File::direct_alignment);
+
+	// the sizes are left as 0 until the file is finalised
+	const std::vector<char> header = wav_header(m_container, m_info, m_channels, 0);
+	append(header.data(), header.size());
+}
+
+size_t Audio_Writer::buffer_bytes() {
+	return io_blocks*io_block_bytes + (direct_io_requested() ? Async_File::direct_alignment : 0);
+}
+
+Audio_Writer::~Audio_Writer() {
+	try {
+		finalize();
+	} catch (...) {}
+}
+
+// full buffers are only written once more output arrives
+void Audio_Writer::append(const char* data, size_t size) {
+	while (size) {
+		if (m_filled == io_block_bytes) flush(io_block_bytes);
+		const size_t count = std::min(size, io_block_bytes - m_filled);
+		std::memcpy(m_buffers[m_buffer].data() + m_filled, data, count);
+		m_filled += count;
+		data += count;
+		size -= count;
+	}
+}
+
+void Audio_Writer::flush(size_t size) {
+	Io_Buffer& buffer = m_buffers[m_buffer];
+	if (m_buffer_offset == 0 && m_first_block.data())
+		std::memcpy(m_first_block.data(), buffer.data(), Async_File::direct_alignment);
+	m_requests[m_buffer] = m_file->write(buffer.data(), size, m_buffer_offset);
+	m_buffer_offset += size;
+	m_filled = 0;
+
+	// the next buffer can only be filled once its previous contents have been written
+	m_buffer = (m_buffer+1) % m_buffers.size();
+	if (m_requests[m_buffer]) {
+		m_file->wait(m_requests[m_buffer]);
+		m_requests[m_buffer] = 0;
+	}
+}
+
+void Audio_Writer::encode(const float* const* channels, size_t first, size_t frames, size_t position) {
+	const Sample_Kernels& kernels = sample_kernels();
+	const size_t bytes = sample_bytes(m_info.format);
+	const bool pcm = m_info.format != Sample_Format::float32;
+
+	// hold a block of interleaved frames, their dither and the converted samples before they are copied to the output
+	std::vector<const float*> block(m_channels);
+	std::vector<float> interleaved(block_frames*m_channels);
+	std::vector<float> dither(pcm && m_info.dither ? block_frames*m_channels : 0);
+	std::vector<char> converted(pcm ? block_frames*m_channels*bytes : 0);
+	// blocks start at multiples of block_frames in the file, so the dither does not depend on
+	// how the frames are split between writes and threads
+	for (size_t offset = 0; offset < frames;) {
+		const uint64_t frame = m_frames + first + offset;
+		const size_t skipped = frame % block_frames;
+		const size_t count = std::min(block_frames - skipped, frames-offset);
+		const size_t samples = count*m_channels;
+		for (size_t channel = 0; channel < m_channels; ++channel)
+			block[channel] = channels[channel] + first + offset;
+		kernels.interleave(block.data(), interleaved.data(), m_channels, count);
+
+		const char* out = reinterpret_cast<const char*>(interleaved.data());
+		if (pcm) {
+			// every block has its own generator, the values for frames before the start are skipped
+			// the difference of two uniform values has a triangular distribution in (-1, 1)
+			uint32_t state = dither_seed(frame / block_frames);
+			for (size_t i = 0; i < skipped*m_channels && !dither.empty(); ++i) {
+				uniform_random(state);
+				uniform_random(state);
+			}
+			for (size_t i = 0; i < dither.size() && i < samples; ++i)
+				dither[i] = uniform_random(state) - uniform_random(state);
+			const float* noise = m_info.dither ? dither.data() : nullptr;
+			if (m_info.format == Sample_Format::pcm16)
+				kernels.float_to_pcm16(interleaved.data(), noise, converted.data(), samples);
+			else
+				kernels.float_to_pcm24(interleaved.data(), noise, converted.data(), samples);
+			out = converted.data();
+		}
+
+		// copy the samples into the buffers following the current one
+		size_t size = samples*bytes;
+		size_t at = position + offset*m_channels*bytes;
+		while (size) {
+			const size_t piece = std::min(size, io_block_bytes - at%io_block_bytes);
+			std::memcpy(m_buffers[(m_buffer + at/io_block_bytes) % m_buffers.size()].data() + at%io_block_bytes, out, piece);
+			out += piece;
+			at += piece;
+			size -= piece;
+		}
+		offset += count;
+	}
+}
+
+void Audio_Writer::write(const float* const* channels, size_t frames) {
+	const size_t frame_bytes = m_channels*sample_bytes(m_info.format);
+	const size_t grain = std::max<size_t>(1, task_bytes/frame_bytes);
+	for (size_t done = 0; done < frames;) {
+		if (m_filled == io_block_bytes) flush(io_block_bytes);
+
+		// each round is encoded into the current buffer and up to half of the ring,
+		// so the buffers filled by the previous round are written meanwhile
+		const size_t space = io_block_bytes - m_filled + (m_buffers.size()/2 - 1)*io_block_bytes;
+		const size_t count = std::clamp<size_t>(space/frame_bytes, 1, frames-done);
+		const size_t filled = m_filled + count*frame_bytes;
+		for (size_t i = 1; i < (filled + io_block_bytes - 1)/io_block_bytes; ++i) {
+			const size_t buffer = (m_buffer + i) % m_buffers.size();
+			if (m_requests[buffer]) {
+				m_file->wait(m_requests[buffer]);
+				m_requests[buffer] = 0;
+			}
+		}
+
+		// every task encodes a disjoint range of frames into its own part of the buffers
+		conversion_pool().parallel_for(count, grain, [&](size_t begin, size_t end) {
+			encode(channels, done + begin, end-begin, m_filled + begin*frame_bytes);
+		});
+
+		m_filled = filled;
+		while (m_filled > io_block_bytes) {
+			const size_t rest = m_filled - io_block_bytes;
+			flush(io_block_bytes);
+			m_filled = rest;
+		}
+		done += count;
+	}
+	m_frames += frames;
+}
+
+void Audio_Writer::finalize() {
+	if (!m_file) return;
+
+	try {
+		// riff chunks are padded to an even size and wave64 chunks to a multiple of 8 bytes
+		const uint64_t data_size = static_cast<uint64_t>(m_frames)*m_channels*sample_bytes(m_info.format);
+		const size_t alignment = m_container == Wav_Container::wave64 ? 8 : 2;
+		const char padding[8] = {};
+		append(padding, (alignment - data_size%alignment)%alignment);
+
+		// direct io only writes whole blocks, the end of the file is cut off afterwards
+		const uint64_t file_size = m_buffer_offset + m_filled;
+		size_t size = m_filled;
+		if (m_file->direct()) {
+			size = (m_filled + Async_File::direct_alignment - 1)/Async_File::direct_alignment*Async_File::direct_alignment;
+			std::memset(m_buffers[m_buffer].data() + m_filled, 0, size - m_filled);
+		}
+		if (size) flush(size);
+		m_file->wait_all();
+
+		const std::vector<char> header = wav_header(m_container, m_info, m_channels, m_frames);
+		if (m_first_block.data()) {
+			std::memcpy(m_first_block.data(), header.data(), header.size());
+			m_file->write(m_first_block.data(), m_first_block.size(), 0);
+			m_file->truncate(file_size);
+		} else {
+			m_file->write(header.data(), header.size(), 0);
+			m_file->wait_all();
+		}
+	} catch (...) {
+		m_file.reset();
+		throw;
+	}
+	m_file.reset();
+}
+
+Audio_Buffer read_audio_file(const std::filesystem::path& path, Audio_Info& info) {
+	Audio_Reader reader(path);
+	info = reader.info();
+	return reader.read_all();
+}
+
+void write_audio_file(const std::filesystem::path& path, const Audio_Buffer& data, const Audio_Info& info) {
+	Audio_Writer writer(path, data.channels(), info);
+	std::vector<const float*> channels(data.channels());
+	for (size_t channel = 0; channel < data.channels(); ++channel)
+		channels[channel] = data.channel(channel);
+	writer.write(channels.data(), data.frames());
+	writer.finalize();
 }
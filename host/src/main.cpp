@@ -1,20 +1,77 @@
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	#include "windows.h"
+#elif __APPLE__ || __linux__
+	#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
 #include <unordered_map>
 #include <unordered_set>
 #include <map>
 #include <filesystem>
+#include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "plugin.hpp"
 #include "audio.hpp"
+#include "Processing_Graph.hpp"
 
 constexpr const char* version_str =
 "Audio Thing v0.1.0\n"
 "Written By Dougal Stewart\n";
 
-static std::map<std::string, std::string> parse_cmd_line_args(int argc, const char* argv[]) {
-	std::map<std::string, std::string> args;
+// returns the smallest n >= size whose prime factors are all 2, 3, 5 or 7
+static size_t next_smooth_size(size_t size) {
+	for (size_t n = std::max<size_t>(size, 1);; ++n) {
+		size_t remaining = n;
+		for (const size_t factor : {2, 3, 5, 7})
+			while (remaining%factor == 0) remaining /= factor;
+		if (remaining == 1) return n;
+	}
+}
+
+/**
+ * Estimated number of floating point operations in a transform of size samples.
+ * Sizes made of small prime factors take about 5*size*log2(size) operations, each prime factor
+ * larger than 31 is transformed with bluesteins algorithm which costs about three transforms
+ * of the next power of 2 >= 2*factor-1.
+ */
+static double estimated_transform_cost(size_t size) {
+	if (size < 2) return 0;
+	const auto cost = [](double n) { return 5.0*n*std::log2(n); };
+	double total = cost(size);
+	size_t remaining = size;
+	for (size_t factor = 2; remaining > 1; ++factor) {
+		// the remaining factor is prime once factor^2 exceeds it
+		if (factor*factor > remaining) factor = remaining;
+		for (; remaining%factor == 0; remaining /= factor) {
+			if (factor <= 31) continue;
+			size_t padded = 1;
+			while (padded < 2*factor-1) padded *= 2;
+			total += static_cast<double>(size/factor)*(3*cost(padded) - cost(factor));
+		}
+	}
+	return total;
+}
+
+/**
+ * Returns the arguments in order as pairs of the long option name and its value,
+ * the input and output files are returned as --input and --output
+ */
+static std::vector<std::pair<std::string, std::string>> parse_cmd_line_args(int argc, const char* argv[]) {
+	std::vector<std::pair<std::string, std::string>> args;
+	bool has_input = false, has_output = false;
 
 	for (int i = 1; i < argc; ++i) {
 		if (argv[i][0] == '-') {
@@ -43,7 +100,8 @@ static std::map<std::string, std::string> parse_cmd_line_args(int argc, const ch
 			// command line options which do not require a value
 			const std::unordered_set<std::string> flags = {
 				"--help",
-				"--info"
+				"--info",
+				"--dither"
 			};
 
 			if (value.empty() && flags.find(argument) == flags.end()) {
@@ -51,33 +109,453 @@ static std::map<std::string, std::string> parse_cmd_line_args(int argc, const ch
 				if (i < argc) value = argv[i];
 			}
 
-			args.insert({argument, value});
+			args.emplace_back(argument, value);
 		} else {
-			if (auto it = args.find("--input"); it == args.end()) args.insert({"--input", argv[i]});
-			else if (auto it = args.find("--output"); it == args.end()) args.insert({"--output", argv[i]});
+			if (!has_input) args.emplace_back("--input", argv[i]);
+			else if (!has_output) args.emplace_back("--output", argv[i]);
 			else throw std::invalid_argument(std::string("Invalid command line argument: ") + argv[i]);
+			(has_input ? has_output : has_input) = true;
 		}
 	}
 
 	return args;
 }
 
+// a node of the processing graph as it is given on the command line
+struct Graph_Node {
+	enum class Type {
+		plugin,
+		mix,
+		merge
+	};
+
+	Type type = Type::plugin;
+	std::unique_ptr<Plugin> plugin;
+	// the name other nodes refer to the node by
+	std::string name;
+	// the node read by a plugin, the previous node if empty
+	std::string from;
+	// the channel connected to each audio input of a plugin as CHANNEL of from or NODE:CHANNEL,
+	// empty connects the channels of from in order
+	std::vector<std::string> route;
+	// the nodes which are mixed or merged
+	std::vector<std::string> sources;
+	std::vector<std::pair<std::string, std::string>> parameters;
+};
+
+// splits a comma separated list
+static std::vector<std::string> split_list(const std::string& str) {
+	std::vector<std::string> items;
+	for (size_t start = 0; start <= str.size();) {
+		size_t end = str.find(',', start);
+		if (end == std::string::npos) end = str.size();
+		items.push_back(str.substr(start, end-start));
+		start = end+1;
+	}
+	return items;
+}
+
+static void print_plugin_info(const Plugin& plugin) {
+	std::cout << "Plugin: " << plugin.path << "\n"
+	          << "name: " << plugin.name << "\n"
+	          << "version: v"
+	          	<< plugin.version[0] << '.'
+	          	<< plugin.version[1] << '.'
+	          	<< plugin.version[2] << "\n"
+	          << "description: " << plugin.description << "\n"
+	          << "author: " << plugin.author << "\n"
+	          << "api version: " << plugin.api_version
+	          	<< (plugin.api_version >= 2 ? " (processes blocks)" : " (processes the whole signal)") << "\n"
+	          << "\n"
+	          << "Parameters: \n";
+
+	for (const auto& port : plugin.input_port_infos) {
+		if (port.type == Port::Type::parameter) {
+			std::cout << "  " << port.name << ": \n"
+			          << "    properties: "
+			          	<< (port.properties & Port::Properties::automatable ? "automatable " : "")
+			          << "\n"
+			          << "    min: " << port.min << port.units << "\n"
+			          << "    max: " << port.max << port.units << "\n"
+			          << "    default: " << port.value << port.units << "\n";
+		} else if (port.type == Port::Type::path) {
+			std::cout << "  " << port.name << ": \n"
+			          << "    type: path\n"
+			          << "    default: \"" << port.text << "\"\n";
+		}
+	}
+
+	std::cout << "\n"
+	          << "Audio:\n"
+	          << "  Input:\n";
+
+	for (const auto& port : plugin.input_port_infos)
+		if (port.type == Port::Type::audio)
+			std::cout << "    " << port.name << "\n";
+	std::cout << "  Output:\n";
+
+	for (const auto& port : plugin.output_port_infos)
+		if (port.type == Port::Type::audio)
+			std::cout << "    " << port.name << "\n";
+}
+
+// runs task on another thread and shows a spinner until it completes
+static void run_with_spinner(const std::string& message, const std::function<void()>& task) {
+	auto future_obj = std::async(std::launch::async, task);
+	size_t state = 0;
+	std::cout << message << "  ";
+	do {
+		std::cout << '\b';
+		switch (state) {
+			case 0:
+				std::cout << '|';
+				break;
+			case 1:
+				std::cout << '/';
+				break;
+			case 2:
+				std::cout << '-';
+				break;
+			case 3:
+				std::cout << '\\';
+				break;
+		}
+		std::cout << std::flush;
+		state = (state+1)%4;
+	} while (future_obj.wait_for(std::chrono::milliseconds(250)) != std::future_status::ready);
+	std::cout << std::endl;
+	// rethrows errors from the task
+	future_obj.get();
+}
+
+// how each file is processed
+struct File_Options {
+	int padding = 0;
+	bool auto_padding = false;
+	Sample_Format format = Sample_Format::float32;
+	bool dither = false;
+	// prints the progress and shows a spinner while the plugins run
+	bool verbose = true;
+	// the threads running the graph, 0 uses one per hardware thread
+	size_t threads = 0;
+};
+
+// limits the memory held by the files which are processed at once
+class Memory_Budget {
+public:
+	explicit Memory_Budget(size_t bytes) : m_budget(bytes) {}
+
+	// waits until bytes fit in the budget, larger requests wait until no other file is being processed
+	void acquire(size_t bytes) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_released.wait(lock, [&] { return m_used == 0 || m_used + bytes <= m_budget; });
+		m_used += bytes;
+	}
+
+	void release(size_t bytes) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_used -= bytes;
+		}
+		m_released.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_released;
+	size_t m_budget;
+	size_t m_used = 0;
+};
+
+static size_t physical_memory() {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		MEMORYSTATUSEX status;
+		status.dwLength = sizeof(status);
+		GlobalMemoryStatusEx(&status);
+		return static_cast<size_t>(status.ullTotalPhys);
+	#elif __APPLE__ || __linux__
+		return static_cast<size_t>(sysconf(_SC_PHYS_PAGES))*static_cast<size_t>(sysconf(_SC_PAGE_SIZE));
+	#endif
+}
+
+/**
+ * The number of channels read from a file with file_channels channels. Without a route the
+ * file's channels are matched to the inputs of the first plugin which reads them, extra
+ * channels are dropped and missing ones are silent.
+ */
+static size_t graph_input_channels(const std::vector<Graph_Node>& nodes, size_t file_channels) {
+	if (!nodes.empty() && nodes.front().plugin && nodes.front().route.empty()
+	    && (nodes.front().from.empty() || nodes.front().from == "input"))
+		return nodes.front().plugin->audio_input_count();
+	return file_channels;
+}
+
+// builds the processing graph of nodes, the plugins are copied so that a graph can be built for every file
+static Processing_Graph build_graph(const std::vector<Graph_Node>& nodes, size_t input_channels) {
+	// the values of the named nodes
+	std::map<std::string, size_t> values = {{"input", 0}};
+	const auto find_value = [&](const std::string& name) {
+		auto it = values.find(name);
+		if (it == values.end())
+			throw std::invalid_argument("unknown node '" + name + "', nodes must be named before they are used");
+		return it->second;
+	};
+
+	Processing_Graph graph(input_channels);
+	for (size_t index = 0; index < nodes.size(); ++index) {
+		const Graph_Node& node = nodes[index];
+		size_t value;
+		if (node.plugin) {
+			const Plugin& plugin = *node.plugin;
+			const size_t source = node.from.empty() ? index : find_value(node.from);
+			std::vector<Processing_Graph::Channel> inputs;
+			if (node.route.empty()) {
+				if (graph.channels(source) != plugin.audio_input_count())
+					throw std::invalid_argument(plugin.name + " has " + std::to_string(plugin.audio_input_count())
+					                            + " audio inputs but receives " + std::to_string(graph.channels(source))
+					                            + " channels, use --route to connect them");
+				for (size_t channel = 0; channel < graph.channels(source); ++channel)
+					inputs.push_back({source, channel});
+			}
+			for (const std::string& entry : node.route) {
+				const size_t separator = entry.rfind(':');
+				if (separator == std::string::npos) inputs.push_back({source, std::stoul(entry)});
+				else inputs.push_back({find_value(entry.substr(0, separator)), std::stoul(entry.substr(separator+1))});
+			}
+			value = graph.add_plugin(std::make_unique<Plugin>(plugin), std::move(inputs));
+		} else {
+			std::vector<size_t> sources;
+			for (const std::string& name : node.sources) sources.push_back(find_value(name));
+			value = node.type == Graph_Node::Type::mix ? graph.add_mix(sources) : graph.add_merge(sources);
+		}
+
+		if (!node.name.empty() && !values.emplace(node.name, value).second)
+			throw std::invalid_argument("more than one node is named '" + node.name + "'");
+	}
+	return graph;
+}
+
+/**
+ * Processes input_file with the graph of nodes, whose plugins must be loaded, and writes the result
+ * to output_file. The memory used by the file is taken from budget unless it is nullptr.
+ */
+static void process_file(const std::vector<Graph_Node>& nodes, const std::filesystem::path& input_file,
+                         const std::filesystem::path& output_file, const File_Options& options, Memory_Budget* budget) {
+	if (options.verbose) std::cout << "reading audio from " << input_file << std::endl;
+	const Wav_Layout layout = Audio_Reader::probe(input_file);
+
+	const size_t original_size = static_cast<size_t>(layout.frames());
+	int padding = options.padding;
+	if (options.auto_padding) {
+		const size_t padded_size = next_smooth_size(original_size);
+		padding = static_cast<int>(padded_size - original_size);
+		if (options.verbose)
+			std::cout << "padding " << original_size << " samples to " << padded_size << "\n"
+			          << "estimated transform cost: " << estimated_transform_cost(padded_size)/1e6 << " Mflop"
+			          << " (" << estimated_transform_cost(original_size)/1e6 << " Mflop without padding)" << std::endl;
+	}
+
+	const size_t input_channels = graph_input_channels(nodes, layout.channels);
+	Processing_Graph graph = build_graph(nodes, input_channels);
+
+	// the file waits until the memory of its decoded audio and io buffers fits in the budget
+	// before the file is opened or the plugins are activated. The estimate from the header is
+	// replaced by the exact amount once the tails are known, growing releases the estimate
+	// before waiting so a file never holds part of the budget while waiting for more.
+	struct Reservation {
+		Memory_Budget* budget;
+		size_t bytes = 0;
+		void resize(size_t new_bytes) {
+			if (!budget) return;
+			if (new_bytes <= bytes) {
+				budget->release(bytes - new_bytes);
+			} else {
+				budget->release(bytes);
+				budget->acquire(new_bytes);
+			}
+			bytes = new_bytes;
+		}
+		~Reservation() { if (budget) budget->release(bytes); }
+	} reservation = {budget};
+	const size_t io_bytes = Audio_Reader::buffer_bytes() + Audio_Writer::buffer_bytes();
+	reservation.resize(graph.estimated_peak_bytes(original_size+padding) + io_bytes);
+
+	Audio_Reader reader(input_file);
+	Audio_Info info = reader.info();
+
+	// block processing plugins report their latency and the length of the tail which follows the input
+	graph.activate(info.sample_rate);
+	std::string names;
+	for (size_t node = 0; node < graph.nodes(); ++node) {
+		const Plugin* plugin = graph.plugin(node);
+		names += (node ? ", " : "") + (plugin ? plugin->name : nodes[node].type == Graph_Node::Type::mix ? "mix" : "merge");
+		if (options.verbose && plugin && (plugin->latency() || plugin->tail_length()))
+			std::cout << plugin->name << " latency: " << plugin->latency() << " samples, tail: " << plugin->tail_length() << " samples" << std::endl;
+	}
+
+	reservation.resize(graph.peak_bytes(original_size+padding) + io_bytes);
+
+	// the padding is allocated along with the audio, as are the tails of the plugins which process it in place
+	Audio_Buffer input = reader.read_all(input_channels, graph.reserved_frames(original_size+padding));
+	input.resize(input_channels, original_size+padding);
+
+	// independent branches of the graph run concurrently
+	Audio_Buffer audio;
+	if (!graph.nodes()) audio = std::move(input);
+	else if (options.verbose) run_with_spinner("Running " + names, [&] { audio = graph.run(std::move(input), options.threads); });
+	else audio = graph.run(std::move(input), options.threads);
+
+	// remove the automatic padding
+	if (options.auto_padding)
+		audio.resize(audio.channels(), original_size + graph.tail());
+
+	// audio which still refers to the mapped input is copied, as opening the output truncates the input
+	// when they are the same file
+	if (audio.mapped()) audio.reserve(audio.channels(), audio.frames());
+
+	if (options.verbose) std::cout << "writing output to " << output_file << std::endl;
+	info.format = options.format;
+	info.dither = options.dither;
+	write_audio_file(output_file, audio, info);
+}
+
+// true if name matches pattern, in which * matches any characters and ? matches one character
+static bool matches_pattern(const char* pattern, const char* name) {
+	if (*pattern == '*')
+		return matches_pattern(pattern+1, name) || (*name && matches_pattern(pattern, name+1));
+	if (!*pattern) return !*name;
+	return *name && (*pattern == '?' || *pattern == *name) && matches_pattern(pattern+1, name+1);
+}
+
+/**
+ * The input and output files of a batch. batch is either a pattern matching the names of the
+ * input files in a directory, or a manifest listing an input file on each line, optionally
+ * followed by a tab and its output file. Outputs which are not given are written to
+ * output_directory with the name of the input.
+ */
+static std::vector<std::pair<std::filesystem::path, std::filesystem::path>> batch_files(
+	const std::string& batch, const std::filesystem::path& output_directory
+) {
+	const auto output_for = [&](const std::filesystem::path& input) {
+		if (output_directory.empty())
+			throw std::invalid_argument("--output-dir must be given for batch inputs without an output file");
+		return output_directory / input.filename();
+	};
+
+	std::vector<std::pair<std::filesystem::path, std::filesystem::path>> files;
+	if (batch.find_first_of("*?") != std::string::npos) {
+		const std::filesystem::path pattern = batch;
+		const std::filesystem::path directory = pattern.has_parent_path() ? pattern.parent_path() : ".";
+		const std::string name_pattern = pattern.filename().string();
+		std::vector<std::filesystem::path> inputs;
+		for (const auto& entry : std::filesystem::directory_iterator(directory))
+			if (entry.is_regular_file() && matches_pattern(name_pattern.c_str(), entry.path().filename().string().c_str()))
+				inputs.push_back(entry.path());
+		std::sort(inputs.begin(), inputs.end());
+		for (const auto& input : inputs) files.emplace_back(input, output_for(input));
+		return files;
+	}
+
+	std::ifstream manifest(batch);
+	if (!manifest) throw std::runtime_error("unable to open batch manifest: " + batch);
+	std::string line;
+	while (std::getline(manifest, line)) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty() || line.front() == '#') continue;
+
+		const size_t separator = line.find('\t');
+		if (separator == std::string::npos) files.emplace_back(line, output_for(line));
+		else files.emplace_back(line.substr(0, separator), line.substr(separator+1));
+	}
+	return files;
+}
+
 int main(int argc, const char* argv[]) {
 
-	std::map<std::string, std::string> flags = parse_cmd_line_args(argc, argv);
+	// options which apply to the whole run, the others set parameters of the preceding plugin
+	const std::unordered_set<std::string> global_options = {
+		"--help", "--version", "--info", "--pad", "--format", "--dither", "--input", "--output",
+		"--batch", "--output-dir", "--jobs", "--memory"
+	};
+
+	std::map<std::string, std::string> flags;
+	std::vector<Graph_Node> nodes;
+	// parameters given before the first plugin apply to it
+	std::vector<std::pair<std::string, std::string>> leading_parameters;
+	const auto preceding_plugin = [&](const std::string& argument) -> Graph_Node& {
+		if (nodes.empty() || nodes.back().type != Graph_Node::Type::plugin)
+			throw std::invalid_argument(argument + " must follow the plugin it applies to");
+		return nodes.back();
+	};
+	for (auto& [argument, value] : parse_cmd_line_args(argc, argv)) {
+		if (argument == "--plugin") {
+			nodes.emplace_back();
+			nodes.back().plugin = std::make_unique<Plugin>();
+			nodes.back().plugin->parse_plugin_file(value);
+		} else if (argument == "--mix" || argument == "--merge") {
+			nodes.emplace_back();
+			nodes.back().type = argument == "--mix" ? Graph_Node::Type::mix : Graph_Node::Type::merge;
+			nodes.back().sources = split_list(value);
+		} else if (argument == "--node") {
+			if (nodes.empty()) throw std::invalid_argument("--node must follow the node it names");
+			nodes.back().name = value;
+		} else if (argument == "--from") {
+			preceding_plugin(argument).from = value;
+		} else if (argument == "--route") {
+			preceding_plugin(argument).route = split_list(value);
+		} else if (global_options.count(argument)) {
+			flags.insert({argument, value});
+		} else if (nodes.empty()) {
+			leading_parameters.emplace_back(argument.substr(2), value);
+		} else {
+			preceding_plugin(argument).parameters.emplace_back(argument.substr(2), value);
+		}
+	}
+	if (!leading_parameters.empty()) {
+		if (nodes.empty() || nodes.front().type != Graph_Node::Type::plugin)
+			throw std::invalid_argument("'" + leading_parameters.front().first + "' does not match any known parameters");
+		nodes.front().parameters.insert(nodes.front().parameters.begin(), leading_parameters.begin(), leading_parameters.end());
+	}
 
 	if (flags.find("--help") != flags.end()) {
 		std::cout << "Usage: " << argv[0] << " [OPTION]... input_file output_file\n"
+		          << "       " << argv[0] << " [OPTION]... --batch=FILES\n"
 		          << "Options:\n"
 		          << "  -h, --help                    Prints this help string\n"
 		          << "  -v, --version                 Prints version information\n"
-		          << "  -p, --plugin=PLUGIN_PATH      Path to the plugin\n"
+		          << "  -p, --plugin=PLUGIN_PATH      Path to the plugin, plugins given more than once\n"
+		          << "                                  are chained in order, each one processing\n"
+		          << "                                  the output of the previous node\n"
+		          << "      --node=NAME               Names the preceding node, the input file is input\n"
+		          << "      --from=NAME               Connects the output of node NAME to the\n"
+		          << "                                  preceding plugin instead of the previous node\n"
+		          << "      --route=CHANNELS          Comma separated channels connected to each audio\n"
+		          << "                                  input of the preceding plugin, as CHANNEL of\n"
+		          << "                                  the node it reads or NAME:CHANNEL\n"
+		          << "      --mix=NAMES               Adds a node summing the comma separated nodes\n"
+		          << "      --merge=NAMES             Adds a node holding the channels of the comma\n"
+		          << "                                  separated nodes, the last node is the output\n"
 		          << "  -i, --info                    Prints information about the\n"
-		          << "                                  selected plugin then exits\n"
+		          << "                                  selected plugins then exits\n"
 		          << "  -l, --pad=PADDING_LENGTH      Pads the input audio with PADDING_LENGTH samples\n"
 				  << "                                  Negative values will reduce the number of samples\n"
-		          << "      --PARAM_NAME=PARAM_VALUE  Sets the plugin parameter\n"
-		          << "                                  PARAM_NAME to PARAM_VALUE\n"
+		          << "      --pad=auto                Pads the input audio to a length with only the\n"
+		          << "                                  prime factors 2, 3, 5 and 7 which is fast to\n"
+		          << "                                  transform, the output is trimmed back\n"
+		          << "      --format=FORMAT           Sample format of the output file, one of\n"
+		          << "                                  float32 (default), pcm16 or pcm24\n"
+		          << "      --dither                  Adds triangular dither when writing pcm samples\n"
+		          << "      --batch=FILES             Processes many files instead of input_file,\n"
+		          << "                                  FILES is a pattern such as clips/*.wav or a\n"
+		          << "                                  manifest listing an input file on each line,\n"
+		          << "                                  optionally followed by a tab and the output file\n"
+		          << "      --output-dir=DIRECTORY    Where batch outputs without a file are written\n"
+		          << "      --jobs=N                  Number of batch files processed at once, one\n"
+		          << "                                  per hardware thread by default\n"
+		          << "      --memory=MEGABYTES        Limits the memory of the batch files processed\n"
+		          << "                                  at once, half of the physical memory by default\n"
+		          << "      --PARAM_NAME=PARAM_VALUE  Sets the parameter PARAM_NAME of the preceding\n"
+		          << "                                  plugin to PARAM_VALUE\n"
 		          << version_str;
 		return 0;
 	}
@@ -87,59 +565,100 @@ int main(int argc, const char* argv[]) {
 		return 0;
 	}
 
-	int padding = 0;
-	if (flags.find("--pad") != flags.end())
-		padding = std::stoi(flags.extract("--pad").mapped());
+	File_Options options;
+	if (flags.find("--pad") != flags.end()) {
+		const std::string pad = flags.extract("--pad").mapped();
+		if (pad == "auto") options.auto_padding = true;
+		else options.padding = std::stoi(pad);
+	}
 
-	Plugin plugin;
-	if (flags.find("--plugin") != flags.end())
-		plugin.parse_plugin_file(flags.extract("--plugin").mapped());
-	else
+	if (flags.find("--format") != flags.end()) {
+		const std::string format = flags.extract("--format").mapped();
+		if (format == "pcm16") options.format = Sample_Format::pcm16;
+		else if (format == "pcm24") options.format = Sample_Format::pcm24;
+		else if (format != "float32") throw std::invalid_argument("unsupported output format: " + format);
+	}
+
+	options.dither = flags.erase("--dither") > 0;
+
+	if (std::none_of(nodes.begin(), nodes.end(), [](const Graph_Node& node) { return node.plugin != nullptr; }))
 		std::cout << "Warning: plugin flag missing\n";
 
 	if (flags.find("--info") != flags.end()) {
-		if (!plugin)
+		bool printed = false;
+		for (Graph_Node& node : nodes) {
+			if (!node.plugin) continue;
+			if (printed) std::cout << "\n";
+			node.plugin->load_plugin();
+			print_plugin_info(*node.plugin);
+			printed = true;
+		}
+		if (!printed)
 			throw std::invalid_argument("--info flags specified without a plugin!");
+		return 0;
+	}
 
-		std::cout << "Plugin: " << plugin.path << "\n"
-		          << "name: " << plugin.name << "\n"
-		          << "version: v"
-		          	<< plugin.version[0] << '.'
-		          	<< plugin.version[1] << '.'
-		          	<< plugin.version[2] << "\n"
-		          << "description: " << plugin.description << "\n"
-		          << "author: " << plugin.author << "\n"
-		          << "\n"
-		          << "Parameters: \n";
-
-		for (const auto& port : plugin.input_port_infos) {
-			if (port.type == Port::Type::parameter) {
-				std::cout << "  " << port.name << ": \n"
-				          << "    properties: "
-				          	<< (port.properties & Port::Properties::automatable ? "automatable " : "")
-				          << "\n"
-				          << "    min: " << port.min << port.units << "\n"
-				          << "    max: " << port.max << port.units << "\n"
-				          << "    default: " << port.value << port.units << "\n";
-			}
-		}
 
-		std::cout << "\n"
-		          << "Audio:\n"
-		          << "  Input:\n";
+	// the plugins are loaded once, each file processes copies of them
+	for (Graph_Node& node : nodes) {
+		if (!node.plugin) continue;
+		for (const auto& [name, value] : node.parameters)
+			node.plugin->set_parameter(name, value);
+		node.plugin->load_plugin();
+	}
 
-		for (const auto& port : plugin.input_port_infos)
-			if (port.type == Port::Type::audio)
-				std::cout << "    " << port.name << "\n";
-		std::cout << "  Output:\n";
+	if (flags.find("--batch") != flags.end()) {
+		if (flags.find("--input") != flags.end())
+			throw std::invalid_argument("the input and output files of a batch are given by --batch");
 
-		for (const auto& port : plugin.output_port_infos)
-			if (port.type == Port::Type::audio)
-				std::cout << "    " << port.name << "\n";
+		std::filesystem::path output_directory;
+		if (flags.find("--output-dir") != flags.end()) {
+			output_directory = flags.extract("--output-dir").mapped();
+			std::filesystem::create_directories(output_directory);
+		}
+		const auto files = batch_files(flags.extract("--batch").mapped(), output_directory);
+
+		size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+		if (flags.find("--jobs") != flags.end())
+			jobs = std::max<size_t>(std::stoul(flags.extract("--jobs").mapped()), 1);
+		jobs = std::min(jobs, files.size());
+
+		size_t memory = physical_memory()/2;
+		if (flags.find("--memory") != flags.end())
+			memory = std::stoull(flags.extract("--memory").mapped()) << 20;
+		Memory_Budget budget(memory);
+
+		// every file is processed by one thread
+		options.verbose = false;
+		options.threads = 1;
+
+		std::atomic<size_t> next_file = 0, processed = 0, failed = 0;
+		std::mutex output_mutex;
+		const auto work = [&] {
+			for (size_t file; (file = next_file++) < files.size();) {
+				const auto& [input_file, output_file] = files[file];
+				try {
+					process_file(nodes, input_file, output_file, options, &budget);
+					std::lock_guard<std::mutex> lock(output_mutex);
+					std::cout << "[" << ++processed + failed << "/" << files.size() << "] "
+					          << input_file << " -> " << output_file << std::endl;
+				} catch (const std::exception& e) {
+					std::lock_guard<std::mutex> lock(output_mutex);
+					std::cerr << "[" << processed + ++failed << "/" << files.size() << "] "
+					          << "failed to process " << input_file << ": " << e.what() << std::endl;
+				}
+			}
+		};
 
-		return 0;
-	}
+		std::vector<std::thread> workers;
+		for (size_t worker = 1; worker < jobs; ++worker)
+			workers.emplace_back(work);
+		work();
+		for (auto& worker : workers) worker.join();
 
+		std::cout << "processed " << processed << " of " << files.size() << " files" << std::endl;
+		return failed ? 1 : 0;
+	}
 
 	std::filesystem::path input_file, output_file;
 	if (flags.find("--input") != flags.end())
@@ -152,106 +671,7 @@ int main(int argc, const char* argv[]) {
 	else
 		throw std::invalid_argument("output file not specified!");
 
-	for (const auto& arg : flags)
-		plugin.set_parameter(arg.first.substr(2), std::stof(arg.second));
-
-
-	if (plugin) plugin.load_plugin();
-
-	// read audio file
-	std::cout << "reading audio from " << input_file << std::endl;
-	Audio_Info info;
-	auto input_audio = read_audio_file(input_file, info);
-
-	// connect input ports
-	{
-		// find the number of input audio ports
-		if (plugin) {
-			size_t input_port_count = 0;
-			for (const auto& port : plugin.input_port_infos)
-				if (port.type == Port::Type::audio) ++input_port_count;
-
-			input_audio.resize(input_port_count);
-		}
-
-		const size_t original_size = input_audio.front().size();
-		// add padding
-		for (auto& channel : input_audio)
-			channel.resize(original_size+padding, 0.f);
-
-		// connect ports
-		if (plugin) {
-			size_t connected_ports = 0;
-			for (size_t port = 0; port < plugin.input_ports.size(); ++port) {
-				if (plugin.input_port_infos[port].type == Port::Type::audio) {
-					plugin.input_ports[port] = input_audio[connected_ports].data();
-					++connected_ports;
-				}
-			}
-		}
-	}
-
-	std::vector<std::vector<float>> output_audio;
-
-	// connect output ports
-	{
-		// find the number of output audio ports
-		size_t output_port_count = 0;
-		if (plugin) {
-			for (const auto& port : plugin.output_port_infos)
-				if (port.type == Port::Type::audio) ++output_port_count;
-		} else {
-			output_port_count = input_audio.size();
-		}
-
-		output_audio.resize(output_port_count);
-
-		// resize output audio
-		for (auto& channel : output_audio)
-			channel.resize(input_audio.front().size());
-
-		// connect ports
-		if (plugin) {
-			size_t connected_ports = 0;
-			for (size_t port = 0; port < plugin.output_ports.size(); ++port) {
-				if (plugin.output_port_infos[port].type == Port::Type::audio) {
-					plugin.output_ports[port] = output_audio[connected_ports].data();
-					++connected_ports;
-				}
-			}
-		}
-	}
-
-	if (plugin) {
-		auto future_obj = std::async(std::launch::async, &Plugin::run, &plugin, input_audio.front().size(), info.sample_rate);
-		size_t state = 0;
-		std::cout << "Running plugin  ";
-		do {
-			std::cout << '\b';
-			switch (state) {
-				case 0:
-					std::cout << '|';
-					break;
-				case 1:
-					std::cout << '/';
-					break;
-				case 2:
-					std::cout << '-';
-					break;
-				case 3:
-					std::cout << '\\';
-					break;
-			}
-			std::cout << std::flush;
-			state = (state+1)%4;
-		} while (future_obj.wait_for(std::chrono::milliseconds(250)) != std::future_status::ready);
-		std::cout << std::endl;
-	} else {
-		output_audio = std::move(input_audio);
-	}
-
-	std::cout << "writing output to " << output_file << std::endl;
-	write_audio_file(output_file, output_audio, info);
+	process_file(nodes, input_file, output_file, options, nullptr);
 
 	return 0;
 }
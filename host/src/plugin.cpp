@@ -183,6 +183,7 @@ static std::vector<Port> parse_ports(const std::string& str) {
 			const std::string port_type = obj_port.find("type")->second;
 			if (port_type == "audio") port.type = Port::Type::audio;
 			else if (port_type == "parameter") port.type = Port::Type::parameter;
+			else if (port_type == "path") port.type = Port::Type::path;
 			else {
 				std::cerr << "WARNING: Ignoring port: Unrecognized port type. This plugin may not work correctly!" << std::endl;
 				continue;
@@ -199,8 +200,12 @@ static std::vector<Port> parse_ports(const std::string& str) {
 		}
 
 		// get port range
-		if (obj_port.find("default") != obj_port.end())
-			port.default_value = port.value = std::stof(obj_port.find("default")->second);
+		if (obj_port.find("default") != obj_port.end()) {
+			if (port.type == Port::Type::path)
+				port.default_text = port.text = parse_string(obj_port.find("default")->second);
+			else
+				port.default_value = port.value = std::stof(obj_port.find("default")->second);
+		}
 		if (obj_port.find("min") != obj_port.end())
 			port.min = std::stof(obj_port.find("min")->second);
 		if (obj_port.find("max") != obj_port.end())
@@ -296,12 +301,26 @@ void Plugin::set_parameter(const std::string& parameter_name, float new_value) {
 	throw std::invalid_argument("'" + parameter_name + "' does not match any known parameters");
 }
 
+void Plugin::set_parameter(const std::string& parameter_name, const std::string& new_value) {
+	for (auto& port : input_port_infos) {
+		if (port.type == Port::Type::path && port.name == parameter_name) {
+			port.text = new_value;
+			return;
+		}
+	}
+	set_parameter(parameter_name, std::stof(new_value));
+}
+
 void Plugin::reset_parameter(const std::string& parameter_name) {
 	for (auto& port : input_port_infos) {
 		if (port.type == Port::Type::parameter && port.name == parameter_name) {
 			port.value = port.default_value;
 			return;
 		}
+		if (port.type == Port::Type::path && port.name == parameter_name) {
+			port.text = port.default_text;
+			return;
+		}
 	}
 	throw std::invalid_argument("'" + parameter_name + "' does not match any known parameters");
 }
@@ -330,40 +349,268 @@ void Plugin::clear_automation(const std::string& parameter_name) {
 	throw std::invalid_argument("'" + parameter_name + "' does not match any known parameters");
 }
 
+Plugin::Plugin(const Plugin& other)
+	: path(other.path),
+	  name(other.name),
+	  version(other.version),
+	  description(other.description),
+	  author(other.author),
+	  supports(other.supports),
+	  binary(other.binary),
+	  input_port_infos(other.input_port_infos),
+	  input_ports(other.input_ports.size()),
+	  output_port_infos(other.output_port_infos),
+	  output_ports(other.output_ports.size()),
+	  plugin_library(other.plugin_library),
+	  api_version(other.api_version),
+	  pfn_process(other.pfn_process),
+	  pfn_instantiate(other.pfn_instantiate),
+	  pfn_activate(other.pfn_activate),
+	  pfn_process_block(other.pfn_process_block),
+	  pfn_deactivate(other.pfn_deactivate),
+	  pfn_destroy(other.pfn_destroy),
+	  pfn_latency(other.pfn_latency),
+	  pfn_tail_length(other.pfn_tail_length) {
+	for (size_t port = 0; port < input_port_infos.size(); ++port)
+		if (input_port_infos[port].type == Port::Type::parameter)
+			input_ports[port] = &input_port_infos[port].value;
+}
+
+Plugin::~Plugin() {
+	deactivate();
+}
+
 void Plugin::load_plugin() {
-	plugin_library = Dynamic_Library(path / binary);
-	pfn_process = reinterpret_cast<Process_Function>(plugin_library.get_function_address("process"));
+	plugin_library = std::make_shared<Dynamic_Library>(path / binary);
+	const auto pfn_api_version = reinterpret_cast<Plugin_API_Version_Function>(plugin_library->find_function_address("plugin_api_version"));
+	api_version = pfn_api_version ? (*pfn_api_version)() : 1;
+	if (api_version > PLUGIN_API_VERSION)
+		throw std::runtime_error("the plugin requires version " + std::to_string(api_version) + " of the plugin api, the host supports up to version " + std::to_string(PLUGIN_API_VERSION) + "!");
+
+	pfn_process = reinterpret_cast<Process_Function>(plugin_library->find_function_address("process"));
+	pfn_instantiate = reinterpret_cast<Instantiate_Function>(plugin_library->find_function_address("instantiate"));
+	pfn_activate = reinterpret_cast<Activate_Function>(plugin_library->find_function_address("activate"));
+	pfn_process_block = reinterpret_cast<Process_Block_Function>(plugin_library->find_function_address("process_block"));
+	pfn_deactivate = reinterpret_cast<Deactivate_Function>(plugin_library->find_function_address("deactivate"));
+	pfn_destroy = reinterpret_cast<Destroy_Function>(plugin_library->find_function_address("destroy"));
+	pfn_latency = reinterpret_cast<Latency_Function>(plugin_library->find_function_address("latency"));
+	pfn_tail_length = reinterpret_cast<Tail_Length_Function>(plugin_library->find_function_address("tail_length"));
+
+	if (api_version >= 2 && !(pfn_instantiate && pfn_activate && pfn_process_block && pfn_deactivate && pfn_destroy))
+		throw std::runtime_error("the plugin binary does not export the block processing functions!");
+	if (api_version < 2 && !pfn_process)
+		throw std::runtime_error("the plugin binary does not export process!");
 }
 
-void Plugin::run(size_t n_samples, double sample_rate) {
-	// create arrays for automatable ports
+size_t Plugin::audio_input_count() const {
+	return std::count_if(input_port_infos.begin(), input_port_infos.end(),
+	                     [](const Port& port) { return port.type == Port::Type::audio; });
+}
+
+size_t Plugin::audio_output_count() const {
+	return std::count_if(output_port_infos.begin(), output_port_infos.end(),
+	                     [](const Port& port) { return port.type == Port::Type::audio; });
+}
+
+void Plugin::activate(double sample_rate, size_t block_size) {
+	if (api_version < 2 || active) return;
+
+	if (!instance) {
+		const Global_Parameters params = {
+			sample_rate,
+			path.c_str()
+		};
+		instance = (*pfn_instantiate)(&params);
+		if (!instance) throw std::runtime_error("unable to create an instance of " + name);
+	}
+	// the parameters and paths are connected for the instance to read, audio ports are not
+	for (size_t port = 0; port < input_port_infos.size(); ++port) {
+		const Port& info = input_port_infos[port];
+		if (info.type == Port::Type::audio) input_ports[port] = nullptr;
+		else if (info.type == Port::Type::path) input_ports[port] = reinterpret_cast<const float*>(info.text.c_str());
+		else input_ports[port] = info.automated ? info.value_arr : &info.value;
+	}
+	const int status = (*pfn_activate)(instance, input_ports.data(), block_size);
+	for (size_t port = 0; port < input_port_infos.size(); ++port)
+		if (input_port_infos[port].type == Port::Type::parameter)
+			input_ports[port] = &input_port_infos[port].value;
+	if (status) throw std::runtime_error("unable to activate " + name);
+	active = true;
+	max_block_size = block_size;
+
+	size_t automatable_ports = 0;
+	for (const auto& port : input_port_infos)
+		if (port.type == Port::Type::parameter && (port.properties & Port::Properties::automatable))
+			++automatable_ports;
+	block_automation = Audio_Buffer(automatable_ports, block_size);
+}
+
+void Plugin::deactivate() {
+	if (active) (*pfn_deactivate)(instance);
+	if (instance) (*pfn_destroy)(instance);
+	active = false;
+	instance = nullptr;
+}
+
+size_t Plugin::latency() const {
+	return active && pfn_latency ? (*pfn_latency)(instance) : 0;
+}
+
+size_t Plugin::tail_length() const {
+	return active && pfn_tail_length ? (*pfn_tail_length)(instance) : 0;
+}
+
+void Plugin::process_block(const float* const* inputs, float* const* outputs, size_t n_samples, size_t position) {
+	if (!active)
+		throw std::logic_error("attempted to process a block with a plugin which is not active");
+	if (n_samples > max_block_size)
+		throw std::invalid_argument("the block is larger than the plugin was activated for");
+
+	size_t input_channel = 0, output_channel = 0, automation_channel = 0;
+	for (size_t port = 0; port < input_port_infos.size(); ++port) {
+		const Port& info = input_port_infos[port];
+		if (info.type == Port::Type::audio) {
+			input_ports[port] = inputs[input_channel++];
+		} else if (info.type == Port::Type::path) {
+			// the strings may have been reallocated when they were set
+			input_ports[port] = reinterpret_cast<const float*>(info.text.c_str());
+		} else if (info.properties & Port::Properties::automatable) {
+			if (info.automated) {
+				input_ports[port] = info.value_arr + position;
+			} else {
+				float* arr = block_automation.channel(automation_channel++);
+				std::fill_n(arr, n_samples, info.value);
+				input_ports[port] = arr;
+			}
+		}
+	}
+	for (size_t port = 0; port < output_port_infos.size(); ++port)
+		if (output_port_infos[port].type == Port::Type::audio)
+			output_ports[port] = outputs[output_channel++];
+
+	(*pfn_process_block)(instance, input_ports.data(), output_ports.data(), n_samples);
+
+	// reconnect the parameters to their values
+	for (size_t port = 0; port < input_port_infos.size(); ++port)
+		if (input_port_infos[port].type == Port::Type::parameter)
+			input_ports[port] = &input_port_infos[port].value;
+}
+
+/**
+ * Runs a version 2 plugin over input a block at a time. Input past the end is silent and the
+ * output is delayed by the latency, so the first latency frames of output are dropped.
+ */
+static void run_blocks(Plugin& plugin, const float* const* input, size_t input_frames,
+                       float* const* output, size_t output_frames, double sample_rate) {
+	plugin.activate(sample_rate, Plugin::default_block_size);
+	const size_t block_size = plugin.max_block_size;
+	const size_t latency = plugin.latency();
+	const size_t end = output_frames + latency;
+	const size_t input_channels = plugin.audio_input_count();
+	const size_t output_channels = plugin.audio_output_count();
+
+	// blocks which run past the input or start before the latency go through these blocks
+	Audio_Buffer input_block(input_channels, block_size);
+	Audio_Buffer output_block(output_channels, block_size);
+	std::vector<const float*> inputs(input_channels);
+	std::vector<float*> outputs(output_channels);
+	for (size_t position = 0; position < end; position += block_size) {
+		const size_t n_samples = std::min(block_size, end-position);
+
+		for (size_t channel = 0; channel < input_channels; ++channel) {
+			if (position + n_samples <= input_frames) {
+				inputs[channel] = input[channel] + position;
+				continue;
+			}
+			float* samples = input_block.channel(channel);
+			const size_t available = position < input_frames ? input_frames-position : 0;
+			if (available) std::copy_n(input[channel] + position, available, samples);
+			std::fill(samples + available, samples + n_samples, 0.f);
+			inputs[channel] = samples;
+		}
+
+		const bool direct = position >= latency && position-latency + n_samples <= output_frames;
+		for (size_t channel = 0; channel < output_channels; ++channel)
+			outputs[channel] = direct ? output[channel] + position-latency : output_block.channel(channel);
+
+		plugin.process_block(inputs.data(), outputs.data(), n_samples, position);
+
+		// keep the part of the block after the latency
+		const size_t first = std::max(position, latency);
+		if (!direct && first < position + n_samples) {
+			for (size_t channel = 0; channel < output_channels; ++channel)
+				std::copy(outputs[channel] + (first-position), outputs[channel] + n_samples, output[channel] + (first-latency));
+		}
+	}
+
+	plugin.deactivate();
+}
+
+void Plugin::run(const Audio_Buffer& input, Audio_Buffer& output, double sample_rate) {
+	std::vector<const float*> inputs(input.channels());
+	std::vector<float*> outputs(output.channels());
+	for (size_t channel = 0; channel < input.channels(); ++channel)
+		inputs[channel] = input.channel(channel);
+	for (size_t channel = 0; channel < output.channels(); ++channel)
+		outputs[channel] = output.channel(channel);
+	run(inputs.data(), input.frames(), outputs.data(), output.frames(), sample_rate);
+}
+
+void Plugin::run(const float* const* inputs, size_t input_frames,
+                 float* const* outputs, size_t output_frames, double sample_rate) {
+	if (api_version >= 2) return run_blocks(*this, inputs, input_frames, outputs, output_frames, sample_rate);
+	if (output_frames < input_frames) throw std::invalid_argument("the output is shorter than the input");
+
+	const size_t n_samples = input_frames;
+
+	// connect audio ports
+	size_t input_channel = 0, output_channel = 0;
+	for (size_t port = 0; port < input_port_infos.size(); ++port)
+		if (input_port_infos[port].type == Port::Type::audio)
+			input_ports[port] = inputs[input_channel++];
+	for (size_t port = 0; port < output_port_infos.size(); ++port)
+		if (output_port_infos[port].type == Port::Type::audio)
+			output_ports[port] = outputs[output_channel++];
+
+	// create arrays for automatable ports, all of them share one allocation
+	size_t automatable_ports = 0;
+	for (const auto& port : input_port_infos)
+		if (port.type == Port::Type::parameter && (port.properties & Port::Properties::automatable) && !port.automated)
+			++automatable_ports;
+
+	Audio_Buffer automation(automatable_ports, n_samples);
+	size_t automation_channel = 0;
 	for (size_t port = 0; port < input_port_infos.size(); ++port) {
 		if ((input_port_infos[port].type == Port::Type::parameter)
 		    && (input_port_infos[port].properties & Port::Properties::automatable)
 		    && !input_port_infos[port].automated
 		) {
-			float* arr = new float[n_samples];
-			for (size_t i = 0; i < n_samples; ++i)
-				arr[i] = input_port_infos[port].value;
+			float* arr = automation.channel(automation_channel++);
+			std::fill_n(arr, n_samples, input_port_infos[port].value);
 			input_port_infos[port].value_arr = arr;
 			input_ports[port] = input_port_infos[port].value_arr;
 		}
 	}
 
+	// connect path ports, the strings may have been reallocated when they were set
+	for (size_t port = 0; port < input_port_infos.size(); ++port)
+		if (input_port_infos[port].type == Port::Type::path)
+			input_ports[port] = reinterpret_cast<const float*>(input_port_infos[port].text.c_str());
+
 	Global_Parameters params = {
 		sample_rate,
 		path.c_str()
 	};
 	(*pfn_process)(&params, input_ports.data(), output_ports.data(), n_samples);
 
-	// destroy arrays for automatable ports
+	// disconnect the arrays for automatable ports
 	for (size_t port = 0; port < input_port_infos.size(); ++port) {
 		if ((input_port_infos[port].type == Port::Type::parameter)
 		    && (input_port_infos[port].properties & Port::Properties::automatable)
 		    && !input_port_infos[port].automated
 		) {
 			input_ports[port] = &input_port_infos[port].value;
-			delete[] input_port_infos[port].value_arr;
+			input_port_infos[port].value_arr = nullptr;
 		}
 	}
 }
@@ -0,0 +1,46 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include "sample_kernels_impl.hpp"
+
+const Sample_Kernels scalar_sample_kernels = {
+	"scalar",
+	scalar_pcm16_to_float,
+	scalar_pcm24_to_float,
+	scalar_pcm32_to_float,
+	scalar_float64_to_float,
+	scalar_float_to_pcm16,
+	scalar_float_to_pcm24,
+	scalar_deinterleave,
+	scalar_interleave
+};
+
+static const Sample_Kernels& select_sample_kernels() {
+	#if defined(__x86_64__) || defined(__i386__)
+		const Sample_Kernels* available[] = {&avx2_sample_kernels, &sse4_sample_kernels, &scalar_sample_kernels};
+		const bool supported[] = {
+			__builtin_cpu_supports("avx2") != 0,
+			__builtin_cpu_supports("sse4.1") != 0,
+			true
+		};
+	#else
+		const Sample_Kernels* available[] = {&scalar_sample_kernels};
+		const bool supported[] = {true};
+	#endif
+	constexpr std::size_t count = sizeof(available)/sizeof(available[0]);
+
+	if (const char* forced = std::getenv("SAMPLE_KERNELS")) {
+		for (std::size_t i = 0; i < count; ++i)
+			if (supported[i] && std::strcmp(forced, available[i]->name) == 0) return *available[i];
+	}
+
+	for (std::size_t i = 0; i < count; ++i)
+		if (supported[i]) return *available[i];
+	return scalar_sample_kernels;
+}
+
+const Sample_Kernels& sample_kernels() {
+	static const Sample_Kernels& kernels = select_sample_kernels();
+	return kernels;
+}
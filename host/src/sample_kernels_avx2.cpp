@@ -0,0 +1,143 @@
+#include <immintrin.h>
+
+#include <cstddef>
+
+#include "sample_kernels_impl.hpp"
+
+namespace {
+
+void pcm16_to_float(const char* in, float* out, std::size_t n) {
+	const __m256 scale = _mm256_set1_ps(1.f/32768.f);
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2*i));
+		const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2*i + 16));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(low)), scale));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(high)), scale));
+	}
+	scalar_pcm16_to_float(in + 2*i, out + i, n-i);
+}
+
+void pcm24_to_float(const char* in, float* out, std::size_t n) {
+	// moves each sample into the upper 3 bytes of a 32 bit integer, in each 128 bit lane
+	const __m256i shuffle = _mm256_setr_epi8(
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m256 scale = _mm256_set1_ps(1.f/2147483648.f);
+	std::size_t i = 0;
+	// the loads read 28 bytes for 8 samples so they must not reach the last 2 samples
+	for (; i + 10 <= n; i += 8) {
+		const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3*i));
+		const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3*i + 12));
+		const __m256i samples = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		const __m256i values = _mm256_shuffle_epi8(samples, shuffle);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(values), scale));
+	}
+	scalar_pcm24_to_float(in + 3*i, out + i, n-i);
+}
+
+void pcm32_to_float(const char* in, float* out, std::size_t n) {
+	const __m256 scale = _mm256_set1_ps(1.f/2147483648.f);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4*i));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+	}
+	scalar_pcm32_to_float(in + 4*i, out + i, n-i);
+}
+
+void float64_to_float(const char* in, float* out, std::size_t n) {
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128 low = _mm256_cvtpd_ps(_mm256_loadu_pd(reinterpret_cast<const double*>(in + 8*i)));
+		const __m128 high = _mm256_cvtpd_ps(_mm256_loadu_pd(reinterpret_cast<const double*>(in + 8*i + 32)));
+		_mm256_storeu_ps(out + i, _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1));
+	}
+	scalar_float64_to_float(in + 8*i, out + i, n-i);
+}
+
+// scales, dithers and clamps 8 samples to bits bits and rounds them to the nearest integer
+template <int bits>
+__m256i quantize(const float* in, const float* dither, std::size_t i) {
+	constexpr float scale = static_cast<float>(int32_t(1) << (bits-1));
+	__m256 value = _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_set1_ps(scale));
+	if (dither) value = _mm256_add_ps(value, _mm256_loadu_ps(dither + i));
+	value = _mm256_max_ps(_mm256_min_ps(value, _mm256_set1_ps(scale-1.f)), _mm256_set1_ps(-scale));
+	return _mm256_cvtps_epi32(value);
+}
+
+void float_to_pcm16(const float* in, const float* dither, char* out, std::size_t n) {
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		// packs works within 128 bit lanes so the 64 bit quarters are reordered afterwards
+		const __m256i packed = _mm256_packs_epi32(quantize<16>(in, dither, i), quantize<16>(in, dither, i+8));
+		const __m256i samples = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2*i), samples);
+	}
+	scalar_float_to_pcm16(in + i, dither ? dither + i : nullptr, out + 2*i, n-i);
+}
+
+void float_to_pcm24(const float* in, const float* dither, char* out, std::size_t n) {
+	// packs the lower 3 bytes of each 32 bit integer into the first 12 bytes of each lane
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	// then moves the 24 packed bytes to the start of the vector
+	const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i packed = _mm256_shuffle_epi8(quantize<24>(in, dither, i), shuffle);
+		const __m256i samples = _mm256_permutevar8x32_epi32(packed, gather);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3*i), _mm256_castsi256_si128(samples));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3*i + 16), _mm256_extracti128_si256(samples, 1));
+	}
+	scalar_float_to_pcm24(in + i, dither ? dither + i : nullptr, out + 3*i, n-i);
+}
+
+void deinterleave(const float* in, float* const* out, std::size_t channels, std::size_t frames) {
+	if (channels != 2) {
+		scalar_deinterleave(in, out, channels, frames);
+		return;
+	}
+	std::size_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		const __m256 a = _mm256_loadu_ps(in + 2*i), b = _mm256_loadu_ps(in + 2*i + 8);
+		// the shuffles work within 128 bit lanes, leaving the pairs of samples out of order
+		const __m256 left = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m256 right = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm256_storeu_ps(out[0] + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(left), _MM_SHUFFLE(3, 1, 2, 0))));
+		_mm256_storeu_ps(out[1] + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(right), _MM_SHUFFLE(3, 1, 2, 0))));
+	}
+	float* const rest[] = {out[0] + i, out[1] + i};
+	scalar_deinterleave(in + 2*i, rest, 2, frames-i);
+}
+
+void interleave(const float* const* in, float* out, std::size_t channels, std::size_t frames) {
+	if (channels != 2) {
+		scalar_interleave(in, out, channels, frames);
+		return;
+	}
+	std::size_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		const __m256 left = _mm256_loadu_ps(in[0] + i), right = _mm256_loadu_ps(in[1] + i);
+		const __m256 low = _mm256_unpacklo_ps(left, right), high = _mm256_unpackhi_ps(left, right);
+		_mm256_storeu_ps(out + 2*i, _mm256_permute2f128_ps(low, high, 0x20));
+		_mm256_storeu_ps(out + 2*i + 8, _mm256_permute2f128_ps(low, high, 0x31));
+	}
+	const float* const rest[] = {in[0] + i, in[1] + i};
+	scalar_interleave(rest, out + 2*i, 2, frames-i);
+}
+
+}
+
+const Sample_Kernels avx2_sample_kernels = {
+	"avx2",
+	pcm16_to_float,
+	pcm24_to_float,
+	pcm32_to_float,
+	float64_to_float,
+	float_to_pcm16,
+	float_to_pcm24,
+	deinterleave,
+	interleave
+};
@@ -0,0 +1,94 @@
+/**
+ * Scalar implementation of the kernels declared in sample_kernels.hpp.
+ * This file is included by each sample_kernels_*.cpp file, the vectorised kernels use these
+ * functions for the samples left over after the last full vector and for channel counts
+ * they do not specialise. Everything is in an anonymous namespace so that copies compiled
+ * for different instruction sets are never merged by the linker, for the same reason no
+ * standard library templates are used.
+ */
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "sample_kernels.hpp"
+
+namespace {
+
+template <typename T>
+T load_le(const char* data) {
+	T value;
+	std::memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+void scalar_pcm16_to_float(const char* in, float* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i)
+		out[i] = static_cast<float>(load_le<int16_t>(in + 2*i))*(1.f/32768.f);
+}
+
+void scalar_pcm24_to_float(const char* in, float* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		const unsigned char* sample = reinterpret_cast<const unsigned char*>(in + 3*i);
+		const uint32_t value = uint32_t(sample[0]) << 8 | uint32_t(sample[1]) << 16 | uint32_t(sample[2]) << 24;
+		out[i] = static_cast<float>(static_cast<int32_t>(value))*(1.f/2147483648.f);
+	}
+}
+
+void scalar_pcm32_to_float(const char* in, float* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i)
+		out[i] = static_cast<float>(load_le<int32_t>(in + 4*i))*(1.f/2147483648.f);
+}
+
+void scalar_float64_to_float(const char* in, float* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i)
+		out[i] = static_cast<float>(load_le<double>(in + 8*i));
+}
+
+// scales, dithers, rounds and clamps a sample to bits bits
+template <int bits>
+int32_t quantize(float sample, const float* dither, std::size_t i) {
+	constexpr float scale = static_cast<float>(int32_t(1) << (bits-1));
+	float value = sample*scale;
+	if (dither) value += dither[i];
+	value = value < -scale ? -scale : value > scale-1.f ? scale-1.f : value;
+	return static_cast<int32_t>(std::lrintf(value));
+}
+
+void scalar_float_to_pcm16(const float* in, const float* dither, char* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		const int16_t value = static_cast<int16_t>(quantize<16>(in[i], dither, i));
+		std::memcpy(out + 2*i, &value, 2);
+	}
+}
+
+void scalar_float_to_pcm24(const float* in, const float* dither, char* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		const uint32_t value = static_cast<uint32_t>(quantize<24>(in[i], dither, i));
+		out[3*i] = static_cast<char>(value);
+		out[3*i+1] = static_cast<char>(value >> 8);
+		out[3*i+2] = static_cast<char>(value >> 16);
+	}
+}
+
+void scalar_deinterleave(const float* in, float* const* out, std::size_t channels, std::size_t frames) {
+	if (channels == 1) {
+		std::memcpy(out[0], in, frames*sizeof(float));
+		return;
+	}
+	for (std::size_t channel = 0; channel < channels; ++channel)
+		for (std::size_t i = 0; i < frames; ++i)
+			out[channel][i] = in[i*channels + channel];
+}
+
+void scalar_interleave(const float* const* in, float* out, std::size_t channels, std::size_t frames) {
+	if (channels == 1) {
+		std::memcpy(out, in[0], frames*sizeof(float));
+		return;
+	}
+	for (std::size_t channel = 0; channel < channels; ++channel)
+		for (std::size_t i = 0; i < frames; ++i)
+			out[i*channels + channel] = in[channel][i];
+}
+
+}
@@ -0,0 +1,130 @@
+#include <smmintrin.h>
+
+#include <cstddef>
+
+#include "sample_kernels_impl.hpp"
+
+namespace {
+
+void pcm16_to_float(const char* in, float* out, std::size_t n) {
+	const __m128 scale = _mm_set1_ps(1.f/32768.f);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2*i));
+		const __m128i low = _mm_cvtepi16_epi32(samples);
+		const __m128i high = _mm_cvtepi16_epi32(_mm_srli_si128(samples, 8));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+	}
+	scalar_pcm16_to_float(in + 2*i, out + i, n-i);
+}
+
+void pcm24_to_float(const char* in, float* out, std::size_t n) {
+	// moves each sample into the upper 3 bytes of a 32 bit integer
+	const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m128 scale = _mm_set1_ps(1.f/2147483648.f);
+	std::size_t i = 0;
+	// each load reads 16 bytes for 4 samples so it must not be one of the last 5 samples
+	for (; i + 6 <= n; i += 4) {
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3*i));
+		const __m128i values = _mm_shuffle_epi8(samples, shuffle);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(values), scale));
+	}
+	scalar_pcm24_to_float(in + 3*i, out + i, n-i);
+}
+
+void pcm32_to_float(const char* in, float* out, std::size_t n) {
+	const __m128 scale = _mm_set1_ps(1.f/2147483648.f);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4*i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), scale));
+	}
+	scalar_pcm32_to_float(in + 4*i, out + i, n-i);
+}
+
+void float64_to_float(const char* in, float* out, std::size_t n) {
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 low = _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double*>(in + 8*i)));
+		const __m128 high = _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double*>(in + 8*i + 16)));
+		_mm_storeu_ps(out + i, _mm_movelh_ps(low, high));
+	}
+	scalar_float64_to_float(in + 8*i, out + i, n-i);
+}
+
+// scales, dithers and clamps 4 samples to bits bits and rounds them to the nearest integer
+template <int bits>
+__m128i quantize(const float* in, const float* dither, std::size_t i) {
+	constexpr float scale = static_cast<float>(int32_t(1) << (bits-1));
+	__m128 value = _mm_mul_ps(_mm_loadu_ps(in + i), _mm_set1_ps(scale));
+	if (dither) value = _mm_add_ps(value, _mm_loadu_ps(dither + i));
+	value = _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(scale-1.f)), _mm_set1_ps(-scale));
+	return _mm_cvtps_epi32(value);
+}
+
+void float_to_pcm16(const float* in, const float* dither, char* out, std::size_t n) {
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128i samples = _mm_packs_epi32(quantize<16>(in, dither, i), quantize<16>(in, dither, i+4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2*i), samples);
+	}
+	scalar_float_to_pcm16(in + i, dither ? dither + i : nullptr, out + 2*i, n-i);
+}
+
+void float_to_pcm24(const float* in, const float* dither, char* out, std::size_t n) {
+	// packs the lower 3 bytes of each 32 bit integer into the first 12 bytes
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128i low = _mm_shuffle_epi8(quantize<24>(in, dither, i), shuffle);
+		const __m128i high = _mm_shuffle_epi8(quantize<24>(in, dither, i+4), shuffle);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3*i), _mm_or_si128(low, _mm_slli_si128(high, 12)));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3*i + 16), _mm_srli_si128(high, 4));
+	}
+	scalar_float_to_pcm24(in + i, dither ? dither + i : nullptr, out + 3*i, n-i);
+}
+
+void deinterleave(const float* in, float* const* out, std::size_t channels, std::size_t frames) {
+	if (channels != 2) {
+		scalar_deinterleave(in, out, channels, frames);
+		return;
+	}
+	std::size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		const __m128 a = _mm_loadu_ps(in + 2*i), b = _mm_loadu_ps(in + 2*i + 4);
+		_mm_storeu_ps(out[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(out[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	float* const rest[] = {out[0] + i, out[1] + i};
+	scalar_deinterleave(in + 2*i, rest, 2, frames-i);
+}
+
+void interleave(const float* const* in, float* out, std::size_t channels, std::size_t frames) {
+	if (channels != 2) {
+		scalar_interleave(in, out, channels, frames);
+		return;
+	}
+	std::size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		const __m128 left = _mm_loadu_ps(in[0] + i), right = _mm_loadu_ps(in[1] + i);
+		_mm_storeu_ps(out + 2*i, _mm_unpacklo_ps(left, right));
+		_mm_storeu_ps(out + 2*i + 4, _mm_unpackhi_ps(left, right));
+	}
+	const float* const rest[] = {in[0] + i, in[1] + i};
+	scalar_interleave(rest, out + 2*i, 2, frames-i);
+}
+
+}
+
+const Sample_Kernels sse4_sample_kernels = {
+	"sse4",
+	pcm16_to_float,
+	pcm24_to_float,
+	pcm32_to_float,
+	float64_to_float,
+	float_to_pcm16,
+	float_to_pcm24,
+	deinterleave,
+	interleave
+};
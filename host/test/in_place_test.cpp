@@ -0,0 +1,108 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/**
+ * Checks that the host can write its output over its input. A single channel 32 bit floating
+ * point file, which the host reads through a memory map, is passed through without any plugins
+ * to the same path, then a batch is written back to the directory it was read from.
+ * usage: in_place_test host
+ * The exit status is non zero if any check fails.
+ */
+
+constexpr std::uint32_t frames = 1 << 20;
+
+static void write_le(std::ofstream& file, std::uint32_t value, std::size_t bytes) {
+	for (std::size_t byte = 0; byte < bytes; ++byte)
+		file.put(static_cast<char>(value >> 8*byte));
+}
+
+static std::uint32_t read_le(const char* bytes) {
+	std::uint32_t value = 0;
+	for (std::size_t byte = 0; byte < 4; ++byte)
+		value |= std::uint32_t(static_cast<unsigned char>(bytes[byte])) << 8*byte;
+	return value;
+}
+
+static std::vector<float> test_signal() {
+	std::vector<float> signal(frames);
+	for (std::size_t n = 0; n < frames; ++n) signal[n] = 0.5f*std::sin(0.01f*n);
+	return signal;
+}
+
+static void write_wav(const std::filesystem::path& path, const std::vector<float>& signal) {
+	std::ofstream file(path, std::ios::binary);
+	const std::uint32_t data_bytes = signal.size()*sizeof(float);
+	file.write("RIFF", 4);
+	write_le(file, 36 + data_bytes, 4);
+	file.write("WAVEfmt ", 8);
+	write_le(file, 16, 4);
+	write_le(file, 3, 2);
+	write_le(file, 1, 2);
+	write_le(file, 48000, 4);
+	write_le(file, 48000*sizeof(float), 4);
+	write_le(file, sizeof(float), 2);
+	write_le(file, 32, 2);
+	file.write("data", 4);
+	write_le(file, data_bytes, 4);
+	file.write(reinterpret_cast<const char*>(signal.data()), data_bytes);
+}
+
+// the samples of the data chunk, empty if the file can not be read
+static std::vector<float> read_wav(const std::filesystem::path& path) {
+	std::ifstream file(path, std::ios::binary);
+	const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	for (std::size_t chunk = 12; chunk + 8 <= contents.size();) {
+		const std::uint32_t size = read_le(contents.data() + chunk + 4);
+		if (!contents.compare(chunk, 4, "data")) {
+			std::vector<float> signal(std::min<std::size_t>(size, contents.size() - chunk - 8)/sizeof(float));
+			std::memcpy(signal.data(), contents.data() + chunk + 8, signal.size()*sizeof(float));
+			return signal;
+		}
+		chunk += 8 + size + (size&1);
+	}
+	return {};
+}
+
+static bool check(const char* name, int status, const std::filesystem::path& path, const std::vector<float>& signal) {
+	const bool ok = status == 0 && read_wav(path) == signal;
+	std::printf("%-10s %6d%s\n", name, status, ok ? "" : "  FAIL");
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		std::fprintf(stderr, "usage: %s host\n", argv[0]);
+		return 1;
+	}
+	const std::string host = std::string("\"") + argv[1] + "\"";
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / "in_place_test";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+
+	const std::vector<float> signal = test_signal();
+	std::size_t failures = 0;
+
+	const std::filesystem::path file = directory / "in_place.wav";
+	write_wav(file, signal);
+	const std::string single = host + " \"--input=" + file.string() + "\" \"--output=" + file.string() + "\"";
+	if (!check("single", std::system(single.c_str()), file, signal)) ++failures;
+
+	write_wav(directory / "a.wav", signal);
+	write_wav(directory / "b.wav", signal);
+	const std::string batch = host + " \"--batch=" + (directory / "*.wav").string() + "\" \"--output-dir=" + directory.string() + "\"";
+	const int status = std::system(batch.c_str());
+	if (!check("batch", status, directory / "a.wav", signal)) ++failures;
+	if (!check("batch", status, directory / "b.wav", signal)) ++failures;
+
+	std::filesystem::remove_all(directory);
+	if (failures) std::printf("%zu in place checks failed\n", failures);
+	return failures ? 1 : 0;
+}
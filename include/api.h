@@ -6,11 +6,75 @@ typedef struct _Global_Parameters {
 	const char* plugin_path;
 } Global_Parameters;
 
+/**
+ * Audio ports pass n_samples floats. Parameter ports with the automatable property in the
+ * plugin.info pass n_samples values, one for each sample, other parameter ports pass a single
+ * value. Path ports pass a null terminated string which the plugin reads by casting the port
+ * pointer to const char*.
+ */
 typedef void (*Process_Function)(const Global_Parameters* global,
 				                 const float* const* input_ports,
                                  float* const* output_ports,
                                  size_t n_samples);
 
+/**
+ * Version 2 plugins keep their state between calls and process the audio a block at a time,
+ * so the host does not need to hold the whole signal. They export plugin_api_version returning
+ * PLUGIN_API_VERSION along with instantiate, activate, process_block, deactivate and destroy,
+ * and may export latency and tail_length. Plugins which do not export plugin_api_version are
+ * version 1 and must export process. A version 2 plugin may also export process so it can be
+ * used by hosts which only support version 1.
+ *
+ * The host calls instantiate once, then activate before processing, process_block any number
+ * of times with consecutive blocks of the signal, and deactivate once the signal ends. An
+ * instance can be activated again for another signal before destroy is called.
+ */
+#define PLUGIN_API_VERSION 2
+
+// the version of the api the plugin was built for, the host refuses versions newer than its own
+typedef unsigned int (*Plugin_API_Version_Function)(void);
+
+// returns a new instance or NULL on failure, global is only valid during the call
+typedef void* (*Instantiate_Function)(const Global_Parameters* global);
+
+/**
+ * Prepares to process blocks of at most max_block_size samples, returns 0 on success.
+ * The parameter and path ports of input_ports are connected so that the plugin can read the
+ * settings its latency or tail depend on, every parameter port points to a single value, the
+ * value at the first sample of an automated parameter. Audio ports are NULL and the pointers
+ * are only valid during the call.
+ */
+typedef int (*Activate_Function)(void* instance, const float* const* input_ports, size_t max_block_size);
+
+/**
+ * Processes the next n_samples samples of the signal, n_samples <= max_block_size.
+ * - audio ports point to n_samples samples
+ * - automatable parameter ports, those with the automatable property in the plugin.info,
+ *   always point to n_samples values, the value of the parameter at each sample of the block,
+ *   whether or not the parameter is automated
+ * - other parameter ports point to a single value which holds for the whole block and may
+ *   change between blocks
+ * - path ports point to a null terminated string
+ * A plugin tells the kinds of parameter port apart from its own plugin.info, the host never
+ * connects a port any other way. The pointers are only valid during the call.
+ */
+typedef void (*Process_Block_Function)(void* instance,
+                                       const float* const* input_ports,
+                                       float* const* output_ports,
+                                       size_t n_samples);
+
+typedef void (*Deactivate_Function)(void* instance);
+typedef void (*Destroy_Function)(void* instance);
+
+// the number of samples by which the output lags the input, valid once the instance is activated
+typedef size_t (*Latency_Function)(const void* instance);
+
+/**
+ * The number of samples of output which follow the end of the input, such as a reverb tail,
+ * valid once the instance is activated
+ */
+typedef size_t (*Tail_Length_Function)(const void* instance);
+
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 	#define SYMBOL_EXPORT extern "C" __declspec(dllexport)
 #else
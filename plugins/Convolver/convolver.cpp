@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "api.h"
+
+#include <convolution.hpp>
+#include <wav.hpp>
+
+enum {
+	in_left = 0,
+	in_right = 1,
+	in_impulse_response = 2,
+	in_mix = 3
+};
+
+enum {
+	out_left = 0,
+	out_right = 1
+};
+
+struct Impulse_Response {
+	double sample_rate;
+	std::vector<std::vector<float>> channels;
+};
+
+template <typename T>
+static T read_le(const char* data) {
+	T value;
+	std::memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+// converts a sample stored in format to a float
+static float decode_sample(Sample_Format format, const char* sample) {
+	switch (format) {
+		case Sample_Format::pcm16: return read_le<int16_t>(sample)/32768.f;
+		case Sample_Format::pcm24: {
+			const auto byte = [&](std::size_t i) { return static_cast<uint32_t>(static_cast<unsigned char>(sample[i])); };
+			return static_cast<int32_t>(byte(0) << 8 | byte(1) << 16 | byte(2) << 24)/2147483648.f;
+		}
+		case Sample_Format::pcm32: return static_cast<float>(read_le<int32_t>(sample)/2147483648.0);
+		case Sample_Format::float32: return read_le<float>(sample);
+		case Sample_Format::float64: return static_cast<float>(read_le<double>(sample));
+	}
+	return 0.f;
+}
+
+/**
+ * Reads a wav, rf64 or wave64 file with the header parser of the host, so the same files are
+ * accepted. Only the header and the samples are read, a block of frames at a time.
+ */
+static Impulse_Response read_impulse_response(const std::string& path) {
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file) throw std::runtime_error("unable to open the impulse response '" + path + "'");
+
+	Wav_Layout layout;
+	try {
+		layout = read_wav_layout(file);
+	} catch (const std::exception& e) {
+		throw std::runtime_error("unable to read the impulse response '" + path + "', " + e.what());
+	}
+
+	const std::size_t frames = static_cast<std::size_t>(layout.frames());
+	const std::size_t frame_bytes = sample_bytes(layout.format)*layout.channels;
+	Impulse_Response impulse_response = {layout.sample_rate, std::vector<std::vector<float>>(layout.channels, std::vector<float>(frames))};
+
+	constexpr std::size_t block_frames = 1 << 14;
+	std::vector<char> block(block_frames*frame_bytes);
+	file.seekg(static_cast<std::streamoff>(layout.data_offset));
+	for (std::size_t first = 0; first < frames; first += block_frames) {
+		const std::size_t count = std::min(block_frames, frames-first);
+		if (!file.read(block.data(), static_cast<std::streamsize>(count*frame_bytes)))
+			throw std::runtime_error("unable to read the impulse response '" + path + "'");
+		for (std::size_t frame = 0; frame < count; ++frame)
+			for (std::size_t channel = 0; channel < layout.channels; ++channel)
+				impulse_response.channels[channel][first+frame] = decode_sample(layout.format, block.data() + frame*frame_bytes + channel*sample_bytes(layout.format));
+	}
+	return impulse_response;
+}
+
+/**
+ * A stream for each channel, the right channel shares the convolver of the left channel
+ * when the impulse response is mono. The dry signal is delayed by the latency of the
+ * convolution so that they line up when they are mixed.
+ */
+struct Convolver_Instance {
+	double sample_rate;
+	std::string path;
+	std::size_t ir_size = 0;
+	std::vector<std::unique_ptr<const Convolver<fft_scalar>>> convolvers;
+	std::vector<Convolver<fft_scalar>::Stream> streams;
+	std::vector<std::vector<float>> dry;
+	std::size_t dry_position = 0;
+	std::vector<float> wet;
+};
+
+// the latency, 0 until an impulse response is loaded
+static std::size_t instance_latency(const Convolver_Instance& instance) {
+	return instance.convolvers.empty() ? 0 : instance.convolvers.front()->block_size();
+}
+
+SYMBOL_EXPORT unsigned int plugin_api_version() {
+	return PLUGIN_API_VERSION;
+}
+
+SYMBOL_EXPORT void* instantiate(const Global_Parameters* global) {
+	Convolver_Instance* instance = new Convolver_Instance;
+	instance->sample_rate = global->sample_rate;
+	return instance;
+}
+
+SYMBOL_EXPORT int activate(void* handle, const float* const* input_ports, std::size_t max_block_size) {
+	Convolver_Instance& instance = *static_cast<Convolver_Instance*>(handle);
+	const std::string path = reinterpret_cast<const char*>(input_ports[in_impulse_response]);
+
+	// the impulse response is only read and transformed again when the path changes
+	if (path != instance.path || instance.convolvers.empty()) {
+		instance.streams.clear();
+		instance.path = path;
+		instance.ir_size = 0;
+		instance.convolvers.clear();
+		try {
+			if (path.empty()) throw std::runtime_error("no impulse response was given");
+			const Impulse_Response impulse_response = read_impulse_response(path);
+			if (impulse_response.sample_rate != instance.sample_rate)
+				std::cerr << "Convolver: the impulse response sample rate does not match the audio" << std::endl;
+
+			if (impulse_response.channels[0].empty()) throw std::runtime_error("the impulse response is empty");
+
+			// mono impulse responses are applied to both channels
+			instance.ir_size = impulse_response.channels[0].size();
+			for (std::size_t channel = 0; channel < std::min<std::size_t>(impulse_response.channels.size(), 2); ++channel) {
+				const std::vector<float>& response = impulse_response.channels[channel];
+				instance.convolvers.push_back(std::make_unique<const Convolver<fft_scalar>>(response.data(), response.size()));
+			}
+		} catch (const std::exception& e) {
+			instance.ir_size = 0;
+			instance.convolvers.clear();
+			std::cerr << "Convolver: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	instance.streams.clear();
+	for (std::size_t channel = 0; channel < 2; ++channel)
+		instance.streams.emplace_back(*instance.convolvers[std::min(channel, instance.convolvers.size()-1)]);
+	instance.dry.assign(2, std::vector<float>(instance_latency(instance)));
+	instance.dry_position = 0;
+	instance.wet.resize(max_block_size);
+	return 0;
+}
+
+SYMBOL_EXPORT void process_block(void* handle,
+                                 const float* const* input_ports,
+                                 float* const* output_ports,
+                                 std::size_t n_samples) {
+	Convolver_Instance& instance = *static_cast<Convolver_Instance*>(handle);
+	const float mix = *input_ports[in_mix];
+
+	const std::size_t in_ports[] = {in_left, in_right}, out_ports[] = {out_left, out_right};
+	const std::size_t latency = instance_latency(instance);
+	for (std::size_t channel = 0; channel < 2; ++channel) {
+		const float* in = input_ports[in_ports[channel]];
+		float* out = output_ports[out_ports[channel]];
+		float* wet = instance.wet.data();
+		instance.streams[channel].process(in, wet, n_samples);
+
+		// the dry samples are swapped through a ring of latency samples, in may alias out
+		std::vector<float>& dry = instance.dry[channel];
+		std::size_t position = instance.dry_position;
+		for (std::size_t sample = 0; sample < n_samples; ++sample) {
+			const float delayed = dry[position];
+			dry[position] = in[sample];
+			if (++position == latency) position = 0;
+			out[sample] = mix*wet[sample] + (1.f-mix)*delayed;
+		}
+	}
+	instance.dry_position = (instance.dry_position + n_samples)%latency;
+}
+
+SYMBOL_EXPORT void deactivate(void* handle) {
+	Convolver_Instance& instance = *static_cast<Convolver_Instance*>(handle);
+	instance.streams.clear();
+	instance.dry.clear();
+}
+
+SYMBOL_EXPORT void destroy(void* handle) {
+	delete static_cast<Convolver_Instance*>(handle);
+}
+
+SYMBOL_EXPORT std::size_t latency(const void* handle) {
+	return instance_latency(*static_cast<const Convolver_Instance*>(handle));
+}
+
+// the convolution of each sample lasts for the length of the impulse response
+SYMBOL_EXPORT std::size_t tail_length(const void* handle) {
+	const Convolver_Instance& instance = *static_cast<const Convolver_Instance*>(handle);
+	return instance.convolvers.empty() ? 0 : instance.ir_size - 1;
+}
@@ -1,8 +1,10 @@
+#include <algorithm>
 #include <cstddef>
 #include <complex>
 #include "api.h"
 
 #include <fft.hpp>
+#include <fft_external.hpp>
 
 enum {
 	in_left = 0,
@@ -19,50 +21,38 @@ SYMBOL_EXPORT void process(const Global_Parameters* global,
                            const float* const* input_ports,
                            float* const* output_ports,
                            std::size_t n_samples) {
-	std::complex<double>* const tmp1 = new std::complex<double>[n_samples];
-	std::complex<double>* const tmp2 = new std::complex<double>[n_samples];
+	const std::size_t spectrum_size = n_samples/2 + 1;
 
-	for (std::size_t sample = 0; sample < n_samples; ++sample)
-		tmp1[sample] = std::complex<double>(input_ports[in_left][sample], input_ports[in_right][sample]);
+	// buffers which do not fit in the memory budget are kept in scratch files
+	const std::size_t memory_budget = fft_memory_budget();
+	const Scratch_Buffer<fft_scalar> samples(n_samples, memory_budget/4);
+	const Scratch_Buffer<std::complex<fft_scalar>> spectrum(spectrum_size, memory_budget/4);
+	const Scratch_Buffer<std::complex<fft_scalar>> shifted(spectrum_size, memory_budget/4);
 
-	fft(tmp1, tmp2, n_samples);
-
-	std::size_t spectrum_size = n_samples/2 + (n_samples&1);
-
-	std::complex<double>* left = new std::complex<double>[spectrum_size];
-	std::complex<double>* right = new std::complex<double>[spectrum_size];
-	std::complex<double>* left_out = new std::complex<double>[spectrum_size]();
-	std::complex<double>* right_out = new std::complex<double>[spectrum_size]();
-
-	split_channels(tmp2, left, right, n_samples);
+	const External_Real_FFT_Plan<fft_scalar> forward(n_samples, FFT_Direction::forward, memory_budget/2);
+	const External_Real_FFT_Plan<fft_scalar> inverse(n_samples, FFT_Direction::inverse, memory_budget/2);
 
 	const double freq_step = global->sample_rate/n_samples;
 	std::size_t min_bin = static_cast<int>(15.0/freq_step);
 
-	// Freq Shift
-
 	// find freq step = 1/duration
 	const int bin_shift = *input_ports[in_hertz]/freq_step;
 
-	for (std::size_t bin = min_bin - std::min(bin_shift, 0); bin < spectrum_size - std::max(bin_shift, 0); ++bin) {
-		left_out[bin+bin_shift] = left[bin];
-		right_out[bin+bin_shift] = right[bin];
-	}
+	// {input port, output port} of each channel
+	const int channels[][2] = {{in_left, out_left}, {in_right, out_right}};
 
-	join_channels(left_out, right_out, tmp2, n_samples);
+	for (const auto& channel : channels) {
+		std::copy_n(input_ports[channel[0]], n_samples, samples.data());
 
-	delete[] left_out;
-	delete[] right_out;
-	delete[] left;
-	delete[] right;
+		forward.execute(samples.data(), spectrum.data());
 
-	ifft(tmp2, tmp1, n_samples);
+		// Freq Shift
+		std::fill_n(shifted.data(), spectrum_size, 0);
+		for (std::size_t bin = min_bin - std::min(bin_shift, 0); bin < spectrum_size - std::max(bin_shift, 0); ++bin)
+			shifted[bin+bin_shift] = spectrum[bin];
 
-	for (std::size_t sample = 0; sample < n_samples; ++sample) {
-		output_ports[out_left][sample] = tmp1[sample].real();
-		output_ports[out_right][sample] = tmp1[sample].imag();
-	}
+		inverse.execute(shifted.data(), samples.data());
 
-	delete[] tmp1;
-	delete[] tmp2;
+		std::copy_n(samples.data(), n_samples, output_ports[channel[1]]);
+	}
 }
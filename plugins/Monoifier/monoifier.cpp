@@ -6,6 +6,7 @@
 #include <iostream>
 
 #include <fft.hpp>
+#include <fft_external.hpp>
 
 enum {
 	in_left = 0,
@@ -28,56 +29,47 @@ SYMBOL_EXPORT void process([[maybe_unused]] const Global_Parameters* global,
                            const float* const* input_ports,
                            float* const* output_ports,
                            std::size_t n_samples) {
-	std::complex<double>* const tmp1 = new std::complex<double>[n_samples];
-	std::complex<double>* const tmp2 = new std::complex<double>[n_samples];
+	const std::size_t spectrum_size = n_samples/2 + 1;
 
-	for (std::size_t sample = 0; sample < n_samples; ++sample)
-		tmp1[sample] = std::complex<double>(input_ports[in_left][sample], input_ports[in_right][sample]);
-
-	fft(tmp1, tmp2, n_samples);
+	// buffers which do not fit in the memory budget are kept in scratch files
+	const std::size_t memory_budget = fft_memory_budget();
+	const Scratch_Buffer<fft_scalar> samples(n_samples, memory_budget/4);
+	const Scratch_Buffer<std::complex<fft_scalar>> left(spectrum_size, memory_budget/4);
+	const Scratch_Buffer<std::complex<fft_scalar>> right(spectrum_size, memory_budget/4);
 
-	std::size_t spectrum_size = n_samples/2 + (n_samples&1);
+	const External_Real_FFT_Plan<fft_scalar> forward(n_samples, FFT_Direction::forward, memory_budget/2);
 
-	std::complex<double>* left = new std::complex<double>[spectrum_size];
-	std::complex<double>* right = new std::complex<double>[spectrum_size];
+	std::copy_n(input_ports[in_left], n_samples, samples.data());
+	forward.execute(samples.data(), left.data());
+	std::copy_n(input_ports[in_right], n_samples, samples.data());
+	forward.execute(samples.data(), right.data());
 
-	split_channels(tmp2, left, right, n_samples);
-
-	// Monoify
+	// Monoify, the result is stored in left
 	for (std::size_t i = 0; i < spectrum_size; ++i)
 		switch(static_cast<Mode>(*input_ports[mode])) {
 			case Mode::GEO_MEAN:
-				tmp1[i] = sqrt(left[i]*right[i]);
+				left[i] = sqrt(left[i]*right[i]);
 				break;
 			case Mode::RMS:
-				tmp1[i] = sqrt((left[i]*left[i] + right[i]*right[i])/2.0);
+				left[i] = sqrt((left[i]*left[i] + right[i]*right[i])/fft_scalar(2));
 				break;
 			case Mode::ABS_SUM:
-				tmp1[i] = std::complex<double>(
-					std::copysign(1.0, left[i].real()+right[i].real())*(std::abs(left[i].real()) + std::abs(right[i].real())),
-					std::copysign(1.0, left[i].imag()+right[i].imag())*(std::abs(left[i].imag()) + std::abs(right[i].imag()))
-				)/2.0;
+				left[i] = std::complex<fft_scalar>(
+					std::copysign(fft_scalar(1), left[i].real()+right[i].real())*(std::abs(left[i].real()) + std::abs(right[i].real())),
+					std::copysign(fft_scalar(1), left[i].imag()+right[i].imag())*(std::abs(left[i].imag()) + std::abs(right[i].imag()))
+				)/fft_scalar(2);
 				break;
 			case Mode::COMPONENTWISE_RMS:
-				tmp1[i] = std::complex<double>(
-					std::copysign(1.0, left[i].real()+right[i].real())*std::hypot(left[i].real(), right[i].real()),
-					std::copysign(1.0, left[i].imag()+right[i].imag())*std::hypot(left[i].imag(), right[i].imag())
-				)/sqrt(2.0);
+				left[i] = std::complex<fft_scalar>(
+					std::copysign(fft_scalar(1), left[i].real()+right[i].real())*std::hypot(left[i].real(), right[i].real()),
+					std::copysign(fft_scalar(1), left[i].imag()+right[i].imag())*std::hypot(left[i].imag(), right[i].imag())
+				)/std::sqrt(fft_scalar(2));
 				break;
 		}
 
-	join_channels(tmp1, tmp1, tmp2, n_samples);
-
-	delete[] left;
-	delete[] right;
-
-	ifft(tmp2, tmp1, n_samples);
-
-	for (std::size_t sample = 0; sample < n_samples; ++sample)
-		output_ports[audio_out][sample] = tmp1[sample].real();
+	External_Real_FFT_Plan<fft_scalar>(n_samples, FFT_Direction::inverse, memory_budget/2).execute(left.data(), samples.data());
 
-	delete[] tmp1;
-	delete[] tmp2;
+	std::copy_n(samples.data(), n_samples, output_ports[audio_out]);
 
 	// Lower volume if peaking
 	float max = 1.0;
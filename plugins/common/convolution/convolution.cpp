@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include "convolution.hpp"
+#include "fft_kernels.hpp"
+
+// the range of block sizes considered by optimal_block_size
+static constexpr std::size_t min_block_size = std::size_t(1) << 6;
+static constexpr std::size_t max_block_size = std::size_t(1) << 20;
+
+// number of bins multiplied per item of the parallel multiply accumulate loop
+static constexpr std::size_t bins_per_item = 256;
+
+template <typename T>
+std::size_t Convolver<T>::optimal_block_size(std::size_t ir_size, std::size_t signal_size) {
+	// a block costs a forward and an inverse real transform of 2*block_size samples
+	// and a complex multiply add for each bin of each partition
+	const auto cost = [&](std::size_t block_size) {
+		const double blocks = std::ceil(static_cast<double>(std::max<std::size_t>(signal_size, 1))/block_size);
+		const double partitions = std::ceil(static_cast<double>(std::max<std::size_t>(ir_size, 1))/block_size);
+		const double transforms = 10.0*block_size*std::log2(2.0*block_size);
+		return blocks*(transforms + 8.0*(block_size+1)*partitions);
+	};
+
+	std::size_t best = min_block_size;
+	for (std::size_t block_size = min_block_size; block_size <= max_block_size; block_size *= 2)
+		if (cost(block_size) < cost(best)) best = block_size;
+	return best;
+}
+
+template <typename T>
+Convolver<T>::Convolver(const float* impulse_response, std::size_t ir_size,
+                        std::size_t block_size, std::size_t expected_size)
+	: m_block_size(block_size ? block_size : optimal_block_size(ir_size, expected_size ? expected_size : ir_size)),
+	  m_partitions((ir_size + m_block_size - 1)/m_block_size),
+	  m_spectra(2*(m_block_size+1)*m_partitions),
+	  m_forward(2*m_block_size, FFT_Direction::forward),
+	  m_inverse(2*m_block_size, FFT_Direction::inverse) {
+	if (m_block_size & (m_block_size-1))
+		throw std::invalid_argument("the convolution block size must be a power of 2");
+
+	const std::size_t bins = m_block_size+1;
+	// the forward transforms of both the signal and the partitions are scaled by 1/(2*block_size)
+	const T scale = static_cast<T>(2*m_block_size);
+	fft_parallel_for(m_partitions, 10*m_block_size*static_cast<std::size_t>(std::log2(2*m_block_size)),
+		[&](std::size_t begin, std::size_t end) {
+			std::vector<T> partition(2*m_block_size);
+			std::vector<std::complex<T>> spectrum(bins);
+			for (std::size_t p = begin; p < end; ++p) {
+				const std::size_t first = p*m_block_size;
+				const std::size_t count = std::min(m_block_size, ir_size-first);
+				std::fill(partition.begin(), partition.end(), T(0));
+				std::copy_n(impulse_response+first, count, partition.begin());
+				m_forward.execute(partition.data(), spectrum.data());
+
+				T* re = m_spectra.data() + 2*bins*p;
+				T* im = re + bins;
+				for (std::size_t k = 0; k < bins; ++k) {
+					re[k] = spectrum[k].real()*scale;
+					im[k] = spectrum[k].imag()*scale;
+				}
+			}
+		});
+}
+
+template <typename T>
+void Convolver<T>::process(const float* in, std::size_t in_size, float* out, std::size_t out_size) const {
+	Stream stream(*this);
+	T* const segment = stream.m_segment.data() + m_block_size;
+	const T* const output = stream.m_output.data() + m_block_size;
+
+	const std::size_t blocks = (out_size + m_block_size - 1)/m_block_size;
+	for (std::size_t block = 0; block < blocks; ++block) {
+		const std::size_t first = block*m_block_size;
+
+		// the input is read before the output of the block is written so in may alias out
+		const std::size_t count = first < in_size ? std::min(m_block_size, in_size-first) : 0;
+		std::copy_n(in+first, count, segment);
+		std::fill(segment + count, segment + m_block_size, T(0));
+		stream.convolve_block();
+
+		const std::size_t written = std::min(m_block_size, out_size-first);
+		for (std::size_t i = 0; i < written; ++i) out[first+i] = static_cast<float>(output[i]);
+	}
+}
+
+template <typename T>
+Convolver<T>::Stream::Stream(const Convolver& convolver)
+	: m_convolver(&convolver),
+	  m_delay_line(2*(convolver.m_block_size+1)*convolver.m_partitions),
+	  m_segment(2*convolver.m_block_size),
+	  m_sum(2*(convolver.m_block_size+1)),
+	  m_spectrum(convolver.m_block_size+1),
+	  m_output(2*convolver.m_block_size) {}
+
+template <typename T>
+void Convolver<T>::Stream::process(const float* in, float* out, std::size_t n_samples) {
+	const std::size_t block_size = m_convolver->m_block_size;
+	while (n_samples) {
+		const std::size_t count = std::min(n_samples, block_size - m_filled);
+		T* const segment = m_segment.data() + block_size + m_filled;
+		const T* const output = m_output.data() + block_size + m_filled;
+		for (std::size_t i = 0; i < count; ++i) {
+			const float sample = in[i];
+			out[i] = static_cast<float>(output[i]);
+			segment[i] = sample;
+		}
+
+		in += count;
+		out += count;
+		n_samples -= count;
+		m_filled += count;
+		if (m_filled == block_size) {
+			convolve_block();
+			m_filled = 0;
+		}
+	}
+}
+
+template <typename T>
+void Convolver<T>::Stream::reset() {
+	std::fill(m_delay_line.begin(), m_delay_line.end(), T(0));
+	std::fill(m_segment.begin(), m_segment.end(), T(0));
+	std::fill(m_output.begin(), m_output.end(), T(0));
+	m_block = 0;
+	m_filled = 0;
+}
+
+template <typename T>
+void Convolver<T>::Stream::convolve_block() {
+	const std::size_t block_size = m_convolver->m_block_size;
+	const std::size_t n_partitions = m_convolver->m_partitions;
+	if (!n_partitions) return;
+
+	const std::size_t bins = block_size+1;
+	const FFT_Kernels<T>& kernels = fft_kernels<T>();
+
+	// the transform overwrites its input so it is given a copy of the segment
+	std::copy(m_segment.begin(), m_segment.end(), m_output.begin());
+	std::copy(m_segment.begin() + block_size, m_segment.end(), m_segment.begin());
+	m_convolver->m_forward.execute(m_output.data(), m_spectrum.data());
+	T* const x = m_delay_line.data() + 2*bins*(m_block%n_partitions);
+	for (std::size_t k = 0; k < bins; ++k) {
+		x[k] = m_spectrum[k].real();
+		x[bins+k] = m_spectrum[k].imag();
+	}
+
+	// sum of the spectra of block-p multiplied by partition p, split between threads by bins
+	const std::size_t partitions = std::min(n_partitions, m_block+1);
+	const std::size_t items = (bins + bins_per_item - 1)/bins_per_item;
+	fft_parallel_for(items, 8*bins_per_item*partitions, [&](std::size_t begin, std::size_t end) {
+		const std::size_t from = begin*bins_per_item, to = std::min(bins, end*bins_per_item);
+		std::fill(m_sum.begin() + from, m_sum.begin() + to, T(0));
+		std::fill(m_sum.begin() + bins + from, m_sum.begin() + bins + to, T(0));
+		for (std::size_t p = 0; p < partitions; ++p) {
+			const T* a = m_delay_line.data() + 2*bins*((m_block-p)%n_partitions);
+			const T* b = m_convolver->m_spectra.data() + 2*bins*p;
+			kernels.multiply_add(m_sum.data() + from, m_sum.data() + bins + from,
+			                     a + from, a + bins + from, b + from, b + bins + from, to-from);
+		}
+	});
+
+	for (std::size_t k = 0; k < bins; ++k) m_spectrum[k] = {m_sum[k], m_sum[bins+k]};
+	// the first half of the output wraps around so only the second half is kept
+	m_convolver->m_inverse.execute(m_spectrum.data(), m_output.data());
+	++m_block;
+}
+
+template class Convolver<float>;
+template class Convolver<double>;
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <complex>
+#include <vector>
+#include "fft.hpp"
+
+/**
+ * Convolves signals with a fixed impulse response using uniformly partitioned overlap save.
+ * The impulse response is split into partitions of block_size samples which are transformed
+ * once when the convolver is created. Each block of block_size input samples is transformed
+ * once and kept in a frequency domain delay line, so every output block is the inverse
+ * transform of the sum of the delayed input spectra multiplied by the partition spectra.
+ * T is the scalar type of the transforms, either float or double.
+ */
+template <typename T>
+class Convolver {
+public:
+	/**
+	 * The state of a signal which is convolved a chunk at a time, such as by a plugin processing
+	 * blocks. The output lags the input by block_size() samples, so the convolution of a signal
+	 * of n samples is complete once n + ir_size - 1 + block_size() samples have been processed.
+	 * The convolver must outlive its streams, each stream may only be used by one thread at once.
+	 */
+	class Stream {
+	public:
+		explicit Stream(const Convolver& convolver);
+
+		/**
+		 * Convolves the next n_samples samples of the signal in in and writes the convolution,
+		 * delayed by block_size() samples, to out. in and out may be the same array.
+		 */
+		void process(const float* in, float* out, std::size_t n_samples);
+
+		// clears the state so that the next sample starts a new signal
+		void reset();
+
+	private:
+		friend class Convolver;
+
+		/**
+		 * Convolves the block of input in the second half of m_segment, writes its output to
+		 * the second half of m_output and moves the block to the first half of m_segment
+		 */
+		void convolve_block();
+
+		const Convolver* m_convolver;
+		// the last partitions() input spectra, block k is stored in slot k % partitions()
+		std::vector<T> m_delay_line;
+		// the previous and the current block of input samples
+		std::vector<T> m_segment;
+		std::vector<T> m_sum;
+		std::vector<std::complex<T>> m_spectrum;
+		// the output of the last block is in the second half
+		std::vector<T> m_output;
+		std::size_t m_block = 0;
+		// the number of samples of the current block which have been processed
+		std::size_t m_filled = 0;
+	};
+
+	/**
+	 * block_size must be a power of 2, 0 selects the block size with the lowest estimated
+	 * cost for signals of expected_size samples
+	 */
+	Convolver(const float* impulse_response, std::size_t ir_size,
+	          std::size_t block_size = 0, std::size_t expected_size = 0);
+
+	/**
+	 * Writes the first out_size samples of the convolution of the in_size samples in in with the
+	 * impulse response to out, in is treated as zero past in_size. in and out may be the same array.
+	 * A convolver may be used from multiple threads at once.
+	 */
+	void process(const float* in, std::size_t in_size, float* out, std::size_t out_size) const;
+
+	std::size_t block_size() const noexcept { return m_block_size; }
+	std::size_t partitions() const noexcept { return m_partitions; }
+
+	/**
+	 * The power of 2 block size which minimises the estimated number of operations needed to
+	 * convolve signal_size samples with an impulse response of ir_size samples
+	 */
+	static std::size_t optimal_block_size(std::size_t ir_size, std::size_t signal_size);
+
+private:
+	std::size_t m_block_size;
+	std::size_t m_partitions;
+	// the spectra of the partitions each stored as block_size+1 real parts then block_size+1
+	// imaginary parts, scaled so that the inverse transform of the products is the convolution
+	std::vector<T> m_spectra;
+	Real_FFT_Plan<T> m_forward;
+	Real_FFT_Plan<T> m_inverse;
+};
+
+extern template class Convolver<float>;
+extern template class Convolver<double>;
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "convolution.hpp"
+
+/**
+ * Checks of the convolver against a direct time domain convolution. Impulse responses
+ * shorter than, equal to and much longer than the block size are convolved with process(),
+ * out of place and in place, and with streams fed chunks which do not divide the block size.
+ * The exit status is non zero if any check fails.
+ */
+
+static std::vector<float> random_signal(std::size_t size, std::mt19937& rng) {
+	std::uniform_real_distribution<float> distribution(-1, 1);
+	std::vector<float> signal(size);
+	for (float& x : signal) x = distribution(rng);
+	return signal;
+}
+
+static std::vector<double> direct_convolution(const std::vector<float>& signal, const std::vector<float>& ir) {
+	std::vector<double> out(signal.size() + ir.size() - 1);
+	for (std::size_t i = 0; i < signal.size(); ++i)
+		for (std::size_t j = 0; j < ir.size(); ++j)
+			out[i+j] += static_cast<double>(signal[i])*ir[j];
+	return out;
+}
+
+// largest absolute error of out[offset, offset + reference.size()) relative to the peak of reference
+static double relative_error(const std::vector<float>& out, std::size_t offset, const std::vector<double>& reference) {
+	double error = 0, peak = 0;
+	for (std::size_t i = 0; i < reference.size(); ++i) {
+		error = std::max(error, std::abs(out[offset+i] - reference[i]));
+		peak = std::max(peak, std::abs(reference[i]));
+	}
+	return error/peak;
+}
+
+template <typename T>
+static bool check(const char* name, std::size_t ir_size, std::size_t block_size, std::size_t chunk_size, double error) {
+	// the output is stored as floats
+	const double tolerance = sizeof(T) == sizeof(float) ? 1e-4 : 1e-5;
+	const bool ok = error <= tolerance;
+	std::printf("%-6s %-10s %6zu %6zu %6zu %12.3e%s\n",
+	            sizeof(T) == sizeof(float) ? "float" : "double", name, ir_size, block_size, chunk_size, error, ok ? "" : "  FAIL");
+	return ok;
+}
+
+template <typename T>
+static std::size_t run(const std::vector<float>& signal, const std::vector<float>& ir,
+                       const std::vector<double>& reference, std::size_t block_size, std::mt19937& rng) {
+	std::size_t failures = 0;
+	const Convolver<T> convolver(ir.data(), ir.size(), block_size, signal.size());
+	block_size = convolver.block_size();
+
+	std::vector<float> out(reference.size());
+	convolver.process(signal.data(), signal.size(), out.data(), out.size());
+	if (!check<T>("process", ir.size(), block_size, 0, relative_error(out, 0, reference))) ++failures;
+
+	std::vector<float> in_place = signal;
+	in_place.resize(reference.size());
+	convolver.process(in_place.data(), signal.size(), in_place.data(), in_place.size());
+	if (!check<T>("in place", ir.size(), block_size, 0, relative_error(in_place, 0, reference))) ++failures;
+
+	// chunk sizes of 0 are random
+	typename Convolver<T>::Stream stream(convolver);
+	for (const std::size_t chunk_size : {std::size_t(1), std::size_t(37), block_size+3, 3*block_size-1, std::size_t(0)}) {
+		std::vector<float> streamed = signal;
+		streamed.resize(reference.size() + block_size);
+		std::uniform_int_distribution<std::size_t> random_chunk(1, 3*block_size);
+		for (std::size_t position = 0; position < streamed.size();) {
+			const std::size_t n = std::min(chunk_size ? chunk_size : random_chunk(rng), streamed.size()-position);
+			stream.process(streamed.data()+position, streamed.data()+position, n);
+			position += n;
+		}
+		stream.reset();
+		if (!check<T>("stream", ir.size(), block_size, chunk_size, relative_error(streamed, block_size, reference))) ++failures;
+	}
+	return failures;
+}
+
+int main() {
+	std::mt19937 rng(1);
+	std::size_t failures = 0;
+
+	const std::vector<float> signal = random_signal(3001, rng);
+	for (const std::size_t ir_size : {std::size_t(1), std::size_t(17), std::size_t(64), std::size_t(5000)}) {
+		const std::vector<float> ir = random_signal(ir_size, rng);
+		const std::vector<double> reference = direct_convolution(signal, ir);
+		// a block size of 0 selects the optimal one
+		for (const std::size_t block_size : {std::size_t(64), std::size_t(0)}) {
+			failures += run<float>(signal, ir, reference, block_size, rng);
+			failures += run<double>(signal, ir, reference, block_size, rng);
+		}
+	}
+
+	if (failures) std::printf("%zu convolution checks failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -1,6 +1,16 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <stdexcept>
+#include <vector>
 #include "fft.hpp"
+#include "fft_internal.hpp"
+#include "fft_kernels.hpp"
+#include "thread_pool.hpp"
 
 void split_channels(std::complex<double>* in,
                     std::complex<double>* left,
@@ -35,204 +45,709 @@ void join_channels(std::complex<double>* left,
 		out[size-1] = std::complex<double>(right[size/2].imag(), left[size/2].imag());
 }
 
-static void dft(const std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	const std::complex<double> wmm = std::exp(std::complex<double>(0, -2.0*M_PI/size));
-	std::complex<double> wm = 1; // wm = wmm^k
-	for (std::size_t k = 0; k < size; ++k) {
-		out[k] = 0.0;
-		std::complex<double> w = 1; // w = wm^n = wmm^nk
-		for (std::size_t n = 0; n < size; ++n) {
-			out[k] += in[n]*w;
-			w *= wm;
-		}
-		out[k] /= size;
+static std::size_t default_fft_threads() {
+	if (const char* threads = std::getenv("FFT_THREADS")) return std::strtoull(threads, nullptr, 10);
+	return 0;
+}
 
-		wm *= wmm;
-	}
+static std::shared_ptr<Thread_Pool>& fft_thread_pool() {
+	static std::shared_ptr<Thread_Pool> pool = std::make_shared<Thread_Pool>(default_fft_threads());
+	return pool;
 }
 
-static void idft(const std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	const std::complex<double> wmm = std::exp(std::complex<double>(0, 2.0*M_PI/size));
-	std::complex<double> wm = 1;
-	for (std::size_t k = 0; k < size; ++k) {
-		out[k] = 0.0;
-		std::complex<double> w = 1;
-		for (std::size_t n = 0; n < size; ++n) {
-			out[k] += in[n]*w;
-			w *= wm;
-		}
-		wm *= wmm;
-	}
+void set_fft_threads(std::size_t n_threads) {
+	std::atomic_store(&fft_thread_pool(), std::make_shared<Thread_Pool>(n_threads));
+}
+
+std::size_t get_fft_threads() {
+	return std::atomic_load(&fft_thread_pool())->size();
 }
 
 /**
- * bit_reverse reverses the first num_reverse bits in n
+ * Calls task(begin, end) over [0, count) using the fft thread pool.
+ * cost is roughly the number of operations per item, loops with too little work to be
+ * worth splitting run on the calling thread. Loops with fewer items than threads also
+ * run serially so that the loops nested inside them can be split instead.
  */
-static std::size_t bit_reverse(std::size_t n, std::size_t num_reverse) {
-	std::size_t rtrn = 0;
-	for (size_t bit = 0; bit < num_reverse; ++bit) {
-		rtrn <<= 1;
-		rtrn += ( (n&(1 << bit)) != 0 );
-	}
-	return rtrn;
+template <typename Task>
+static void parallel_for(std::size_t count, std::size_t cost, const Task& task) {
+	constexpr std::size_t min_chunk_cost = std::size_t(1) << 14;
+	if (count*cost < 2*min_chunk_cost || Thread_Pool::in_task()) return task(0, count);
+
+	const std::shared_ptr<Thread_Pool> pool = std::atomic_load(&fft_thread_pool());
+	if (pool->size() == 1 || count < pool->size()) return task(0, count);
+
+	const std::size_t grain = std::max((min_chunk_cost+cost-1)/cost, count/(4*pool->size()));
+	pool->parallel_for(count, grain, task);
+}
+
+void fft_parallel_for(std::size_t count, std::size_t cost, const std::function<void(std::size_t, std::size_t)>& task) {
+	parallel_for(count, cost, task);
+}
+
+template <typename T>
+struct FFT_Node {
+	virtual ~FFT_Node() = default;
+
+	/**
+	 * Computes the unscaled transform of in and stores it in out.
+	 * in may be used as scratch space
+	 */
+	virtual void execute(std::complex<T>* in, std::complex<T>* out) const = 0;
+
+	/**
+	 * Computes the unscaled transform of data in place.
+	 * Nodes only use scratch space which is small compared to the size of data.
+	 */
+	virtual void execute_in_place(std::complex<T>* data) const = 0;
+};
+
+template <typename T>
+static std::shared_ptr<const FFT_Node<T>> get_node(std::size_t size, FFT_Direction direction);
+
+template <typename T> class Decimation_Node;
+
+template <typename T>
+static std::shared_ptr<const Decimation_Node<T>> get_decimation_node(std::size_t size, FFT_Direction direction);
+
+/**
+ * returns {exp(-+2*pi*i*n/size) | 0 <= n < count}, the sign depends on the direction
+ * The twiddles are always evaluated in double precision
+ */
+template <typename T>
+static std::vector<std::complex<T>> twiddle_table(std::size_t count, std::size_t size, FFT_Direction direction) {
+	const double sign = direction == FFT_Direction::forward ? -1.0 : 1.0;
+	std::vector<std::complex<T>> table(count);
+	for (std::size_t n = 0; n < count; ++n)
+		table[n] = std::polar(1.0, sign*2.0*M_PI*static_cast<double>(n)/static_cast<double>(size));
+	return table;
+}
+
+// (a*b) for complex numbers without the checks for infinities of std::complex multiplication
+template <typename T>
+static inline std::complex<T> mul(std::complex<T> a, std::complex<T> b) {
+	return {a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real()};
+}
+
+// i*a if sign > 0, -i*a otherwise
+template <typename T>
+static inline std::complex<T> rotate(std::complex<T> a, T sign) {
+	return {-sign*a.imag(), sign*a.real()};
 }
 
 /**
- * Requires size to be a power of 2
+ * Transforms of sizes whose prime factors are all <= max_smooth_radix, computed with the
+ * mixed radix stockham autosort algorithm. Each pass transforms the signal with one radix and
+ * writes it to the other buffer in natural order. A pass with radix p over the signal as
+ * l1 blocks of p rows of ido elements computes
+ * y[i + ido*(k + l1*m)] = w^(m*l1*i) * sum_j x[i + ido*(j + p*k)] * exp(-+2*pi*i*j*m/p)
+ * where w = exp(-+2*pi*i/size). Radices 2, 3, 4 and 5 have dedicated butterflies, other
+ * radices are evaluated directly.
  */
-static void bit_reverse_copy(const std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	std::size_t log_size = 0;
-	while (1 << log_size ^ size) ++log_size;
-	for (std::size_t i = 0; i < size; ++i) out[bit_reverse(i, log_size)] = in[i];
-}
-
-static void bit_reverse_fft(const std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	bit_reverse_copy(in, out, size);
-	for (std::size_t m = 2; m <= size; m <<= 1) {
-		const std::complex<double> wm = std::exp(std::complex<double>(0.0, -2.0*M_PI/m));
-		for (std::size_t k = 0; k < size; k += m) {
-			std::complex<double> w = 1;
-			for (std::size_t j = 0; j < m/2; ++j) {
-				const auto even = out[k+j];
-				const auto odd = w*out[k+j+m/2];
-				out[k+j] = even + odd;
-				out[k+j+m/2] = even - odd;
-				w *= wm;
+template <typename T>
+class Smooth_Node : public FFT_Node<T> {
+public:
+	static constexpr std::size_t max_smooth_radix = 31;
+
+	Smooth_Node(std::size_t size, FFT_Direction direction)
+		: m_size(size), m_sign(direction == FFT_Direction::forward ? -1 : 1) {
+		std::size_t remaining = size;
+		std::size_t l1 = 1;
+		const auto add_pass = [&](std::size_t radix) {
+			remaining /= radix;
+			Pass pass = {radix, l1, remaining, m_twiddles.size(), m_roots.size()};
+			for (std::size_t m = 1; m < radix; ++m)
+				for (std::size_t i = 0; i < remaining; ++i)
+					m_twiddles.push_back(polar(mul_mod(m*l1, i, size), size));
+			for (std::size_t t = 0; radix > 5 && t < radix; ++t)
+				m_roots.push_back(polar(t, radix));
+			m_passes.push_back(pass);
+			l1 *= radix;
+		};
+		while (remaining%4 == 0 && remaining > 1) add_pass(4);
+		if (remaining%2 == 0 && remaining > 1) add_pass(2);
+		for (std::size_t radix = 3; remaining > 1; radix += 2) {
+			while (remaining%radix == 0) add_pass(radix);
+			if (radix > max_smooth_radix && remaining > 1)
+				throw std::logic_error("Smooth_Node size has a prime factor larger than max_smooth_radix");
+		}
+	}
+
+	// true if every prime factor of size is <= max_smooth_radix
+	static bool is_smooth(std::size_t size) {
+		if (size == 0) return true;
+		for (std::size_t radix = 2; radix <= max_smooth_radix; ++radix)
+			while (size%radix == 0) size /= radix;
+		return size == 1;
+	}
+
+	void execute(std::complex<T>* in, std::complex<T>* out) const override {
+		if (m_passes.size()%2 == 0) {
+			std::copy_n(in, m_size, out);
+			run_passes(out, in);
+		} else {
+			run_passes(in, out);
+		}
+	}
+
+	void execute_in_place(std::complex<T>* data) const override {
+		static thread_local std::vector<std::complex<T>> scratch;
+		scratch.resize(m_size);
+		if (m_passes.size()%2 == 0) {
+			run_passes(data, scratch.data());
+		} else {
+			std::copy_n(data, m_size, scratch.data());
+			run_passes(scratch.data(), data);
+		}
+	}
+
+private:
+	struct Pass {
+		std::size_t radix, l1, ido;
+		// offsets into m_twiddles and m_roots
+		std::size_t twiddles, roots;
+	};
+
+	std::complex<T> polar(std::size_t index, std::size_t size) const {
+		return std::complex<T>(std::polar(1.0, m_sign*2.0*M_PI*static_cast<double>(index)/static_cast<double>(size)));
+	}
+
+	// ping-pongs between x and y, the result ends in x after an even number of passes
+	void run_passes(std::complex<T>* x, std::complex<T>* y) const {
+		for (const Pass& pass : m_passes) {
+			switch (pass.radix) {
+			case 2: radix_2(pass, x, y); break;
+			case 3: radix_3(pass, x, y); break;
+			case 4: radix_4(pass, x, y); break;
+			case 5: radix_5(pass, x, y); break;
+			default: radix_n(pass, x, y); break;
 			}
+			std::swap(x, y);
 		}
 	}
 
-	for (std::size_t i = 0; i < size; ++i) out[i] /= static_cast<double>(size);
-}
+	/**
+	 * Calls butterfly(a, b) for every butterfly of the pass, where a holds the radix inputs and
+	 * the results stored in b are multiplied by the twiddles and written out
+	 */
+	template <std::size_t radix, typename Butterfly>
+	void run_pass(const Pass& pass, const std::complex<T>* x, std::complex<T>* y, const Butterfly& butterfly) const {
+		const std::size_t ido = pass.ido, l1 = pass.l1;
+		const std::complex<T>* twiddles = m_twiddles.data() + pass.twiddles;
+		for (std::size_t k = 0; k < l1; ++k) {
+			const std::complex<T>* from = x + ido*radix*k;
+			std::complex<T>* to = y + ido*k;
+			for (std::size_t i = 0; i < ido; ++i) {
+				std::complex<T> a[radix], b[radix];
+				for (std::size_t j = 0; j < radix; ++j) a[j] = from[i + ido*j];
+				butterfly(a, b);
+				to[i] = b[0];
+				for (std::size_t m = 1; m < radix; ++m)
+					to[i + ido*l1*m] = mul(b[m], twiddles[(m-1)*ido + i]);
+			}
+		}
+	}
+
+	void radix_2(const Pass& pass, const std::complex<T>* x, std::complex<T>* y) const {
+		run_pass<2>(pass, x, y, [](const std::complex<T>* a, std::complex<T>* b) {
+			b[0] = a[0] + a[1];
+			b[1] = a[0] - a[1];
+		});
+	}
+
+	void radix_3(const Pass& pass, const std::complex<T>* x, std::complex<T>* y) const {
+		const T s = m_sign*T(0.866025403784438646763723170752936183);
+		run_pass<3>(pass, x, y, [s](const std::complex<T>* a, std::complex<T>* b) {
+			const std::complex<T> t = a[1] + a[2];
+			const std::complex<T> c = a[0] - T(0.5)*t;
+			const std::complex<T> d = rotate(a[1] - a[2], s);
+			b[0] = a[0] + t;
+			b[1] = c + d;
+			b[2] = c - d;
+		});
+	}
+
+	void radix_4(const Pass& pass, const std::complex<T>* x, std::complex<T>* y) const {
+		const T sign = m_sign;
+		run_pass<4>(pass, x, y, [sign](const std::complex<T>* a, std::complex<T>* b) {
+			const std::complex<T> t0 = a[0] + a[2], t1 = a[0] - a[2];
+			const std::complex<T> t2 = a[1] + a[3], t3 = rotate(a[1] - a[3], sign);
+			b[0] = t0 + t2;
+			b[1] = t1 + t3;
+			b[2] = t0 - t2;
+			b[3] = t1 - t3;
+		});
+	}
+
+	void radix_5(const Pass& pass, const std::complex<T>* x, std::complex<T>* y) const {
+		const T c1 = T(0.309016994374947424102293417182819059), c2 = T(-0.809016994374947424102293417182819059);
+		const T s1 = m_sign*T(0.951056516295153572116439333379382143), s2 = m_sign*T(0.587785252292473129168705954639072769);
+		run_pass<5>(pass, x, y, [=](const std::complex<T>* a, std::complex<T>* b) {
+			const std::complex<T> t1 = a[1] + a[4], t2 = a[2] + a[3];
+			const std::complex<T> d1 = a[1] - a[4], d2 = a[2] - a[3];
+			const std::complex<T> c_1 = a[0] + c1*t1 + c2*t2, c_2 = a[0] + c2*t1 + c1*t2;
+			const std::complex<T> r1 = rotate(s1*d1 + s2*d2, T(1)), r2 = rotate(s2*d1 - s1*d2, T(1));
+			b[0] = a[0] + t1 + t2;
+			b[1] = c_1 + r1;
+			b[4] = c_1 - r1;
+			b[2] = c_2 + r2;
+			b[3] = c_2 - r2;
+		});
+	}
 
-static void bit_reverse_ifft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	bit_reverse_copy(in, out, size);
-	for (std::size_t m = 2; m <= size; m <<= 1) {
-		const std::complex<double> wm = std::exp(std::complex<double>(0.0, 2.0*M_PI/m));
-		for (std::size_t k = 0; k < size; k += m) {
-			std::complex<double> w = 1;
-			for (std::size_t j = 0; j < m/2; ++j) {
-				const auto even = out[k+j];
-				const auto odd = w*out[k+j+m/2];
-				out[k+j] = even + odd;
-				out[k+j+m/2] = even - odd;
-				w *= wm;
+	void radix_n(const Pass& pass, const std::complex<T>* x, std::complex<T>* y) const {
+		const std::size_t radix = pass.radix, ido = pass.ido, l1 = pass.l1;
+		const std::complex<T>* twiddles = m_twiddles.data() + pass.twiddles;
+		const std::complex<T>* roots = m_roots.data() + pass.roots;
+		std::complex<T> a[max_smooth_radix];
+		for (std::size_t k = 0; k < l1; ++k) {
+			for (std::size_t i = 0; i < ido; ++i) {
+				for (std::size_t j = 0; j < radix; ++j) a[j] = x[i + ido*(j + radix*k)];
+				for (std::size_t m = 0; m < radix; ++m) {
+					std::complex<T> sum = a[0];
+					std::size_t index = 0; // j*m mod radix
+					for (std::size_t j = 1; j < radix; ++j) {
+						index += m;
+						if (index >= radix) index -= radix;
+						sum += mul(a[j], roots[index]);
+					}
+					y[i + ido*(k + l1*m)] = m ? mul(sum, twiddles[(m-1)*ido + i]) : sum;
+				}
 			}
 		}
 	}
-}
+
+	std::size_t m_size;
+	T m_sign;
+	std::vector<Pass> m_passes;
+	// w^(m*l1*i) of each pass, stored as radix-1 rows of ido twiddles
+	std::vector<std::complex<T>> m_twiddles;
+	// exp(-+2*pi*i*t/radix) for the passes without a dedicated butterfly
+	std::vector<std::complex<T>> m_roots;
+};
 
 /**
- * Finds the nearest power of 2 which is >= n
+ * In place decimation in time and decimation in frequency passes over power of 2 signals
+ * stored as separate arrays of real and imaginary parts. Bluesteins algorithm uses them to
+ * compute convolutions without reordering the spectra.
+ * Requires size to be a power of 2 >= 4
  */
-static inline std::size_t next_pow_2(std::size_t n) {
-	std::size_t log_n = ((n&(n-1)) != 0);
-	while (n >>= 1) ++log_n;
-	return 1 << log_n;
-}
+template <typename T>
+class Decimation_Node {
+public:
+	Decimation_Node(std::size_t size, FFT_Direction direction)
+		: m_size(size), m_inverse(direction == FFT_Direction::inverse) {
+		std::size_t log_size = 0;
+		while ((std::size_t(1) << log_size) < size) ++log_size;
+
+		// a radix 2 pass is needed when log2(size) is odd
+		m_first_quarter = log_size&1 ? 2 : 1;
+		m_block = m_first_quarter;
+		m_block_twiddles = 0;
+		for (std::size_t quarter = m_first_quarter; 4*quarter <= size; quarter *= 4) {
+			for (const std::size_t power : {1, 2}) {
+				const auto stage = twiddle_table<T>(quarter, 4*quarter/power, direction);
+				for (const auto& w : stage) m_twiddles.push_back(w.real());
+				for (const auto& w : stage) m_twiddles.push_back(w.imag());
+			}
 
-static void bluesteins_algorithm(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	const std::size_t padded_size = next_pow_2(2*size-1);
+			// the passes which fit in the cache are computed one block at a time
+			if (4*quarter*sizeof(T) <= max_block_bytes) {
+				m_block = 4*quarter;
+				m_block_twiddles = m_twiddles.size();
+			}
+		}
+	}
 
-	std::complex<double>* a = new std::complex<double>[padded_size]();
-	std::complex<double>* b = new std::complex<double>[padded_size]();
-	std::complex<double>* c = new std::complex<double>[padded_size];
+	// transforms bit reversed input into output in natural order
+	void decimation_in_time(T* re, T* im) const {
+		const FFT_Kernels<T>& kernels = fft_kernels<T>();
+		parallel_for(m_size/m_block, m_block*block_passes(), [&](std::size_t begin, std::size_t end) {
+			for (std::size_t block = begin*m_block; block < end*m_block; block += m_block) {
+				if (m_first_quarter == 2) kernels.radix_2_pass(re+block, im+block, m_block);
 
-	for (std::size_t n = 0; n < size; ++n) {
-		a[n] = in[n]*std::exp(std::complex<double>(0.0, -M_PI*n*n/size));
-		b[n] = std::exp(std::complex<double>(0.0, M_PI*n*n/size));
+				const T* twiddles = m_twiddles.data();
+				for (std::size_t quarter = m_first_quarter; 4*quarter <= m_block; quarter *= 4) {
+					kernels.dit_radix_4_pass(re+block, im+block, twiddles, m_block, quarter, 0, quarter, m_inverse);
+					twiddles += 4*quarter;
+				}
+			}
+		});
+
+		const T* twiddles = m_twiddles.data() + m_block_twiddles;
+		for (std::size_t quarter = m_block; 4*quarter <= m_size; quarter *= 4) {
+			split_pass(quarter, [&](std::size_t begin, std::size_t end) {
+				kernels.dit_radix_4_pass(re, im, twiddles, m_size, quarter, begin, end, m_inverse);
+			});
+			twiddles += 4*quarter;
+		}
 	}
 
-	for (std::size_t n = 1; n < size; ++n) b[padded_size-n] = b[n];
+	// transforms input in natural order into bit reversed output
+	void decimation_in_frequency(T* re, T* im) const {
+		const FFT_Kernels<T>& kernels = fft_kernels<T>();
+		const T* twiddles = m_twiddles.data() + m_twiddles.size();
+		for (std::size_t quarter = m_size/4; quarter >= m_block; quarter /= 4) {
+			twiddles -= 4*quarter;
+			split_pass(quarter, [&](std::size_t begin, std::size_t end) {
+				kernels.dif_radix_4_pass(re, im, twiddles, m_size, quarter, begin, end, m_inverse);
+			});
+		}
 
-	bit_reverse_ifft(b, c, padded_size);
-	bit_reverse_ifft(a, b, padded_size);
+		parallel_for(m_size/m_block, m_block*block_passes(), [&](std::size_t begin, std::size_t end) {
+			for (std::size_t block = begin*m_block; block < end*m_block; block += m_block) {
+				const T* twiddles = m_twiddles.data() + m_block_twiddles;
+				for (std::size_t quarter = m_block/4; quarter >= m_first_quarter; quarter /= 4) {
+					twiddles -= 4*quarter;
+					kernels.dif_radix_4_pass(re+block, im+block, twiddles, m_block, quarter, 0, quarter, m_inverse);
+				}
 
-	for (std::size_t n = 0; n < padded_size; ++n) b[n] *= c[n];
+				if (m_first_quarter == 2) kernels.radix_2_pass(re+block, im+block, m_block);
+			}
+		});
+	}
 
-	bit_reverse_fft(b, a, padded_size);
+private:
+	// blocks of up to max_block_bytes of real and imaginary parts are transformed independently
+	static constexpr std::size_t max_block_bytes = std::size_t(1) << 17;
 
-	for (int k = 0; static_cast<std::size_t>(k) < size; ++k)
-		out[k] = std::exp(std::complex<double>(0.0, -M_PI*k*k/size)) * a[k] / static_cast<double>(size);
+	std::size_t block_passes() const {
+		std::size_t passes = 1;
+		for (std::size_t quarter = m_first_quarter; 4*quarter <= m_block; quarter *= 4) ++passes;
+		return passes;
+	}
 
-	delete[] a;
-	delete[] b;
-	delete[] c;
-}
+	/**
+	 * Splits the butterflies of a pass over the whole signal between the threads,
+	 * each thread computes the butterflies with begin <= j < end in every group
+	 */
+	template <typename Pass>
+	void split_pass(std::size_t quarter, const Pass& pass) const {
+		const std::size_t step = std::min<std::size_t>(16, quarter);
+		parallel_for(quarter/step, step*m_size/quarter, [&](std::size_t begin, std::size_t end) {
+			pass(begin*step, end*step);
+		});
+	}
 
-static void inverse_bluesteins_algorithm(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	const std::size_t padded_size = next_pow_2(2*size-1);
+	std::size_t m_size;
+	bool m_inverse;
+	std::size_t m_first_quarter;
+	// the passes with 4*quarter <= m_block use the first m_block_twiddles twiddles
+	std::size_t m_block;
+	std::size_t m_block_twiddles;
+	std::vector<T> m_twiddles;
+};
 
-	std::complex<double>* a = new std::complex<double>[padded_size]();
-	std::complex<double>* b = new std::complex<double>[padded_size]();
-	std::complex<double>* c = new std::complex<double>[padded_size];
+// larger power of 2 and smooth transforms are split by a Mixed_Radix_Node
+static constexpr std::size_t max_stockham_size = std::size_t(1) << 16;
+static constexpr std::size_t max_smooth_size = std::size_t(1) << 16;
 
-	for (std::size_t n = 0; n < size; ++n) {
-		a[n] = in[n]*std::exp(std::complex<double>(0.0, M_PI*n*n/size));
-		b[n] = std::exp(std::complex<double>(0.0, -M_PI*n*n/size));
+/**
+ * Power of 2 transforms computed with the stockham autosort algorithm, every pass reads and
+ * writes the signal in natural order so no bit reversal is needed. The passes alternate between
+ * two copies of the signal stored as separate arrays of real and imaginary parts.
+ * Requires size to be a power of 2 >= 16 and <= max_stockham_size
+ */
+template <typename T>
+class Stockham_Node : public FFT_Node<T> {
+public:
+	Stockham_Node(std::size_t size, FFT_Direction direction)
+		: m_size(size), m_inverse(direction == FFT_Direction::inverse), m_passes(0) {
+		const double sign = direction == FFT_Direction::forward ? -1.0 : 1.0;
+		for (std::size_t stride = 1; stride < size; stride *= 4) ++m_passes;
+		for (std::size_t stride = 1; 4*stride <= size; stride *= 4) {
+			const std::size_t n = size/stride;
+			for (const double power : {1.0, 2.0, 3.0}) {
+				std::vector<std::complex<T>> stage(n/4);
+				for (std::size_t p = 0; p < n/4; ++p)
+					stage[p] = std::polar(1.0, sign*2.0*M_PI*power*static_cast<double>(p)/static_cast<double>(n));
+				for (const auto& w : stage) m_twiddles.push_back(w.real());
+				for (const auto& w : stage) m_twiddles.push_back(w.imag());
+			}
+		}
 	}
 
-	for (std::size_t n = 1; n < size; ++n) b[padded_size-n] = b[n];
+	void execute(std::complex<T>* in, std::complex<T>* out) const override {
+		T* const x = reinterpret_cast<T*>(out);
+		T* const y = reinterpret_cast<T*>(in);
+		for (std::size_t i = 0; i < m_size; ++i) {
+			x[i] = in[i].real();
+			x[m_size+i] = in[i].imag();
+		}
+
+		run_passes(x, y, false);
 
-	bit_reverse_ifft(b, c, padded_size);
-	bit_reverse_ifft(a, b, padded_size);
+		for (std::size_t i = 0; i < m_size; ++i) out[i] = {y[i], y[m_size+i]};
+	}
 
-	for (std::size_t n = 0; n < padded_size; ++n) b[n] *= c[n];
+	void execute_in_place(std::complex<T>* data) const override {
+		static thread_local std::vector<T> scratch;
+		scratch.resize(2*m_size);
+		T* const x = scratch.data();
+		T* const y = reinterpret_cast<T*>(data);
+		for (std::size_t i = 0; i < m_size; ++i) {
+			x[i] = data[i].real();
+			x[m_size+i] = data[i].imag();
+		}
 
-	bit_reverse_fft(b, a, padded_size);
+		run_passes(x, y, true);
 
-	for (int k = 0; static_cast<std::size_t>(k) < size; ++k)
-		out[k] = std::exp(std::complex<double>(0.0, M_PI*k*k/size)) * a[k];
+		for (std::size_t i = 0; i < m_size; ++i) data[i] = {x[i], x[m_size+i]};
+	}
 
-	delete[] a;
-	delete[] b;
-	delete[] c;
-}
+private:
+	/**
+	 * Runs the passes starting from the real and imaginary parts in x, each stored as m_size
+	 * real parts followed by m_size imaginary parts. The result ends in x if end_in_x is set
+	 * and in y otherwise, the last pass is computed in place when needed to get there.
+	 */
+	void run_passes(T* x, T* y, bool end_in_x) const {
+		const FFT_Kernels<T>& kernels = fft_kernels<T>();
+		// every out of place pass swaps x and y
+		const bool last_in_place = (m_passes%2 == 0) != end_in_x;
 
-static void separate(const std::complex<double>* in, std::complex<double>* out, std::size_t radix, std::size_t size) {
-	for (std::size_t i = 0; i < radix; ++i)
-		for (std::size_t j = 0; j < size/radix; ++j)
-			out[i*size/radix+j] = in[radix*j+i];
+		const T* twiddles = m_twiddles.data();
+		std::size_t stride = 1;
+		for (std::size_t pass = 1; pass <= m_passes; ++pass, stride *= 4) {
+			const bool in_place = last_in_place && pass == m_passes;
+			T* const to = in_place ? x : y;
+			if (4*stride <= m_size) {
+				kernels.stockham_radix_4_pass(x, x+m_size, to, to+m_size, twiddles, m_size, stride, m_inverse);
+				twiddles += 6*(m_size/(4*stride));
+			} else {
+				kernels.stockham_radix_2_pass(x, x+m_size, to, to+m_size, m_size);
+			}
+			if (!in_place) std::swap(x, y);
+		}
+	}
+
+	std::size_t m_size;
+	bool m_inverse;
+	std::size_t m_passes;
+	std::vector<T> m_twiddles;
+};
+
+/**
+ * Finds the nearest power of 2 which is >= n
+ */
+static inline std::size_t next_pow_2(std::size_t n) {
+	std::size_t log_n = ((n&(n-1)) != 0);
+	while (n >>= 1) ++log_n;
+	return std::size_t(1) << log_n;
 }
 
-static void combine(const std::complex<double>* in, std::complex<double>* out, std::size_t radix, std::size_t size) {
-	for (std::size_t i = 0; i < radix; ++i)
-		for (std::size_t j = 0; j < size/radix; ++j)
-			out[radix*j+i] = in[i*size/radix+j];
+/**
+ * Resizes buffer so that it holds a 64 byte aligned array of size elements and returns the array
+ */
+template <typename T>
+static T* aligned_scratch(std::vector<T>& buffer, std::size_t size) {
+	buffer.resize(size + 64/sizeof(T));
+	void* data = buffer.data();
+	std::size_t space = buffer.size()*sizeof(T);
+	return static_cast<T*>(std::align(64, size*sizeof(T), data, space));
 }
 
-static void mixed_radix_fft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	std::size_t radix = static_cast<std::size_t>(sqrt(size));
-	while (size%radix) --radix;
-	separate(in, out, radix, size);
-	for (std::size_t n = 0; n < radix; ++n)
-		fft(out + n*size/radix, in + n*size/radix, size/radix);
+/**
+ * Computes transforms of arbitrary size as a convolution of power of 2 size.
+ * The convolution is computed with a decimation in frequency forward transform
+ * and a decimation in time inverse transform so no bit reversal is required.
+ * The chirp and the transformed filter only depend on the size so they are computed
+ * once with the plan, the chirp index n^2 is reduced modulo 2*size exactly before
+ * the angle is computed so large sizes do not lose precision.
+ */
+template <typename T>
+class Bluestein_Node : public FFT_Node<T> {
+public:
+	Bluestein_Node(std::size_t size, FFT_Direction direction)
+		: m_size(size),
+		  m_padded_size(next_pow_2(2*size-1)),
+		  m_chirp(size),
+		  m_filter_re(m_padded_size),
+		  m_filter_im(m_padded_size),
+		  m_forward(get_decimation_node<T>(m_padded_size, FFT_Direction::forward)),
+		  m_inverse(get_decimation_node<T>(m_padded_size, FFT_Direction::inverse)) {
+		const double sign = direction == FFT_Direction::forward ? -1.0 : 1.0;
+		// exp(-+i*pi*n^2/size) has period 2*size in n^2
+		parallel_for(size, 64, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t n = begin; n < end; ++n) {
+				const double angle = sign*M_PI*static_cast<double>(mul_mod(n, n, 2*size))/static_cast<double>(size);
+				m_chirp[n] = std::polar(1.0, angle);
+				// the filter is the conjugate chirp, the result is scaled by 1/m_padded_size through it
+				const auto b = std::polar(1.0/static_cast<double>(m_padded_size), -angle);
+				m_filter_re[n] = b.real();
+				m_filter_im[n] = b.imag();
+				if (n) {
+					m_filter_re[m_padded_size-n] = b.real();
+					m_filter_im[m_padded_size-n] = b.imag();
+				}
+			}
+		});
+		m_forward->decimation_in_frequency(m_filter_re.data(), m_filter_im.data());
+	}
+
+	void execute(std::complex<T>* in, std::complex<T>* out) const override {
+		static thread_local std::vector<T> scratch;
+		T* const a_re = aligned_scratch(scratch, 2*m_padded_size);
+		T* const a_im = a_re + m_padded_size;
+
+		parallel_for(m_padded_size, 4, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t n = begin; n < std::min(end, m_size); ++n) {
+				const T re = in[n].real(), im = in[n].imag();
+				const T w_re = m_chirp[n].real(), w_im = m_chirp[n].imag();
+				a_re[n] = re*w_re - im*w_im;
+				a_im[n] = re*w_im + im*w_re;
+			}
+			for (std::size_t n = std::max(begin, m_size); n < end; ++n) a_re[n] = a_im[n] = 0;
+		});
 
-	combine(in, out, radix, size);
-	for (std::size_t k = 0; k*radix < size; ++k) {
-		for (std::size_t n = 0; n < radix; ++n)
-			out[radix*k+n] *= std::exp(std::complex<double>(0, -2.0*M_PI*n*k/size));
-		fft(out + radix*k, in + radix*k, radix);
+		m_forward->decimation_in_frequency(a_re, a_im);
+		parallel_for(m_padded_size, 4, [&](std::size_t begin, std::size_t end) {
+			fft_kernels<T>().multiply(a_re+begin, a_im+begin, m_filter_re.data()+begin, m_filter_im.data()+begin, end-begin);
+		});
+		m_inverse->decimation_in_time(a_re, a_im);
+
+		parallel_for(m_size, 4, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t k = begin; k < end; ++k) {
+				const T w_re = m_chirp[k].real(), w_im = m_chirp[k].imag();
+				out[k] = {a_re[k]*w_re - a_im[k]*w_im, a_re[k]*w_im + a_im[k]*w_re};
+			}
+		});
 	}
-	separate(in, out, radix, size);
-}
 
-static void mixed_radix_ifft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	std::size_t radix = static_cast<std::size_t>(sqrt(size));
-	while (size%radix) --radix;
-	separate(in, out, radix, size);
-	for (std::size_t n = 0; n < radix; ++n)
-		ifft(out + n*size/radix, in + n*size/radix, size/radix);
+	// in is only read before out is written
+	void execute_in_place(std::complex<T>* data) const override { execute(data, data); }
 
-	combine(in, out, radix, size);
-	for (std::size_t k = 0; k*radix < size; ++k) {
-		for (std::size_t n = 0; n < radix; ++n)
-			out[radix*k+n] *= std::exp(std::complex<double>(0, 2.0*M_PI*n*k/size));
-		ifft(out + radix*k, in + radix*k, radix);
+private:
+	std::size_t m_size;
+	std::size_t m_padded_size;
+	// exp(-+i*pi*n^2/size)
+	std::vector<std::complex<T>> m_chirp;
+	// transform of the conjugate chirp scaled by 1/m_padded_size, in bit reversed order
+	std::vector<T> m_filter_re, m_filter_im;
+	std::shared_ptr<const Decimation_Node<T>> m_forward;
+	std::shared_ptr<const Decimation_Node<T>> m_inverse;
+};
+
+/**
+ * Moves data[source(i)] to data[i] for every i by following the cycles of the permutation,
+ * one bit per element marks the positions which have already been written
+ */
+template <typename T, typename Source>
+static void permute_in_place(std::complex<T>* data, std::size_t size, const Source& source) {
+	std::vector<bool> written(size);
+	for (std::size_t start = 0; start < size; ++start) {
+		if (written[start]) continue;
+		const std::complex<T> first = data[start];
+		for (std::size_t i = start;;) {
+			written[i] = true;
+			const std::size_t from = source(i);
+			if (from == start) {
+				data[i] = first;
+				break;
+			}
+			data[i] = data[from];
+			i = from;
+		}
 	}
-	separate(in, out, radix, size);
 }
 
+/**
+ * Transforms count contiguous sub signals of length size, the results are copied back in place
+ */
+template <typename T>
+static void transform_rows_in_place(const FFT_Node<T>& node, std::complex<T>* data, std::size_t count, std::size_t size) {
+	parallel_for(count, transform_cost(size), [&](std::size_t begin, std::size_t end) {
+		std::vector<std::complex<T>> row(size);
+		for (std::size_t i = begin; i < end; ++i) {
+			node.execute(data + i*size, row.data());
+			std::copy(row.begin(), row.end(), data + i*size);
+		}
+	});
+}
+
+/**
+ * Cooley-Tukey decomposition of size = N1*N2 where N1 is the radix.
+ * The signal is treated as N2 rows of N1 elements, x[n1 + N1*n2]. The columns are transformed
+ * in blocks which fit in the cache and multiplied by the twiddle factors exp(-+2*pi*i*n1*k2/size)
+ * in place, then each row is transformed and X[k2 + N2*k1] is written out by transposing blocks
+ * of rows, so the signal is only accessed in contiguous runs.
+ */
+template <typename T>
+class Mixed_Radix_Node : public FFT_Node<T> {
+public:
+	Mixed_Radix_Node(std::size_t size, std::size_t radix, FFT_Direction direction)
+		: m_size(size),
+		  m_N1(radix),
+		  m_N2(size/radix),
+		  m_twiddles(twiddle_table<T>((radix-1)*(size/radix-1)+1, size, direction)),
+		  m_columns(get_node<T>(size/radix, direction)),
+		  m_rows(get_node<T>(radix, direction)) {}
+
+	void execute(std::complex<T>* in, std::complex<T>* out) const override {
+		transform_columns(in);
+
+		const std::size_t block_rows = std::clamp<std::size_t>(block_bytes/(m_N1*sizeof(std::complex<T>)), 1, m_N2);
+		const std::size_t blocks = (m_N2+block_rows-1)/block_rows;
+		parallel_for(blocks, block_rows*transform_cost(m_N1), [&](std::size_t begin, std::size_t end) {
+			std::vector<std::complex<T>> rows(block_rows*m_N1);
+			for (std::size_t block = begin; block < end; ++block) {
+				const std::size_t first = block*block_rows;
+				const std::size_t count = std::min(block_rows, m_N2-first);
+				for (std::size_t row = 0; row < count; ++row)
+					m_rows->execute(in + (first+row)*m_N1, rows.data() + row*m_N1);
+
+				for (std::size_t k1 = 0; k1 < m_N1; ++k1)
+					for (std::size_t row = 0; row < count; ++row)
+						out[k1*m_N2 + first + row] = rows[row*m_N1 + k1];
+			}
+		});
+	}
+
+	void execute_in_place(std::complex<T>* data) const override {
+		transform_columns(data);
+		transform_rows_in_place(*m_rows, data, m_N2, m_N1);
+
+		// X[k2 + N2*k1] is stored at k1 + N1*k2
+		const std::size_t N1 = m_N1, N2 = m_N2;
+		permute_in_place(data, m_size, [N1, N2](std::size_t i) { return (i/N2) + N1*(i%N2); });
+	}
+
+private:
+	// the block of columns which is transformed at once and its transform take about 2*block_bytes
+	static constexpr std::size_t block_bytes = std::size_t(1) << 17;
+	// short runs waste most of each cache line
+	static constexpr std::size_t min_block_columns = 4;
+
+	void transform_columns(std::complex<T>* data) const {
+		const std::size_t block_columns = std::clamp<std::size_t>(
+			block_bytes/(m_N2*sizeof(std::complex<T>)), std::min(min_block_columns, m_N1), m_N1);
+		const std::size_t blocks = (m_N1+block_columns-1)/block_columns;
+		parallel_for(blocks, block_columns*transform_cost(m_N2), [&](std::size_t begin, std::size_t end) {
+			std::vector<std::complex<T>> columns(block_columns*m_N2), transformed(block_columns*m_N2);
+			for (std::size_t block = begin; block < end; ++block) {
+				const std::size_t first = block*block_columns;
+				const std::size_t count = std::min(block_columns, m_N1-first);
+				for (std::size_t n2 = 0; n2 < m_N2; ++n2)
+					for (std::size_t column = 0; column < count; ++column)
+						columns[column*m_N2 + n2] = data[n2*m_N1 + first + column];
+
+				for (std::size_t column = 0; column < count; ++column)
+					m_columns->execute(columns.data() + column*m_N2, transformed.data() + column*m_N2);
+
+				for (std::size_t k2 = 0; k2 < m_N2; ++k2)
+					for (std::size_t column = 0; column < count; ++column)
+						data[k2*m_N1 + first + column] = transformed[column*m_N2 + k2]*m_twiddles[(first+column)*k2];
+			}
+		});
+	}
+
+	std::size_t m_size;
+	std::size_t m_N1, m_N2;
+	std::vector<std::complex<T>> m_twiddles;
+	std::shared_ptr<const FFT_Node<T>> m_columns;
+	std::shared_ptr<const FFT_Node<T>> m_rows;
+};
+
 /**
  * return {x, y} where a*x + b*y = gcd(a, b)
  */
@@ -253,70 +768,402 @@ static std::pair<std::size_t, std::size_t> extended_euclid(std::size_t a, std::s
 	}
 }
 
-void fft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	if (size < 16) return dft(in, out, size);
-	if ((size & (size-1)) == 0) return bit_reverse_fft(in, out, size);
+/**
+ * Good-Thomas prime factor algorithm, requires N1 and N2 to be coprime
+ */
+template <typename T>
+class Prime_Factor_Node : public FFT_Node<T> {
+public:
+	Prime_Factor_Node(std::size_t N1, std::size_t N2, FFT_Direction direction)
+		: m_N1(N1), m_N2(N2), m_size(N1*N2),
+		  m_columns(get_node<T>(N1, direction)),
+		  m_rows(get_node<T>(N2, direction)) {
+		auto [i_N1, i_N2] = extended_euclid(N1, N2);
+		i_N1 = std::min(i_N1, N2+i_N1);
+		i_N2 = std::min(i_N2, N1+i_N2);
+		m_output_step_1 = (i_N2*N2)%m_size;
+		m_output_step_2 = (i_N1*N1)%m_size;
+	}
+
+	void execute(std::complex<T>* in, std::complex<T>* out) const override {
+		// out[n1*N2 + n2] = in[(n1*N2 + n2*N1) % size]
+		parallel_for(m_N1, m_N2, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t n1 = begin; n1 < end; ++n1) {
+				std::size_t index = n1*m_N2;
+				for (std::size_t n2 = 0; n2 < m_N2; ++n2) {
+					out[n1*m_N2+n2] = in[index];
+					index += m_N1;
+					if (index >= m_size) index -= m_size;
+				}
+			}
+		});
+
+		parallel_for(m_N1, transform_cost(m_N2), [&](std::size_t begin, std::size_t end) {
+			for (std::size_t n1 = begin; n1 < end; ++n1)
+				m_rows->execute(out + n1*m_N2, in + n1*m_N2);
+		});
+
+		parallel_for(m_N1, m_N2, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t n1 = begin; n1 < end; ++n1)
+				for (std::size_t n2 = 0; n2 < m_N2; ++n2)
+					out[n2*m_N1+n1] = in[n1*m_N2+n2];
+		});
+
+		parallel_for(m_N2, transform_cost(m_N1), [&](std::size_t begin, std::size_t end) {
+			for (std::size_t k2 = begin; k2 < end; ++k2)
+				m_columns->execute(out+k2*m_N1, in+k2*m_N1);
+		});
+
+		// out[(k1*i_N2*N2 + k2*i_N1*N1) % size] = in[k2*N1 + k1]
+		parallel_for(m_N2, m_N1, [&](std::size_t begin, std::size_t end) {
+			std::size_t row_start = mul_mod(begin, m_output_step_2, m_size);
+			for (std::size_t k2 = begin; k2 < end; ++k2) {
+				std::size_t index = row_start;
+				for (std::size_t k1 = 0; k1 < m_N1; ++k1) {
+					out[index] = in[k2*m_N1+k1];
+					index += m_output_step_1;
+					if (index >= m_size) index -= m_size;
+				}
+				row_start += m_output_step_2;
+				if (row_start >= m_size) row_start -= m_size;
+			}
+		});
+	}
+
+	void execute_in_place(std::complex<T>* data) const override {
+		const std::size_t N1 = m_N1, N2 = m_N2, size = m_size;
+		// data[n1*N2 + n2] = data[(n1*N2 + n2*N1) % size]
+		permute_in_place(data, size, [=](std::size_t i) { return ((i/N2)*N2 + mul_mod(i%N2, N1, size)) % size; });
+		transform_rows_in_place(*m_rows, data, N1, N2);
+
+		// data[n2*N1 + n1] = data[n1*N2 + n2]
+		permute_in_place(data, size, [=](std::size_t i) { return (i%N1)*N2 + i/N1; });
+		transform_rows_in_place(*m_columns, data, N2, N1);
+
+		// the output index k = (k1*i_N2*N2 + k2*i_N1*N1) % size satisfies k1 = k % N1 and k2 = k % N2
+		permute_in_place(data, size, [=](std::size_t k) { return (k%N2)*N1 + k%N1; });
+	}
+
+private:
+	std::size_t m_N1, m_N2, m_size;
+	std::size_t m_output_step_1, m_output_step_2;
+	std::shared_ptr<const FFT_Node<T>> m_columns;
+	std::shared_ptr<const FFT_Node<T>> m_rows;
+};
+
+/**
+ * Chooses the factorisation used for a given size
+ */
+template <typename T>
+static std::shared_ptr<const FFT_Node<T>> make_node(std::size_t size, FFT_Direction direction) {
+	if ((size & (size-1)) == 0 && size >= 16 && size <= max_stockham_size)
+		return std::make_shared<Stockham_Node<T>>(size, direction);
+	if (size <= max_smooth_size && Smooth_Node<T>::is_smooth(size))
+		return std::make_shared<Smooth_Node<T>>(size, direction);
 
 	std::size_t N1 = static_cast<std::size_t>(sqrt(size));
 	while (size%N1) --N1;
-	if (N1 == 1) return bluesteins_algorithm(in, out, size);
+	if (N1 == 1) return std::make_shared<Bluestein_Node<T>>(size, direction);
+	const std::size_t radix = N1;
 	while (std::gcd(N1, size/N1) != 1) N1 *= std::gcd(N1, size/N1);
-	std::size_t N2 = size/N1;
-	if (N2 == 1) return mixed_radix_fft(in, out, size);
+	const std::size_t N2 = size/N1;
+	if (N2 == 1) return std::make_shared<Mixed_Radix_Node<T>>(size, radix, direction);
+
+	return std::make_shared<Prime_Factor_Node<T>>(N1, N2, direction);
+}
 
-	auto [i_N1, i_N2] = extended_euclid(N1, N2);
-	i_N1 = std::min(i_N1, N2+i_N1);
-	i_N2 = std::min(i_N2, N1+i_N2);
+/**
+ * Real transforms of even size pack the even samples into the real part and the odd samples
+ * into the imaginary part of a complex signal of half the size. The spectra of the even and
+ * odd samples are then separated using the symmetry of real spectra and combined.
+ * Odd sizes fall back to a complex transform of the full size.
+ */
+template <typename T>
+struct Real_FFT_Node {
+	Real_FFT_Node(std::size_t size, FFT_Direction direction)
+		: size(size),
+		  complex_plan(size&1 ? size : size/2, direction),
+		  twiddles(twiddle_table<T>(size&1 ? 0 : size/4+1, size, FFT_Direction::forward)) {}
+
+	std::size_t size;
+	FFT_Plan<T> complex_plan;
+	// exp(-2*pi*i*k/size) for 0 <= k <= size/4
+	std::vector<std::complex<T>> twiddles;
+};
+
+static std::mutex plan_cache_mutex;
 
-	for (std::size_t n1 = 0; n1 < N1; ++n1)
-		for (std::size_t n2 = 0; n2 < N2; ++n2)
-			out[n1*N2+n2] = in[(n1*N2 + n2*N1)%size];
+template <typename Node>
+using Plan_Cache = std::map<std::pair<std::size_t, FFT_Direction>, std::shared_ptr<const Node>>;
 
-	for (std::size_t n1 = 0; n1 < N1; ++n1)
-		fft(out + n1*N2, in + n1*N2, N2);
+template <typename T>
+static Plan_Cache<FFT_Node<T>> plan_cache;
 
-	for (std::size_t n1 = 0; n1 < N1; ++n1)
-		for (std::size_t n2 = 0; n2 < N2; ++n2)
-			out[n2*N1+n1] = in[n1*N2+n2];
+template <typename T>
+static Plan_Cache<Real_FFT_Node<T>> real_plan_cache;
+
+template <typename T>
+static Plan_Cache<Decimation_Node<T>> decimation_cache;
+
+/**
+ * Finds the plan for size and direction in cache, creating it with build if it does not exist
+ */
+template <typename Node, typename Build>
+static std::shared_ptr<const Node> find_or_create(Plan_Cache<Node>& cache, std::size_t size, FFT_Direction direction, Build build) {
+	const auto key = std::make_pair(size, direction);
+	{
+		std::lock_guard<std::mutex> lock(plan_cache_mutex);
+		if (auto it = cache.find(key); it != cache.end()) return it->second;
+	}
 
-	for (std::size_t k2 = 0; k2 < N2; ++k2)
-		fft(out+k2*N1, in+k2*N1, N1);
+	// the lock is not held while building as nodes request their sub nodes from the cache
+	std::shared_ptr<const Node> node = build();
 
-	for (std::size_t k2 = 0; k2 < N2; ++k2)
-		for (std::size_t k1 = 0; k1 < N1; ++k1)
-			out[(k1*i_N2*N2 + k2*i_N1*N1)%size] = in[k2*N1+k1];
+	std::lock_guard<std::mutex> lock(plan_cache_mutex);
+	return cache.try_emplace(key, std::move(node)).first->second;
 }
 
-void ifft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
-	if (size < 16) return idft(in, out, size);
-	if ((size & (size-1)) == 0) return bit_reverse_ifft(in, out, size);
+template <typename T>
+static std::shared_ptr<const FFT_Node<T>> get_node(std::size_t size, FFT_Direction direction) {
+	return find_or_create(plan_cache<T>, size, direction, [&] { return make_node<T>(size, direction); });
+}
 
-	std::size_t N1 = static_cast<std::size_t>(sqrt(size));
-	while (size%N1) --N1;
-	if (N1 == 1) return inverse_bluesteins_algorithm(in, out, size);
-	while (std::gcd(N1, size/N1) != 1) N1 *= std::gcd(N1, size/N1);
-	std::size_t N2 = size/N1;
-	if (N2 == 1) return mixed_radix_ifft(in, out, size);
+template <typename T>
+static std::shared_ptr<const Decimation_Node<T>> get_decimation_node(std::size_t size, FFT_Direction direction) {
+	return find_or_create(decimation_cache<T>, size, direction, [&] {
+		return std::make_shared<const Decimation_Node<T>>(size, direction);
+	});
+}
+
+template <typename T>
+static std::shared_ptr<const Real_FFT_Node<T>> get_real_node(std::size_t size, FFT_Direction direction) {
+	return find_or_create(real_plan_cache<T>, size, direction, [&] {
+		return std::make_shared<const Real_FFT_Node<T>>(size, direction);
+	});
+}
 
-	auto [i_N1, i_N2] = extended_euclid(N1, N2);
-	i_N1 = std::min(i_N1, N2+i_N1);
-	i_N2 = std::min(i_N2, N1+i_N2);
+void clear_fft_plan_cache() {
+	std::lock_guard<std::mutex> lock(plan_cache_mutex);
+	plan_cache<float>.clear();
+	plan_cache<double>.clear();
+	real_plan_cache<float>.clear();
+	real_plan_cache<double>.clear();
+	decimation_cache<float>.clear();
+	decimation_cache<double>.clear();
+}
 
-	for (std::size_t n1 = 0; n1 < N1; ++n1)
-		for (std::size_t n2 = 0; n2 < N2; ++n2)
-			out[n1*N2+n2] = in[(n1*N2 + n2*N1)%size];
+template <typename T>
+FFT_Plan<T>::FFT_Plan(std::size_t size, Direction direction)
+	: m_root(get_node<T>(size, direction)), m_size(size), m_direction(direction) {}
 
-	for (std::size_t n1 = 0; n1 < N1; ++n1)
-		ifft(out + n1*N2, in + n1*N2, N2);
+template <typename T>
+void FFT_Plan<T>::execute(std::complex<T>* in, std::complex<T>* out) const {
+	m_root->execute(in, out);
+	if (m_direction == Direction::forward) {
+		const T scale = T(1)/static_cast<T>(m_size);
+		parallel_for(m_size, 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) out[i] *= scale;
+		});
+	}
+}
 
-	for (std::size_t n1 = 0; n1 < N1; ++n1)
-		for (std::size_t n2 = 0; n2 < N2; ++n2)
-			out[n2*N1+n1] = in[n1*N2+n2];
+template <typename T>
+void FFT_Plan<T>::execute(std::complex<T>* data) const {
+	m_root->execute_in_place(data);
+	if (m_direction == Direction::forward) {
+		const T scale = T(1)/static_cast<T>(m_size);
+		parallel_for(m_size, 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) data[i] *= scale;
+		});
+	}
+}
 
-	for (std::size_t k2 = 0; k2 < N2; ++k2)
-		ifft(out+k2*N1, in+k2*N1, N1);
+// signals in batches are gathered in blocks of about this many bytes
+static constexpr std::size_t batch_block_bytes = std::size_t(1) << 18;
+
+/**
+ * Calls transform(a, b) for each of count signals, where a holds in_size elements of the
+ * input signal and b receives out_size elements of the output. Signal c of in starts at
+ * in + c*in_distance and its elements are in_stride apart, out is laid out the same way.
+ * Strided or overlapping signals are copied through buffers in blocks of signals, so
+ * interleaved channels are read and written one frame at a time. The blocks are split
+ * between the threads.
+ */
+template <typename In, typename Out, typename Transform>
+static void execute_batch(std::size_t count, std::size_t cost,
+                          In* in, std::size_t in_size, std::size_t in_stride, std::size_t in_distance,
+                          Out* out, std::size_t out_size, std::size_t out_stride, std::size_t out_distance,
+                          const Transform& transform) {
+	if (!count) return;
+	const auto end_of = [count](const void* data, std::size_t size, std::size_t stride, std::size_t distance, std::size_t element) {
+		return static_cast<const char*>(data) + ((count-1)*distance + (size-1)*stride + 1)*element;
+	};
+	const std::less<const void*> less;
+	const bool overlap = in_size && out_size
+		&& less(in, end_of(out, out_size, out_stride, out_distance, sizeof(Out)))
+		&& less(out, end_of(in, in_size, in_stride, in_distance, sizeof(In)));
+	const bool gather = in_stride != 1 || overlap;
+	const bool scatter = out_stride != 1 || overlap;
+
+	const std::size_t block = std::clamp<std::size_t>(
+		batch_block_bytes/std::max<std::size_t>(1, in_size*sizeof(In) + out_size*sizeof(Out)), 1, count);
+	const std::size_t blocks = (count+block-1)/block;
+	parallel_for(blocks, block*cost, [&](std::size_t begin, std::size_t end) {
+		std::vector<In> a(gather ? block*in_size : 0);
+		std::vector<Out> b(scatter ? block*out_size : 0);
+		for (std::size_t first = begin*block; first < std::min(count, end*block); first += block) {
+			const std::size_t signals = std::min(block, count-first);
+			if (gather) {
+				for (std::size_t i = 0; i < in_size; ++i)
+					for (std::size_t c = 0; c < signals; ++c)
+						a[c*in_size + i] = in[(first+c)*in_distance + i*in_stride];
+			}
+
+			for (std::size_t c = 0; c < signals; ++c) {
+				transform(gather ? a.data() + c*in_size : in + (first+c)*in_distance,
+				          scatter ? b.data() + c*out_size : out + (first+c)*out_distance);
+			}
+
+			if (scatter) {
+				for (std::size_t i = 0; i < out_size; ++i)
+					for (std::size_t c = 0; c < signals; ++c)
+						out[(first+c)*out_distance + i*out_stride] = b[c*out_size + i];
+			}
+		}
+	});
+}
+
+template <typename T>
+void FFT_Plan<T>::execute_batch(std::size_t count,
+                                std::complex<T>* in, std::size_t in_stride, std::size_t in_distance,
+                                std::complex<T>* out, std::size_t out_stride, std::size_t out_distance) const {
+	::execute_batch(count, transform_cost(m_size),
+	                in, m_size, in_stride, in_distance,
+	                out, m_size, out_stride, out_distance,
+	                [&](std::complex<T>* a, std::complex<T>* b) { execute(a, b); });
+}
+
+template <typename T>
+Real_FFT_Plan<T>::Real_FFT_Plan(std::size_t size, Direction direction)
+	: m_root(get_real_node<T>(size, direction)), m_size(size), m_direction(direction) {}
+
+template <typename T>
+void Real_FFT_Plan<T>::execute(T* in, std::complex<T>* out) const {
+	if (m_direction != Direction::forward)
+		throw std::logic_error("attempted to compute a forward transform with an inverse real fft plan");
+
+	if (m_size&1) {
+		std::vector<std::complex<T>> signal(in, in+m_size), spectrum(m_size);
+		m_root->complex_plan.execute(signal.data(), spectrum.data());
+		std::copy_n(spectrum.begin(), m_size/2+1, out);
+		return;
+	}
+
+	// out[0, size/2) = fft(in[2n] + i*in[2n+1])*2/size
+	m_root->complex_plan.execute(reinterpret_cast<std::complex<T>*>(in), out);
+
+	const std::size_t half = m_size/2;
+	const T one_half = 0.5;
+	out[half] = out[0];
+	parallel_for(half/2+1, 16, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t k = begin; k < end; ++k) {
+			const std::size_t j = half-k;
+			const std::complex<T> a = out[k], b = out[j];
+			const std::complex<T> even = one_half*(a + std::conj(b));
+			const std::complex<T> odd = std::complex<T>(0, -one_half)*(a - std::conj(b))*m_root->twiddles[k];
+			out[k] = one_half*(even + odd);
+			out[j] = one_half*std::conj(even - odd);
+		}
+	});
+}
+
+template <typename T>
+void Real_FFT_Plan<T>::execute(std::complex<T>* in, T* out) const {
+	if (m_direction != Direction::inverse)
+		throw std::logic_error("attempted to compute an inverse transform with a forward real fft plan");
+
+	if (m_size&1) {
+		std::vector<std::complex<T>> spectrum(m_size), signal(m_size);
+		std::copy_n(in, m_size/2+1, spectrum.begin());
+		for (std::size_t k = 1; k <= m_size/2; ++k) spectrum[m_size-k] = std::conj(in[k]);
+		spectrum[0].imag(0);
+		m_root->complex_plan.execute(spectrum.data(), signal.data());
+		for (std::size_t n = 0; n < m_size; ++n) out[n] = signal[n].real();
+		return;
+	}
+
+	// recombine the bins into the spectrum of in[2n] + i*in[2n+1], the
+	// imaginary parts of the dc and nyquist bins would leak into the output
+	const std::size_t half = m_size/2;
+	in[0].imag(0);
+	in[half].imag(0);
+	parallel_for(half/2+1, 16, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t k = begin; k < end; ++k) {
+			const std::size_t j = half-k;
+			const std::complex<T> a = in[k], b = in[j];
+			const std::complex<T> even = a + std::conj(b);
+			const std::complex<T> odd = std::complex<T>(0, 1)*(a - std::conj(b))*std::conj(m_root->twiddles[k]);
+			in[k] = even + odd;
+			if (k) in[j] = std::conj(even - odd);
+		}
+	});
+
+	m_root->complex_plan.execute(in, reinterpret_cast<std::complex<T>*>(out));
+}
+
+template <typename T>
+void Real_FFT_Plan<T>::execute_batch(std::size_t count,
+                                     T* in, std::size_t in_stride, std::size_t in_distance,
+                                     std::complex<T>* out, std::size_t out_stride, std::size_t out_distance) const {
+	::execute_batch(count, transform_cost(m_size),
+	                in, m_size, in_stride, in_distance,
+	                out, m_size/2+1, out_stride, out_distance,
+	                [&](T* a, std::complex<T>* b) { execute(a, b); });
+}
+
+template <typename T>
+void Real_FFT_Plan<T>::execute_batch(std::size_t count,
+                                     std::complex<T>* in, std::size_t in_stride, std::size_t in_distance,
+                                     T* out, std::size_t out_stride, std::size_t out_distance) const {
+	::execute_batch(count, transform_cost(m_size),
+	                in, m_size/2+1, in_stride, in_distance,
+	                out, m_size, out_stride, out_distance,
+	                [&](std::complex<T>* a, T* b) { execute(a, b); });
+}
+
+template class FFT_Plan<float>;
+template class FFT_Plan<double>;
+template class Real_FFT_Plan<float>;
+template class Real_FFT_Plan<double>;
+
+void fft(std::complex<float>* in, std::complex<float>* out, std::size_t size) {
+	FFT_Plan<float>(size, FFT_Direction::forward).execute(in, out);
+}
+
+void fft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
+	FFT_Plan<double>(size, FFT_Direction::forward).execute(in, out);
+}
+
+void ifft(std::complex<float>* in, std::complex<float>* out, std::size_t size) {
+	FFT_Plan<float>(size, FFT_Direction::inverse).execute(in, out);
+}
+
+void ifft(std::complex<double>* in, std::complex<double>* out, std::size_t size) {
+	FFT_Plan<double>(size, FFT_Direction::inverse).execute(in, out);
+}
+
+void rfft(float* in, std::complex<float>* out, std::size_t size) {
+	Real_FFT_Plan<float>(size, FFT_Direction::forward).execute(in, out);
+}
+
+void rfft(double* in, std::complex<double>* out, std::size_t size) {
+	Real_FFT_Plan<double>(size, FFT_Direction::forward).execute(in, out);
+}
+
+void irfft(std::complex<float>* in, float* out, std::size_t size) {
+	Real_FFT_Plan<float>(size, FFT_Direction::inverse).execute(in, out);
+}
 
-	for (std::size_t k2 = 0; k2 < N2; ++k2)
-		for (std::size_t k1 = 0; k1 < N1; ++k1)
-			out[(k1*i_N2*N2 + k2*i_N1*N1)%size] = in[k2*N1+k1];
+void irfft(std::complex<double>* in, double* out, std::size_t size) {
+	Real_FFT_Plan<double>(size, FFT_Direction::inverse).execute(in, out);
 }
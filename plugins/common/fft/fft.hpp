@@ -1,6 +1,18 @@
 #pragma once
 #include <cstddef>
 #include <complex>
+#include <functional>
+#include <memory>
+
+/**
+ * Scalar type used by the spectral plugins.
+ * Single precision is selected with the SINGLE_PRECISION_FFT build option.
+ */
+#ifdef SINGLE_PRECISION_FFT
+	using fft_scalar = float;
+#else
+	using fft_scalar = double;
+#endif
 
 // Separates the output of an fft with input l+ri into separate left and right channels
 void split_channels(std::complex<double>* in,
@@ -14,5 +26,140 @@ void join_channels(std::complex<double>* left,
                    std::complex<double>* out,
                    std::size_t size);
 
+enum class FFT_Direction {
+	forward,
+	inverse
+};
+
+template <typename T> struct FFT_Node;
+
+/**
+ * An FFT_Plan holds everything needed to transform signals of a given size
+ * and direction: the chosen factorisation, the twiddle factors and the index
+ * permutations. Plans are shared through a process wide cache, so constructing
+ * a plan for a size that has been seen before is cheap.
+ * A plan is immutable and may be executed from multiple threads at once.
+ * T is the scalar type of the signal, either float or double.
+ */
+template <typename T>
+class FFT_Plan {
+public:
+	using Direction = FFT_Direction;
+
+	FFT_Plan(std::size_t size, Direction direction);
+
+	/**
+	 * Transforms in and stores the result in out.
+	 * in is used as scratch space and its contents are undefined afterwards.
+	 * The forward transform is scaled by 1/size, the inverse is not scaled.
+	 */
+	void execute(std::complex<T>* in, std::complex<T>* out) const;
+
+	/**
+	 * Transforms data in place with the same scaling as the out of place transform.
+	 * Only a small amount of scratch space is used compared to the size of data,
+	 * except for sizes which use bluesteins algorithm.
+	 */
+	void execute(std::complex<T>* data) const;
+
+	/**
+	 * Transforms count signals with one call. Element i of signal c is read from
+	 * in[c*in_distance + i*in_stride] and its transform is written to
+	 * out[c*out_distance + i*out_stride], so interleaved channels have stride = channels and
+	 * distance = 1 while planar channels have stride = 1 and distance >= size.
+	 * The signals are spread over the threads. in is used as scratch space, in and out may be
+	 * the same array.
+	 */
+	void execute_batch(std::size_t count,
+	                   std::complex<T>* in, std::size_t in_stride, std::size_t in_distance,
+	                   std::complex<T>* out, std::size_t out_stride, std::size_t out_distance) const;
+
+	std::size_t size() const noexcept { return m_size; }
+	Direction direction() const noexcept { return m_direction; }
+
+private:
+	std::shared_ptr<const FFT_Node<T>> m_root;
+	std::size_t m_size;
+	Direction m_direction;
+};
+
+template <typename T> struct Real_FFT_Node;
+
+/**
+ * A plan for transforms between size real samples and the size/2+1 non redundant bins of
+ * their spectrum. Even sizes are computed with a complex transform of half the size.
+ * The scaling follows FFT_Plan: the forward transform is scaled by 1/size.
+ */
+template <typename T>
+class Real_FFT_Plan {
+public:
+	using Direction = FFT_Direction;
+
+	Real_FFT_Plan(std::size_t size, Direction direction);
+
+	/**
+	 * Forward transform of the size samples in in into the size/2+1 bins in out.
+	 * in is used as scratch space and its contents are undefined afterwards.
+	 */
+	void execute(T* in, std::complex<T>* out) const;
+
+	/**
+	 * Inverse transform of the size/2+1 bins in in into the size samples in out.
+	 * The imaginary parts of the dc and nyquist bins are ignored.
+	 * in is used as scratch space and its contents are undefined afterwards.
+	 */
+	void execute(std::complex<T>* in, T* out) const;
+
+	/**
+	 * Batched forward and inverse transforms, the layout of in and out follows
+	 * FFT_Plan::execute_batch with size samples and size/2+1 bins per signal
+	 */
+	void execute_batch(std::size_t count,
+	                   T* in, std::size_t in_stride, std::size_t in_distance,
+	                   std::complex<T>* out, std::size_t out_stride, std::size_t out_distance) const;
+	void execute_batch(std::size_t count,
+	                   std::complex<T>* in, std::size_t in_stride, std::size_t in_distance,
+	                   T* out, std::size_t out_stride, std::size_t out_distance) const;
+
+	std::size_t size() const noexcept { return m_size; }
+	Direction direction() const noexcept { return m_direction; }
+
+private:
+	std::shared_ptr<const Real_FFT_Node<T>> m_root;
+	std::size_t m_size;
+	Direction m_direction;
+};
+
+extern template class FFT_Plan<float>;
+extern template class FFT_Plan<double>;
+extern template class Real_FFT_Plan<float>;
+extern template class Real_FFT_Plan<double>;
+
+// Releases every cached plan which is not currently held by a plan object
+void clear_fft_plan_cache();
+
+/**
+ * Sets the number of threads used to execute large transforms, 0 uses one thread per core.
+ * The default is read from the FFT_THREADS environment variable.
+ */
+void set_fft_threads(std::size_t n_threads);
+std::size_t get_fft_threads();
+
+/**
+ * Calls task(begin, end) on disjoint ranges covering [0, count) using the fft threads.
+ * cost is roughly the number of operations per item, loops with too little work to be
+ * worth splitting and loops started from inside a task run on the calling thread.
+ */
+void fft_parallel_for(std::size_t count, std::size_t cost, const std::function<void(std::size_t, std::size_t)>& task);
+
+void fft(std::complex<float>* in, std::complex<float>* out, std::size_t size);
 void fft(std::complex<double>* in, std::complex<double>* out, std::size_t size);
+void ifft(std::complex<float>* in, std::complex<float>* out, std::size_t size);
 void ifft(std::complex<double>* in, std::complex<double>* out, std::size_t size);
+
+// Transforms size real samples into size/2+1 bins
+void rfft(float* in, std::complex<float>* out, std::size_t size);
+void rfft(double* in, std::complex<double>* out, std::size_t size);
+// Transforms size/2+1 bins into size real samples
+void irfft(std::complex<float>* in, float* out, std::size_t size);
+void irfft(std::complex<double>* in, double* out, std::size_t size);
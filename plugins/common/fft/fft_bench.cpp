@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include "fft.hpp"
+#include "fft_external.hpp"
+
+/**
+ * Benchmark and accuracy suite for the FFT library.
+ * Every size is checked for the round trip error of a forward and inverse transform and,
+ * for small sizes, the error against a direct dft in long double precision. The same checks
+ * are made for real transforms, in place transforms, batches of strided signals and out of
+ * core transforms with a memory budget smaller than the signal.
+ * The time per transform is reported in ns per point and in GFLOPs assuming 5*n*log2(n)
+ * operations per transform, as is customary for comparing FFT libraries.
+ *
+ * usage: fft_bench [--accuracy] [--double|--float] [size...]
+ *   --accuracy  skip the timings
+ *   size...     only test the given sizes
+ * The exit status is non zero if any error exceeds its tolerance.
+ */
+
+struct Size_Class {
+	const char* name;
+	std::vector<std::size_t> sizes;
+};
+
+static const std::vector<Size_Class> size_classes = {
+	{"power of 2", {2, 4, 8, 16, 64, 256, 1024, 4096, 16384, 65536, 1<<18, 1<<20}},
+	{"5-smooth", {6, 12, 15, 60, 100, 360, 1000, 3000, 6000, 48000, 96000, 1000000}},
+	{"7-smooth", {7, 14, 441, 2205, 44100, 88200}},
+	{"coprime", {1517, 5183, 255255, 1025024}},
+	{"prime", {17, 31, 97, 127, 1009, 4093, 10007, 65521}},
+	{"large prime", {131071, 999983, 1048573}}
+};
+
+// the reference dft is O(n^2) so it is only computed for small sizes
+static constexpr std::size_t max_reference_size = 4096;
+// the other interfaces are checked up to this size to keep the test suite quick
+static constexpr std::size_t max_variant_size = 1 << 18;
+// timed transforms are repeated for at least this long
+static constexpr double min_time = 0.05;
+
+template <typename T>
+static std::vector<std::complex<T>> random_signal(std::size_t size) {
+	std::mt19937 rng(static_cast<std::mt19937::result_type>(size));
+	std::uniform_real_distribution<T> distribution(-1, 1);
+	std::vector<std::complex<T>> signal(size);
+	for (auto& x : signal) x = {distribution(rng), distribution(rng)};
+	return signal;
+}
+
+template <typename T>
+static std::vector<T> random_real_signal(std::size_t size) {
+	const auto signal = random_signal<T>(size);
+	std::vector<T> real(size);
+	for (std::size_t n = 0; n < size; ++n) real[n] = signal[n].real();
+	return real;
+}
+
+// ||a - b|| / ||b||
+template <typename A, typename B>
+static double relative_error(const std::vector<A>& a, const std::vector<B>& b) {
+	long double error = 0, norm = 0;
+	for (std::size_t i = 0; i < a.size(); ++i) {
+		const std::complex<long double> x(a[i].real(), a[i].imag()), y(b[i].real(), b[i].imag());
+		error += std::norm(x - y);
+		norm += std::norm(y);
+	}
+	return norm > 0 ? static_cast<double>(std::sqrt(error/norm)) : 0.0;
+}
+
+// forward transform scaled by 1/size to match FFT_Plan
+template <typename T>
+static std::vector<std::complex<long double>> dft(const std::vector<std::complex<T>>& signal) {
+	const std::size_t size = signal.size();
+	std::vector<std::complex<long double>> roots(size), spectrum(size);
+	for (std::size_t n = 0; n < size; ++n)
+		roots[n] = std::polar(1.0L, -2.0L*static_cast<long double>(M_PI)*n/size);
+	for (std::size_t k = 0; k < size; ++k) {
+		std::complex<long double> sum = 0;
+		std::size_t index = 0; // n*k mod size
+		for (std::size_t n = 0; n < size; ++n) {
+			sum += std::complex<long double>(signal[n].real(), signal[n].imag())*roots[index];
+			index += k;
+			if (index >= size) index -= size;
+		}
+		spectrum[k] = sum/static_cast<long double>(size);
+	}
+	return spectrum;
+}
+
+// seconds per forward transform
+template <typename T>
+static double time_transform(const FFT_Plan<T>& plan, const std::vector<std::complex<T>>& signal) {
+	std::vector<std::complex<T>> in(signal.size()), out(signal.size());
+	std::size_t repetitions = 1;
+	for (;;) {
+		double copy_time = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < repetitions; ++i) {
+			const auto copy_start = std::chrono::steady_clock::now();
+			std::copy(signal.begin(), signal.end(), in.begin());
+			copy_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - copy_start).count();
+			plan.execute(in.data(), out.data());
+		}
+		const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (time >= min_time) return (time - copy_time)/static_cast<double>(repetitions);
+		repetitions *= 2;
+	}
+}
+
+/**
+ * Tolerance of the relative rms error, the error of a stable FFT grows with the
+ * square root of log2(size) but a linear bound leaves room for bluesteins algorithm
+ */
+template <typename T>
+static double tolerance(std::size_t size) {
+	return 4*std::numeric_limits<T>::epsilon()*std::max(1.0, std::log2(static_cast<double>(size)));
+}
+
+// prints a row of the table, reference_error is negative when there is no reference
+template <typename T>
+static bool report(const char* name, std::size_t size, double round_trip_error, double reference_error,
+                   const FFT_Plan<T>* timed = nullptr, const std::vector<std::complex<T>>* signal = nullptr) {
+	const bool ok = round_trip_error <= tolerance<T>(size) && reference_error <= tolerance<T>(size);
+
+	std::printf("%-6s %-12s %10zu", sizeof(T) == sizeof(float) ? "float" : "double", name, size);
+	if (timed) {
+		const double time = time_transform(*timed, *signal)*1e9;
+		const double flops = 5.0*static_cast<double>(size)*std::log2(static_cast<double>(size));
+		std::printf(" %10.2f %8.2f", time/static_cast<double>(size), flops/time);
+	}
+	std::printf(" %12.3e", round_trip_error);
+	if (reference_error >= 0) std::printf(" %12.3e", reference_error);
+	else std::printf(" %12s", "-");
+	std::printf("%s\n", ok ? "" : "  FAIL");
+	std::fflush(stdout);
+	return ok;
+}
+
+template <typename T>
+static bool run(const char* name, std::size_t size, bool timings) {
+	const auto signal = random_signal<T>(size);
+	const FFT_Plan<T> forward(size, FFT_Direction::forward), inverse(size, FFT_Direction::inverse);
+
+	std::vector<std::complex<T>> in = signal, spectrum(size), result(size);
+	forward.execute(in.data(), spectrum.data());
+	const double reference_error = size <= max_reference_size ? relative_error(spectrum, dft(signal)) : -1.0;
+	inverse.execute(spectrum.data(), result.data());
+	const double round_trip_error = relative_error(result, signal);
+
+	return report<T>(name, size, round_trip_error, reference_error, timings ? &forward : nullptr, &signal);
+}
+
+template <typename T>
+static bool run_real(std::size_t size) {
+	const auto signal = random_real_signal<T>(size);
+	const Real_FFT_Plan<T> forward(size, FFT_Direction::forward), inverse(size, FFT_Direction::inverse);
+
+	std::vector<T> in = signal, result(size);
+	std::vector<std::complex<T>> spectrum(size/2+1);
+	forward.execute(in.data(), spectrum.data());
+	double reference_error = -1.0;
+	if (size <= max_reference_size) {
+		auto reference = dft(std::vector<std::complex<T>>(signal.begin(), signal.end()));
+		reference.resize(size/2+1);
+		reference_error = relative_error(spectrum, reference);
+	}
+	// the imaginary parts of the dc and nyquist bins must not change the inverse
+	spectrum[0].imag(1);
+	if (size%2 == 0) spectrum[size/2].imag(1);
+	inverse.execute(spectrum.data(), result.data());
+
+	std::vector<std::complex<T>> complex_result(result.begin(), result.end());
+	return report<T>("real", size, relative_error(complex_result, std::vector<std::complex<T>>(signal.begin(), signal.end())),
+	                 reference_error);
+}
+
+template <typename T>
+static bool run_in_place(std::size_t size) {
+	const auto signal = random_signal<T>(size);
+	const FFT_Plan<T> forward(size, FFT_Direction::forward), inverse(size, FFT_Direction::inverse);
+
+	std::vector<std::complex<T>> data = signal;
+	forward.execute(data.data());
+	const double reference_error = size <= max_reference_size ? relative_error(data, dft(signal)) : -1.0;
+	inverse.execute(data.data());
+	return report<T>("in place", size, relative_error(data, signal), reference_error);
+}
+
+/**
+ * Transforms interleaved signals into planar spectra padded to size+1 and back
+ */
+template <typename T>
+static bool run_batch(std::size_t size) {
+	constexpr std::size_t count = 3;
+	const FFT_Plan<T> forward(size, FFT_Direction::forward), inverse(size, FFT_Direction::inverse);
+
+	std::vector<std::vector<std::complex<T>>> signals;
+	std::vector<std::complex<T>> interleaved(count*size), planar(count*(size+1));
+	for (std::size_t c = 0; c < count; ++c) {
+		signals.push_back(random_signal<T>(size+c));
+		signals.back().resize(size);
+		for (std::size_t n = 0; n < size; ++n) interleaved[n*count + c] = signals.back()[n];
+	}
+
+	forward.execute_batch(count, interleaved.data(), count, 1, planar.data(), 1, size+1);
+	double reference_error = -1.0;
+	if (size <= max_reference_size) {
+		for (std::size_t c = 0; c < count; ++c) {
+			const std::vector<std::complex<T>> spectrum(planar.begin() + c*(size+1), planar.begin() + c*(size+1) + size);
+			reference_error = std::max(reference_error, relative_error(spectrum, dft(signals[c])));
+		}
+	}
+
+	inverse.execute_batch(count, planar.data(), 1, size+1, interleaved.data(), count, 1);
+	double round_trip_error = 0;
+	for (std::size_t c = 0; c < count; ++c) {
+		std::vector<std::complex<T>> result(size);
+		for (std::size_t n = 0; n < size; ++n) result[n] = interleaved[n*count + c];
+		round_trip_error = std::max(round_trip_error, relative_error(result, signals[c]));
+	}
+	return report<T>("batch", size, round_trip_error, reference_error);
+}
+
+/**
+ * The budget only holds half of the signal and its transform, so the plan uses the two pass
+ * algorithm for sizes with a factorisation and bluesteins algorithm for primes
+ */
+template <typename T>
+static bool run_external(std::size_t size) {
+	const auto signal = random_signal<T>(size);
+	const std::size_t budget = size*sizeof(std::complex<T>);
+	const External_FFT_Plan<T> forward(size, FFT_Direction::forward, budget);
+	const External_FFT_Plan<T> inverse(size, FFT_Direction::inverse, budget);
+
+	std::vector<std::complex<T>> in = signal, spectrum(size), result(size);
+	forward.execute(in.data(), spectrum.data());
+	const double reference_error = size <= max_reference_size ? relative_error(spectrum, dft(signal)) : -1.0;
+	inverse.execute(spectrum.data(), result.data());
+	return report<T>("external", size, relative_error(result, signal), reference_error);
+}
+
+// the real, in place, batched and out of core transforms
+template <typename T>
+static std::size_t run_variants(std::size_t size) {
+	std::size_t failures = 0;
+	if (!run_real<T>(size)) ++failures;
+	if (!run_in_place<T>(size)) ++failures;
+	if (!run_batch<T>(size)) ++failures;
+	if (size >= 16 && !run_external<T>(size)) ++failures;
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	bool timings = true, doubles = true, floats = true;
+	std::vector<Size_Class> classes;
+	Size_Class selected = {"selected", {}};
+	for (int i = 1; i < argc; ++i) {
+		if (!std::strcmp(argv[i], "--accuracy")) timings = false;
+		else if (!std::strcmp(argv[i], "--double")) floats = false;
+		else if (!std::strcmp(argv[i], "--float")) doubles = false;
+		else if (argv[i][0] >= '0' && argv[i][0] <= '9') selected.sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+		else {
+			std::fprintf(stderr, "usage: %s [--accuracy] [--double|--float] [size...]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (selected.sizes.empty()) classes = size_classes;
+	else classes.push_back(selected);
+
+	std::printf("%-6s %-12s %10s", "type", "class", "size");
+	if (timings) std::printf(" %10s %8s", "ns/point", "GFLOPs");
+	std::printf(" %12s %12s\n", "round trip", "reference");
+
+	std::size_t failures = 0;
+	for (const Size_Class& size_class : classes) {
+		for (const std::size_t size : size_class.sizes) {
+			if (doubles && !run<double>(size_class.name, size, timings)) ++failures;
+			if (floats && !run<float>(size_class.name, size, timings)) ++failures;
+		}
+	}
+
+	// the other interfaces are only checked for their accuracy
+	for (const Size_Class& size_class : classes) {
+		for (const std::size_t size : size_class.sizes) {
+			if (size > max_variant_size) continue;
+			if (doubles) failures += run_variants<double>(size);
+			if (floats) failures += run_variants<float>(size);
+		}
+	}
+
+	if (failures) std::printf("%zu transforms exceeded the error tolerance\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+	#include <windows.h>
+#elif __APPLE__ || __linux__
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+#include "fft_external.hpp"
+#include "fft_internal.hpp"
+
+std::size_t fft_memory_budget() {
+	if (const char* budget = std::getenv("FFT_MEMORY_BUDGET"))
+		return std::strtoull(budget, nullptr, 10) << 20;
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		MEMORYSTATUSEX status;
+		status.dwLength = sizeof(status);
+		GlobalMemoryStatusEx(&status);
+		return static_cast<std::size_t>(status.ullTotalPhys/2);
+	#elif __APPLE__ || __linux__
+		return static_cast<std::size_t>(sysconf(_SC_PHYS_PAGES))*static_cast<std::size_t>(sysconf(_SC_PAGE_SIZE))/2;
+	#endif
+}
+
+static std::string scratch_directory() {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		for (const char* variable : {"FFT_SCRATCH_DIR", "TMP", "TEMP"})
+			if (const char* directory = std::getenv(variable); directory && *directory) return directory;
+		return ".";
+	#elif __APPLE__ || __linux__
+		for (const char* variable : {"FFT_SCRATCH_DIR", "TMPDIR"})
+			if (const char* directory = std::getenv(variable); directory && *directory) return directory;
+		return "/tmp";
+	#endif
+}
+
+Mapped_File::Mapped_File(std::size_t bytes) : m_size(bytes) {
+	if (!bytes) return;
+
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		char path[MAX_PATH];
+		if (!GetTempFileNameA(scratch_directory().c_str(), "fft", 0, path))
+			throw std::runtime_error("failed to create a scratch file in " + scratch_directory());
+		// the file is removed once the view and every handle to it are closed
+		const HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		                                FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			DeleteFileA(path);
+			throw std::runtime_error(std::string("failed to open the scratch file ") + path);
+		}
+
+		// extending the file through the mapping fills it with zeros
+		const unsigned long long size = bytes;
+		const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+		                                          static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+		if (mapping) m_data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+		// the view keeps its own reference to the mapping and the file
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		if (!m_data) throw std::runtime_error("failed to map a scratch file");
+	#elif __APPLE__ || __linux__
+		std::string path = scratch_directory() + "/fft_scratch_XXXXXX";
+		const int fd = mkstemp(path.data());
+		if (fd == -1)
+			throw std::runtime_error("failed to create a scratch file in " + scratch_directory() + ": " + std::strerror(errno));
+		// the file is removed once it is unmapped and closed
+		unlink(path.c_str());
+
+		if (ftruncate(fd, static_cast<off_t>(bytes)) == -1) {
+			const int error = errno;
+			close(fd);
+			throw std::runtime_error(std::string("failed to resize a scratch file: ") + std::strerror(error));
+		}
+
+		m_data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		const int error = errno;
+		close(fd);
+		if (m_data == MAP_FAILED) {
+			m_data = nullptr;
+			throw std::runtime_error(std::string("failed to map a scratch file: ") + std::strerror(error));
+		}
+	#endif
+}
+
+Mapped_File::~Mapped_File() {
+	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+		if (m_data) UnmapViewOfFile(m_data);
+	#elif __APPLE__ || __linux__
+		if (m_data) munmap(m_data, m_size);
+	#endif
+}
+
+Twiddle_Table::Twiddle_Table(std::size_t size, FFT_Direction direction) {
+	std::size_t log_size = 0;
+	while ((std::size_t(1) << log_size) < size) ++log_size;
+	m_low_bits = log_size/2;
+
+	const double step = (direction == FFT_Direction::forward ? -2.0 : 2.0)*M_PI/static_cast<double>(size);
+	m_low.resize(std::size_t(1) << m_low_bits);
+	for (std::size_t m = 0; m < m_low.size(); ++m)
+		m_low[m] = std::polar(1.0, step*static_cast<double>(m));
+	m_high.resize((size >> m_low_bits) + 1);
+	for (std::size_t m = 0; m < m_high.size(); ++m)
+		m_high[m] = std::polar(1.0, step*static_cast<double>(m << m_low_bits));
+}
+
+template <typename T>
+External_FFT_Plan<T>::External_FFT_Plan(std::size_t size, Direction direction, std::size_t memory_budget)
+	: m_size(size), m_direction(direction), m_memory_budget(memory_budget) {
+	constexpr std::size_t element = sizeof(std::complex<T>);
+	if (2*size*element <= memory_budget) {
+		m_in_core.emplace(size, direction);
+		return;
+	}
+
+	// the first pass holds at least one column of N2 elements and its transform, when that
+	// does not fit in the budget the columns are still used if they are not much longer than
+	// the rows as the padded transform of bluesteins algorithm would not do any better
+	std::size_t N1 = static_cast<std::size_t>(std::sqrt(static_cast<double>(size)));
+	while (size%N1) --N1;
+	if (N1 > 1 && (2*(size/N1)*element <= memory_budget || size/N1 <= 4*N1)) {
+		m_N1 = N1;
+		m_N2 = size/N1;
+		m_rows.emplace(m_N1, direction);
+		m_columns.emplace(m_N2, direction);
+		m_twiddles.emplace(size, direction);
+		return;
+	}
+
+	// the chirp exp(-+i*pi*n^2/size) is looked up from a table of the 2*size roots of unity
+	m_padded_size = 1;
+	while (m_padded_size < 2*size-1) m_padded_size <<= 1;
+	m_twiddles.emplace(2*size, direction);
+	m_padded_forward = std::make_unique<const External_FFT_Plan<T>>(m_padded_size, Direction::forward, memory_budget);
+	m_padded_inverse = std::make_unique<const External_FFT_Plan<T>>(m_padded_size, Direction::inverse, memory_budget);
+
+	// the spectrum of the chirp filter is the same for every signal, it is scaled by the
+	// padded size to undo the scaling of the forward transform
+	const std::size_t M = m_padded_size;
+	m_filter = std::make_unique<const Scratch_Buffer<std::complex<T>>>(M, memory_budget/3);
+	Scratch_Buffer<std::complex<T>> filter(M, memory_budget/3);
+	for (std::size_t n = 0; n < size; ++n) filter[n] = std::complex<T>(std::conj(chirp(n)));
+	for (std::size_t n = 1; n < size; ++n) filter[M-n] = filter[n];
+	m_padded_forward->execute(filter.data(), m_filter->data());
+	const T padded_size = static_cast<T>(M);
+	for (std::size_t k = 0; k < M; ++k) (*m_filter)[k] *= padded_size;
+}
+
+template <typename T>
+std::complex<double> External_FFT_Plan<T>::chirp(std::size_t n) const noexcept {
+	return (*m_twiddles)(mul_mod(n, n, 2*m_size));
+}
+
+template <typename T>
+void External_FFT_Plan<T>::execute(std::complex<T>* in, std::complex<T>* out) const {
+	if (m_in_core) m_in_core->execute(in, out);
+	else if (m_N1) execute_two_pass(in, out);
+	else execute_bluestein(in, out);
+}
+
+/**
+ * The signal is treated as N2 rows of N1 elements, x[n1 + N1*n2]. The first pass transforms
+ * the columns, applies the twiddle factors exp(-+2*pi*i*n1*k2/size) and writes them back in
+ * place. The second pass transforms the rows and scatters X[k2 + N2*k1] into out.
+ * The plans scale the forward transforms by 1/N2 and 1/N1, so the result is scaled by 1/size.
+ * The columns and rows of each block are split between the fft threads.
+ */
+template <typename T>
+void External_FFT_Plan<T>::execute_two_pass(std::complex<T>* in, std::complex<T>* out) const {
+	constexpr std::size_t element = sizeof(std::complex<T>);
+	const std::size_t N1 = m_N1, N2 = m_N2;
+	const std::size_t block_columns = std::clamp<std::size_t>(m_memory_budget/(2*N2*element), 1, N1);
+	const std::size_t block_rows = std::clamp<std::size_t>(m_memory_budget/(2*N1*element), 1, N2);
+
+	std::vector<std::complex<T>> block(std::max(block_columns*N2, block_rows*N1));
+	std::vector<std::complex<T>> transformed(block.size());
+
+	for (std::size_t first = 0; first < N1; first += block_columns) {
+		const std::size_t columns = std::min(block_columns, N1-first);
+		fft_parallel_for(columns, transform_cost(N2), [&](std::size_t begin, std::size_t end) {
+			for (std::size_t n2 = 0; n2 < N2; ++n2) {
+				const std::complex<T>* row = in + n2*N1 + first;
+				for (std::size_t column = begin; column < end; ++column)
+					block[column*N2 + n2] = row[column];
+			}
+
+			for (std::size_t column = begin; column < end; ++column)
+				m_columns->execute(block.data() + column*N2, transformed.data() + column*N2);
+
+			for (std::size_t k2 = 0; k2 < N2; ++k2) {
+				std::complex<T>* row = in + k2*N1 + first;
+				for (std::size_t column = begin; column < end; ++column)
+					row[column] = std::complex<T>(std::complex<double>(transformed[column*N2 + k2])
+					                              *(*m_twiddles)((first+column)*k2));
+			}
+		});
+	}
+
+	for (std::size_t first = 0; first < N2; first += block_rows) {
+		const std::size_t rows = std::min(block_rows, N2-first);
+		fft_parallel_for(rows, transform_cost(N1), [&](std::size_t begin, std::size_t end) {
+			std::copy_n(in + (first+begin)*N1, (end-begin)*N1, block.data() + begin*N1);
+			for (std::size_t row = begin; row < end; ++row)
+				m_rows->execute(block.data() + row*N1, transformed.data() + row*N1);
+		});
+
+		// each run written to out is contiguous
+		fft_parallel_for(N1, 2*rows, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t k1 = begin; k1 < end; ++k1) {
+				std::complex<T>* run = out + k1*N2 + first;
+				for (std::size_t row = 0; row < rows; ++row)
+					run[row] = transformed[row*N1 + k1];
+			}
+		});
+	}
+}
+
+/**
+ * Bluestein's algorithm with the padded signal and a scratch buffer stored in Mapped_Files
+ * when they do not fit in the memory budget, the filter spectrum is computed by the constructor
+ */
+template <typename T>
+void External_FFT_Plan<T>::execute_bluestein(std::complex<T>* in, std::complex<T>* out) const {
+	const std::size_t M = m_padded_size;
+	Scratch_Buffer<std::complex<T>> a(M, m_memory_budget/3), scratch(M, m_memory_budget/3);
+	fft_parallel_for(m_size, 16, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t n = begin; n < end; ++n)
+			a[n] = std::complex<T>(std::complex<double>(in[n])*chirp(n));
+	});
+
+	// scratch = fft(a)*fft(b), a = ifft(scratch)
+	m_padded_forward->execute(a.data(), scratch.data());
+	const Scratch_Buffer<std::complex<T>>& filter = *m_filter;
+	fft_parallel_for(M, 8, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t k = begin; k < end; ++k) scratch[k] *= filter[k];
+	});
+	m_padded_inverse->execute(scratch.data(), a.data());
+
+	const double scale = m_direction == Direction::forward ? 1.0/static_cast<double>(m_size) : 1.0;
+	fft_parallel_for(m_size, 16, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t k = begin; k < end; ++k)
+			out[k] = std::complex<T>(chirp(k)*std::complex<double>(a[k])*scale);
+	});
+}
+
+template <typename T>
+External_Real_FFT_Plan<T>::External_Real_FFT_Plan(std::size_t size, Direction direction, std::size_t memory_budget)
+	: m_size(size), m_direction(direction), m_memory_budget(memory_budget) {
+	if (size*sizeof(std::complex<T>) <= memory_budget) {
+		m_in_core.emplace(size, direction);
+		return;
+	}
+
+	m_complex_plan.emplace(size&1 ? size : size/2, direction, memory_budget);
+	if (!(size&1)) m_twiddles.emplace(size, FFT_Direction::forward);
+}
+
+template <typename T>
+void External_Real_FFT_Plan<T>::execute(T* in, std::complex<T>* out) const {
+	if (m_direction != Direction::forward)
+		throw std::logic_error("attempted to compute a forward transform with an inverse real fft plan");
+	if (m_in_core) return m_in_core->execute(in, out);
+
+	if (m_size&1) {
+		Scratch_Buffer<std::complex<T>> signal(m_size, m_memory_budget/2), spectrum(m_size, m_memory_budget/2);
+		std::copy_n(in, m_size, signal.data());
+		m_complex_plan->execute(signal.data(), spectrum.data());
+		std::copy_n(spectrum.data(), m_size/2+1, out);
+		return;
+	}
+
+	// same as Real_FFT_Plan, the bins are read in pairs from both ends of out
+	m_complex_plan->execute(reinterpret_cast<std::complex<T>*>(in), out);
+
+	const std::size_t half = m_size/2;
+	const T one_half = 0.5;
+	out[half] = out[0];
+	for (std::size_t k = 0; k <= half/2; ++k) {
+		const std::size_t j = half-k;
+		const std::complex<T> a = out[k], b = out[j];
+		const std::complex<T> even = one_half*(a + std::conj(b));
+		const std::complex<T> odd = std::complex<T>(0, -one_half)*(a - std::conj(b))*std::complex<T>((*m_twiddles)(k));
+		out[k] = one_half*(even + odd);
+		out[j] = one_half*std::conj(even - odd);
+	}
+}
+
+template <typename T>
+void External_Real_FFT_Plan<T>::execute(std::complex<T>* in, T* out) const {
+	if (m_direction != Direction::inverse)
+		throw std::logic_error("attempted to compute an inverse transform with a forward real fft plan");
+	if (m_in_core) return m_in_core->execute(in, out);
+
+	if (m_size&1) {
+		Scratch_Buffer<std::complex<T>> spectrum(m_size, m_memory_budget/2), signal(m_size, m_memory_budget/2);
+		std::copy_n(in, m_size/2+1, spectrum.data());
+		for (std::size_t k = 1; k <= m_size/2; ++k) spectrum[m_size-k] = std::conj(in[k]);
+		spectrum[0].imag(0);
+		m_complex_plan->execute(spectrum.data(), signal.data());
+		for (std::size_t n = 0; n < m_size; ++n) out[n] = signal[n].real();
+		return;
+	}
+
+	const std::size_t half = m_size/2;
+	in[0].imag(0);
+	in[half].imag(0);
+	for (std::size_t k = 0; k <= half/2; ++k) {
+		const std::size_t j = half-k;
+		const std::complex<T> a = in[k], b = in[j];
+		const std::complex<T> even = a + std::conj(b);
+		const std::complex<T> odd = std::complex<T>(0, 1)*(a - std::conj(b))*std::conj(std::complex<T>((*m_twiddles)(k)));
+		in[k] = even + odd;
+		if (k) in[j] = std::conj(even - odd);
+	}
+
+	m_complex_plan->execute(in, reinterpret_cast<std::complex<T>*>(out));
+}
+
+template class External_FFT_Plan<float>;
+template class External_FFT_Plan<double>;
+template class External_Real_FFT_Plan<float>;
+template class External_Real_FFT_Plan<double>;
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstddef>
+#include <complex>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "fft.hpp"
+
+/**
+ * Out of core transforms for signals which do not fit in memory.
+ * Large buffers are kept in memory mapped scratch files so that the kernel can write them back
+ * to disk instead of running out of memory, and the transforms only hold blocks of the signal
+ * within a memory budget. The scratch files are created in FFT_SCRATCH_DIR, TMPDIR or /tmp.
+ */
+
+/**
+ * The default memory budget in bytes. It is read from the FFT_MEMORY_BUDGET environment
+ * variable in megabytes, or is half of the physical memory if it is not set.
+ */
+std::size_t fft_memory_budget();
+
+/**
+ * A zero initialised scratch file mapped into memory, the file is deleted when it is created
+ * so it does not outlive the process
+ */
+class Mapped_File {
+public:
+	explicit Mapped_File(std::size_t bytes);
+	Mapped_File(const Mapped_File& other) = delete;
+
+	~Mapped_File();
+
+	Mapped_File& operator=(const Mapped_File& other) = delete;
+
+	void* data() const noexcept { return m_data; }
+	std::size_t size() const noexcept { return m_size; }
+
+private:
+	void* m_data = nullptr;
+	std::size_t m_size;
+};
+
+/**
+ * A zero initialised array which is stored in a Mapped_File when it takes more than
+ * in_memory_limit bytes and on the heap otherwise
+ */
+template <typename T>
+class Scratch_Buffer {
+public:
+	Scratch_Buffer(std::size_t size, std::size_t in_memory_limit) : m_size(size) {
+		if (size*sizeof(T) > in_memory_limit) {
+			m_file = std::make_unique<Mapped_File>(size*sizeof(T));
+			m_data = static_cast<T*>(m_file->data());
+		} else {
+			m_memory = std::make_unique<T[]>(size);
+			m_data = m_memory.get();
+		}
+	}
+
+	T* data() const noexcept { return m_data; }
+	std::size_t size() const noexcept { return m_size; }
+	bool file_backed() const noexcept { return m_file != nullptr; }
+
+	T& operator[](std::size_t i) const noexcept { return m_data[i]; }
+
+private:
+	std::unique_ptr<Mapped_File> m_file;
+	std::unique_ptr<T[]> m_memory;
+	T* m_data;
+	std::size_t m_size;
+};
+
+/**
+ * exp(-+2*pi*i*m/size) for 0 <= m < size computed from two tables of O(sqrt(size)) entries
+ */
+class Twiddle_Table {
+public:
+	Twiddle_Table(std::size_t size, FFT_Direction direction);
+
+	std::complex<double> operator()(std::size_t m) const noexcept {
+		return m_high[m >> m_low_bits]*m_low[m & (m_low.size()-1)];
+	}
+
+private:
+	std::size_t m_low_bits;
+	std::vector<std::complex<double>> m_low;
+	std::vector<std::complex<double>> m_high;
+};
+
+/**
+ * A plan with the same interface as FFT_Plan for signals larger than memory_budget.
+ * Transforms which fit in the budget are computed in memory. Larger transforms are split into
+ * size = N1*N2 and computed in two passes, the first transforms blocks of columns of length N2
+ * and the second blocks of rows of length N1, so that in and out are only read and written in
+ * long contiguous runs and can be stored in Mapped_Files. Sizes without a suitable factorisation
+ * use bluesteins algorithm over scratch files, the spectrum of its chirp filter is computed once
+ * by the constructor. Both are split between the fft threads.
+ */
+template <typename T>
+class External_FFT_Plan {
+public:
+	using Direction = FFT_Direction;
+
+	External_FFT_Plan(std::size_t size, Direction direction, std::size_t memory_budget = fft_memory_budget());
+
+	/**
+	 * Transforms in and stores the result in out, in is used as scratch space.
+	 * The forward transform is scaled by 1/size, the inverse is not scaled.
+	 */
+	void execute(std::complex<T>* in, std::complex<T>* out) const;
+
+	std::size_t size() const noexcept { return m_size; }
+	Direction direction() const noexcept { return m_direction; }
+
+	// true if the transform is computed in memory
+	bool in_core() const noexcept { return m_in_core.has_value(); }
+
+private:
+	void execute_two_pass(std::complex<T>* in, std::complex<T>* out) const;
+	void execute_bluestein(std::complex<T>* in, std::complex<T>* out) const;
+
+	// exp(-+i*pi*n^2/size)
+	std::complex<double> chirp(std::size_t n) const noexcept;
+
+	std::size_t m_size;
+	Direction m_direction;
+	std::size_t m_memory_budget;
+
+	std::optional<FFT_Plan<T>> m_in_core;
+
+	// two pass transforms
+	std::size_t m_N1 = 0, m_N2 = 0;
+	std::optional<FFT_Plan<T>> m_rows, m_columns;
+	std::optional<Twiddle_Table> m_twiddles;
+
+	// bluestein transforms
+	std::size_t m_padded_size = 0;
+	std::unique_ptr<const External_FFT_Plan<T>> m_padded_forward, m_padded_inverse;
+	// fft of the chirp filter scaled by the padded size
+	std::unique_ptr<const Scratch_Buffer<std::complex<T>>> m_filter;
+};
+
+/**
+ * A plan with the same interface as Real_FFT_Plan for signals larger than memory_budget
+ */
+template <typename T>
+class External_Real_FFT_Plan {
+public:
+	using Direction = FFT_Direction;
+
+	External_Real_FFT_Plan(std::size_t size, Direction direction, std::size_t memory_budget = fft_memory_budget());
+
+	// Forward transform of the size samples in in into the size/2+1 bins in out
+	void execute(T* in, std::complex<T>* out) const;
+
+	// Inverse transform of the size/2+1 bins in in into the size samples in out
+	void execute(std::complex<T>* in, T* out) const;
+
+	std::size_t size() const noexcept { return m_size; }
+	Direction direction() const noexcept { return m_direction; }
+
+private:
+	std::size_t m_size;
+	Direction m_direction;
+	std::size_t m_memory_budget;
+
+	std::optional<Real_FFT_Plan<T>> m_in_core;
+	// size/2 for even sizes, size for odd sizes
+	std::optional<External_FFT_Plan<T>> m_complex_plan;
+	std::optional<Twiddle_Table> m_twiddles;
+};
+
+extern template class External_FFT_Plan<float>;
+extern template class External_FFT_Plan<double>;
+extern template class External_Real_FFT_Plan<float>;
+extern template class External_Real_FFT_Plan<double>;
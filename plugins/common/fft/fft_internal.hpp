@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Helpers shared by the in memory and out of core transforms, not part of the public interface
+ */
+
+// (a*b) % m without overflow
+inline std::size_t mul_mod(std::size_t a, std::size_t b, std::size_t m) {
+	return static_cast<std::size_t>(static_cast<unsigned __int128>(a)*b % m);
+}
+
+/**
+ * Approximate number of operations in a transform of the given size
+ */
+inline std::size_t transform_cost(std::size_t size) {
+	std::size_t log_size = 1;
+	while ((std::size_t(1) << log_size) < size) ++log_size;
+	return 5*size*log_size;
+}
@@ -0,0 +1,41 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include "fft_kernels_impl.hpp"
+
+const FFT_Kernel_Set scalar_fft_kernels = {
+	"scalar",
+	make_fft_kernels<Scalar<float>, Scalar<float>>(),
+	make_fft_kernels<Scalar<double>, Scalar<double>>()
+};
+
+static const FFT_Kernel_Set& select_fft_kernel_set() {
+	#if defined(__x86_64__) || defined(__i386__)
+		const FFT_Kernel_Set* available[] = {&avx512_fft_kernels, &avx2_fft_kernels, &sse2_fft_kernels, &scalar_fft_kernels};
+		const bool supported[] = {
+			__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma"),
+			__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"),
+			__builtin_cpu_supports("sse2") != 0,
+			true
+		};
+	#else
+		const FFT_Kernel_Set* available[] = {&scalar_fft_kernels};
+		const bool supported[] = {true};
+	#endif
+	constexpr std::size_t count = sizeof(available)/sizeof(available[0]);
+
+	if (const char* forced = std::getenv("FFT_KERNELS")) {
+		for (std::size_t i = 0; i < count; ++i)
+			if (supported[i] && std::strcmp(forced, available[i]->name) == 0) return *available[i];
+	}
+
+	for (std::size_t i = 0; i < count; ++i)
+		if (supported[i]) return *available[i];
+	return scalar_fft_kernels;
+}
+
+const FFT_Kernel_Set& fft_kernel_set() {
+	static const FFT_Kernel_Set& kernel_set = select_fft_kernel_set();
+	return kernel_set;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * Butterfly kernels for power of 2 transforms of split real and imaginary arrays.
+ * The kernels are compiled once for each supported instruction set and the best
+ * set supported by the cpu is selected at runtime.
+ *
+ * The radix 4 passes each combine two radix 2 stages. A pass with a given quarter
+ * transforms blocks of 4*quarter elements and reads its twiddles from
+ * {re(w^j)..., im(w^j)..., re(w^2j)..., im(w^2j)...} for 0 <= j < quarter
+ * where w = exp(-+2*pi*i/(4*quarter)) depending on the direction.
+ * Only the butterflies with begin <= j < end are computed so that a pass can be
+ * split between threads, begin and end should be multiples of 16 unless they are 0 or quarter.
+ */
+template <typename T>
+struct FFT_Kernels {
+	/**
+	 * Decimation in time pass, requires the input of the first pass to be in bit reversed order
+	 * inverse selects the sign of the rotation by i and must match the direction of the twiddles
+	 */
+	void (*dit_radix_4_pass)(T* re, T* im, const T* twiddles, std::size_t size, std::size_t quarter,
+	                         std::size_t begin, std::size_t end, bool inverse);
+
+	/**
+	 * Decimation in frequency pass, the output of the last pass is in bit reversed order
+	 */
+	void (*dif_radix_4_pass)(T* re, T* im, const T* twiddles, std::size_t size, std::size_t quarter,
+	                         std::size_t begin, std::size_t end, bool inverse);
+
+	// radix 2 pass over adjacent pairs, used when log2(size) is odd
+	void (*radix_2_pass)(T* re, T* im, std::size_t size);
+
+	/**
+	 * Stockham autosort pass from x to y, both in natural order. The signal is treated as stride
+	 * interleaved transforms of length n = size/stride and each pass splits them into 4 of length n/4:
+	 * y[q + stride*(4p + r)] = w^(r*p) * sum_j x[q + stride*(p + j*n/4)]*exp(-+2*pi*i*j*r/4)
+	 * for 0 <= p < n/4 and 0 <= q < stride where w = exp(-+2*pi*i/n). The twiddles are
+	 * {re(w^p)..., im(w^p)..., re(w^2p)..., im(w^2p)..., re(w^3p)..., im(w^3p)...}.
+	 * x and y may only be the same array in the last pass, when n == 4.
+	 */
+	void (*stockham_radix_4_pass)(const T* x_re, const T* x_im, T* y_re, T* y_im, const T* twiddles,
+	                              std::size_t size, std::size_t stride, bool inverse);
+
+	// last stockham pass when log2(size) is odd, n == 2 and stride == size/2, may be in place
+	void (*stockham_radix_2_pass)(const T* x_re, const T* x_im, T* y_re, T* y_im, std::size_t size);
+
+	// (re + i*im) *= (b_re + i*b_im) element wise
+	void (*multiply)(T* re, T* im, const T* b_re, const T* b_im, std::size_t size);
+
+	// (re + i*im) += (a_re + i*a_im)*(b_re + i*b_im) element wise
+	void (*multiply_add)(T* re, T* im, const T* a_re, const T* a_im, const T* b_re, const T* b_im, std::size_t size);
+};
+
+// The kernels compiled for one instruction set
+struct FFT_Kernel_Set {
+	const char* name;
+	FFT_Kernels<float> single_precision;
+	FFT_Kernels<double> double_precision;
+};
+
+extern const FFT_Kernel_Set scalar_fft_kernels;
+#if defined(__x86_64__) || defined(__i386__)
+extern const FFT_Kernel_Set sse2_fft_kernels;
+extern const FFT_Kernel_Set avx2_fft_kernels;
+extern const FFT_Kernel_Set avx512_fft_kernels;
+#endif
+
+/**
+ * Returns the fastest kernels supported by the cpu.
+ * The FFT_KERNELS environment variable can be set to scalar, sse2, avx2 or avx512
+ * to force a specific set.
+ */
+const FFT_Kernel_Set& fft_kernel_set();
+
+template <typename T>
+const FFT_Kernels<T>& fft_kernels() {
+	if constexpr (std::is_same_v<T, float>) return fft_kernel_set().single_precision;
+	else return fft_kernel_set().double_precision;
+}
@@ -0,0 +1,51 @@
+#include <immintrin.h>
+
+#include <cstddef>
+
+#include "fft_kernels_impl.hpp"
+
+namespace {
+
+struct Double_Vector {
+	using scalar = double;
+	using type = __m256d;
+	static constexpr std::size_t width = 4;
+	static type load(const double* p) { return _mm256_loadu_pd(p); }
+	static void store(double* p, type v) { _mm256_storeu_pd(p, v); }
+	static type broadcast(double x) { return _mm256_set1_pd(x); }
+};
+
+struct Narrow_Double_Vector {
+	using scalar = double;
+	using type = __m128d;
+	static constexpr std::size_t width = 2;
+	static type load(const double* p) { return _mm_loadu_pd(p); }
+	static void store(double* p, type v) { _mm_storeu_pd(p, v); }
+	static type broadcast(double x) { return _mm_set1_pd(x); }
+};
+
+struct Float_Vector {
+	using scalar = float;
+	using type = __m256;
+	static constexpr std::size_t width = 8;
+	static type load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, type v) { _mm256_storeu_ps(p, v); }
+	static type broadcast(float x) { return _mm256_set1_ps(x); }
+};
+
+struct Narrow_Float_Vector {
+	using scalar = float;
+	using type = __m128;
+	static constexpr std::size_t width = 4;
+	static type load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, type v) { _mm_storeu_ps(p, v); }
+	static type broadcast(float x) { return _mm_set1_ps(x); }
+};
+
+}
+
+const FFT_Kernel_Set avx2_fft_kernels = {
+	"avx2",
+	make_fft_kernels<Float_Vector, Narrow_Float_Vector>(),
+	make_fft_kernels<Double_Vector, Narrow_Double_Vector>()
+};
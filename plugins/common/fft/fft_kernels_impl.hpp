@@ -0,0 +1,389 @@
+/**
+ * Generic implementation of the kernels declared in fft_kernels.hpp.
+ * This file is included by each fft_kernels_*.cpp file which then instantiates the kernels
+ * with the vector types of its instruction set. Everything is in an anonymous namespace so
+ * that instantiations compiled for different instruction sets are never merged by the linker.
+ *
+ * A vector type provides:
+ *   scalar                   the element type, float or double
+ *   type                     the vector of scalars, supporting +, - and *
+ *   width                    the number of scalars in type
+ *   load(const scalar*)      unaligned load
+ *   store(scalar*, type)     unaligned store
+ *   broadcast(scalar)        a vector with every element set to the scalar
+ */
+#include <algorithm>
+#include <cstddef>
+
+#include "fft_kernels.hpp"
+
+namespace {
+
+template <typename T>
+struct Scalar {
+	using scalar = T;
+	using type = T;
+	static constexpr std::size_t width = 1;
+	static type load(const T* p) { return *p; }
+	static void store(T* p, type v) { *p = v; }
+	static type broadcast(T x) { return x; }
+};
+
+template <typename V, bool inverse>
+void dit_pass(typename V::scalar* re, typename V::scalar* im, const typename V::scalar* twiddles,
+        std::size_t size, std::size_t quarter, std::size_t begin, std::size_t end) {
+	using S = typename V::scalar;
+	using T = typename V::type;
+	const S* w1_re = twiddles;
+	const S* w1_im = twiddles + quarter;
+	const S* w2_re = twiddles + 2*quarter;
+	const S* w2_im = twiddles + 3*quarter;
+
+	for (std::size_t k = 0; k < size; k += 4*quarter) {
+		S* const r0 = re+k; S* const r1 = r0+quarter; S* const r2 = r1+quarter; S* const r3 = r2+quarter;
+		S* const i0 = im+k; S* const i1 = i0+quarter; S* const i2 = i1+quarter; S* const i3 = i2+quarter;
+		for (std::size_t j = begin; j < end; j += V::width) {
+			const T wr1 = V::load(w1_re+j), wi1 = V::load(w1_im+j);
+			const T wr2 = V::load(w2_re+j), wi2 = V::load(w2_im+j);
+
+			const T x0r = V::load(r0+j), x0i = V::load(i0+j);
+			const T x1r = V::load(r1+j), x1i = V::load(i1+j);
+			const T x2r = V::load(r2+j), x2i = V::load(i2+j);
+			const T x3r = V::load(r3+j), x3i = V::load(i3+j);
+
+			// first radix 2 stage, span 2*quarter
+			const T t1r = x1r*wr2 - x1i*wi2, t1i = x1r*wi2 + x1i*wr2;
+			const T t3r = x3r*wr2 - x3i*wi2, t3i = x3r*wi2 + x3i*wr2;
+			const T b0r = x0r + t1r, b0i = x0i + t1i;
+			const T b1r = x0r - t1r, b1i = x0i - t1i;
+			const T b2r = x2r + t3r, b2i = x2i + t3i;
+			const T b3r = x2r - t3r, b3i = x2i - t3i;
+
+			// second radix 2 stage, span 4*quarter
+			const T ur = b2r*wr1 - b2i*wi1, ui = b2r*wi1 + b2i*wr1;
+			const T vr = b3r*wr1 - b3i*wi1, vi = b3r*wi1 + b3i*wr1;
+			V::store(r0+j, b0r + ur); V::store(i0+j, b0i + ui);
+			V::store(r2+j, b0r - ur); V::store(i2+j, b0i - ui);
+			if constexpr (inverse) {
+				// b1 +- i*v
+				V::store(r1+j, b1r - vi); V::store(i1+j, b1i + vr);
+				V::store(r3+j, b1r + vi); V::store(i3+j, b1i - vr);
+			} else {
+				// b1 -+ i*v
+				V::store(r1+j, b1r + vi); V::store(i1+j, b1i - vr);
+				V::store(r3+j, b1r - vi); V::store(i3+j, b1i + vr);
+			}
+		}
+	}
+}
+
+template <typename V, bool inverse>
+void dif_pass(typename V::scalar* re, typename V::scalar* im, const typename V::scalar* twiddles,
+        std::size_t size, std::size_t quarter, std::size_t begin, std::size_t end) {
+	using S = typename V::scalar;
+	using T = typename V::type;
+	const S* w1_re = twiddles;
+	const S* w1_im = twiddles + quarter;
+	const S* w2_re = twiddles + 2*quarter;
+	const S* w2_im = twiddles + 3*quarter;
+
+	for (std::size_t k = 0; k < size; k += 4*quarter) {
+		S* const r0 = re+k; S* const r1 = r0+quarter; S* const r2 = r1+quarter; S* const r3 = r2+quarter;
+		S* const i0 = im+k; S* const i1 = i0+quarter; S* const i2 = i1+quarter; S* const i3 = i2+quarter;
+		for (std::size_t j = begin; j < end; j += V::width) {
+			const T wr1 = V::load(w1_re+j), wi1 = V::load(w1_im+j);
+			const T wr2 = V::load(w2_re+j), wi2 = V::load(w2_im+j);
+
+			const T x0r = V::load(r0+j), x0i = V::load(i0+j);
+			const T x1r = V::load(r1+j), x1i = V::load(i1+j);
+			const T x2r = V::load(r2+j), x2i = V::load(i2+j);
+			const T x3r = V::load(r3+j), x3i = V::load(i3+j);
+
+			// first radix 2 stage, span 4*quarter
+			const T b0r = x0r + x2r, b0i = x0i + x2i;
+			const T b1r = x1r + x3r, b1i = x1i + x3i;
+			const T d0r = x0r - x2r, d0i = x0i - x2i;
+			// (x1 - x3) rotated by -+i
+			const T d1r = inverse ? x3i - x1i : x1i - x3i;
+			const T d1i = inverse ? x1r - x3r : x3r - x1r;
+			const T b2r = d0r*wr1 - d0i*wi1, b2i = d0r*wi1 + d0i*wr1;
+			const T b3r = d1r*wr1 - d1i*wi1, b3i = d1r*wi1 + d1i*wr1;
+
+			// second radix 2 stage, span 2*quarter
+			const T e0r = b0r - b1r, e0i = b0i - b1i;
+			const T e1r = b2r - b3r, e1i = b2i - b3i;
+			V::store(r0+j, b0r + b1r); V::store(i0+j, b0i + b1i);
+			V::store(r1+j, e0r*wr2 - e0i*wi2); V::store(i1+j, e0r*wi2 + e0i*wr2);
+			V::store(r2+j, b2r + b3r); V::store(i2+j, b2i + b3i);
+			V::store(r3+j, e1r*wr2 - e1i*wi2); V::store(i3+j, e1r*wi2 + e1i*wr2);
+		}
+	}
+}
+
+template <typename V>
+bool fits(std::size_t quarter, std::size_t begin, std::size_t end) {
+	return quarter%V::width == 0 && begin%V::width == 0 && end%V::width == 0;
+}
+
+// picks the widest vector which fits in the range of butterflies
+template <typename V, typename Narrow, bool inverse>
+void dit_radix_4_pass(typename V::scalar* re, typename V::scalar* im, const typename V::scalar* twiddles,
+                      std::size_t size, std::size_t quarter, std::size_t begin, std::size_t end) {
+	using S = Scalar<typename V::scalar>;
+	if (fits<V>(quarter, begin, end)) dit_pass<V, inverse>(re, im, twiddles, size, quarter, begin, end);
+	else if (fits<Narrow>(quarter, begin, end)) dit_pass<Narrow, inverse>(re, im, twiddles, size, quarter, begin, end);
+	else dit_pass<S, inverse>(re, im, twiddles, size, quarter, begin, end);
+}
+
+template <typename V, typename Narrow, bool inverse>
+void dif_radix_4_pass(typename V::scalar* re, typename V::scalar* im, const typename V::scalar* twiddles,
+                      std::size_t size, std::size_t quarter, std::size_t begin, std::size_t end) {
+	using S = Scalar<typename V::scalar>;
+	if (fits<V>(quarter, begin, end)) dif_pass<V, inverse>(re, im, twiddles, size, quarter, begin, end);
+	else if (fits<Narrow>(quarter, begin, end)) dif_pass<Narrow, inverse>(re, im, twiddles, size, quarter, begin, end);
+	else dif_pass<S, inverse>(re, im, twiddles, size, quarter, begin, end);
+}
+
+template <typename V, typename Narrow>
+void dit_radix_4(typename V::scalar* re, typename V::scalar* im, const typename V::scalar* twiddles,
+                 std::size_t size, std::size_t quarter, std::size_t begin, std::size_t end, bool inverse) {
+	if (inverse) dit_radix_4_pass<V, Narrow, true>(re, im, twiddles, size, quarter, begin, end);
+	else dit_radix_4_pass<V, Narrow, false>(re, im, twiddles, size, quarter, begin, end);
+}
+
+template <typename V, typename Narrow>
+void dif_radix_4(typename V::scalar* re, typename V::scalar* im, const typename V::scalar* twiddles,
+                 std::size_t size, std::size_t quarter, std::size_t begin, std::size_t end, bool inverse) {
+	if (inverse) dif_radix_4_pass<V, Narrow, true>(re, im, twiddles, size, quarter, begin, end);
+	else dif_radix_4_pass<V, Narrow, false>(re, im, twiddles, size, quarter, begin, end);
+}
+
+/**
+ * One radix 4 butterfly of the stockham pass:
+ * y0 = x0+x1+x2+x3, y1 = (x0 -+ i*x1 - x2 +- i*x3)*w1, y2 = (x0-x1+x2-x3)*w2, y3 = (x0 +- i*x1 - x2 -+ i*x3)*w3
+ */
+template <typename V, bool inverse>
+struct Stockham_Butterfly {
+	using T = typename V::type;
+	T y0r, y0i, y1r, y1i, y2r, y2i, y3r, y3i;
+
+	Stockham_Butterfly(T x0r, T x0i, T x1r, T x1i, T x2r, T x2i, T x3r, T x3i,
+	                   T wr1, T wi1, T wr2, T wi2, T wr3, T wi3) {
+		const T t0r = x0r + x2r, t0i = x0i + x2i;
+		const T t1r = x0r - x2r, t1i = x0i - x2i;
+		const T t2r = x1r + x3r, t2i = x1i + x3i;
+		// (x1 - x3) rotated by -+i
+		const T t3r = inverse ? x3i - x1i : x1i - x3i;
+		const T t3i = inverse ? x1r - x3r : x3r - x1r;
+
+		const T a1r = t1r + t3r, a1i = t1i + t3i;
+		const T a2r = t0r - t2r, a2i = t0i - t2i;
+		const T a3r = t1r - t3r, a3i = t1i - t3i;
+		y0r = t0r + t2r; y0i = t0i + t2i;
+		y1r = a1r*wr1 - a1i*wi1; y1i = a1r*wi1 + a1i*wr1;
+		y2r = a2r*wr2 - a2i*wi2; y2i = a2r*wi2 + a2i*wr2;
+		y3r = a3r*wr3 - a3i*wi3; y3i = a3r*wi3 + a3i*wr3;
+	}
+};
+
+/**
+ * Stockham pass vectorised over q, requires stride to be a multiple of the width.
+ * Every butterfly reads and writes the same positions when size == 4*stride, so the last
+ * pass may be computed in place.
+ */
+template <typename V, bool inverse>
+void stockham_pass_over_q(const typename V::scalar* x_re, const typename V::scalar* x_im,
+                          typename V::scalar* y_re, typename V::scalar* y_im,
+                          const typename V::scalar* twiddles, std::size_t size, std::size_t stride) {
+	using S = typename V::scalar;
+	const std::size_t m = size/(4*stride);
+	const std::size_t leg = stride*m;
+	for (std::size_t p = 0; p < m; ++p) {
+		const auto wr1 = V::broadcast(twiddles[p]), wi1 = V::broadcast(twiddles[m+p]);
+		const auto wr2 = V::broadcast(twiddles[2*m+p]), wi2 = V::broadcast(twiddles[3*m+p]);
+		const auto wr3 = V::broadcast(twiddles[4*m+p]), wi3 = V::broadcast(twiddles[5*m+p]);
+
+		const S* const a_re = x_re + stride*p;
+		const S* const a_im = x_im + stride*p;
+		S* const b_re = y_re + 4*stride*p;
+		S* const b_im = y_im + 4*stride*p;
+		for (std::size_t q = 0; q < stride; q += V::width) {
+			const Stockham_Butterfly<V, inverse> y(
+				V::load(a_re+q), V::load(a_im+q), V::load(a_re+leg+q), V::load(a_im+leg+q),
+				V::load(a_re+2*leg+q), V::load(a_im+2*leg+q), V::load(a_re+3*leg+q), V::load(a_im+3*leg+q),
+				wr1, wi1, wr2, wi2, wr3, wi3
+			);
+			V::store(b_re+q, y.y0r); V::store(b_im+q, y.y0i);
+			V::store(b_re+stride+q, y.y1r); V::store(b_im+stride+q, y.y1i);
+			V::store(b_re+2*stride+q, y.y2r); V::store(b_im+2*stride+q, y.y2i);
+			V::store(b_re+3*stride+q, y.y3r); V::store(b_im+3*stride+q, y.y3i);
+		}
+	}
+}
+
+/**
+ * Stockham pass for strides smaller than the width, vectorised over t = q + stride*p.
+ * The inputs are contiguous in t, the twiddles and outputs are gathered and scattered through
+ * small buffers. Requires size/4 to be a multiple of the width.
+ */
+template <typename V, bool inverse, std::size_t stride>
+void stockham_pass_over_t(const typename V::scalar* x_re, const typename V::scalar* x_im,
+                          typename V::scalar* y_re, typename V::scalar* y_im,
+                          const typename V::scalar* twiddles, std::size_t size) {
+	using S = typename V::scalar;
+	using T = typename V::type;
+	constexpr std::size_t W = V::width;
+	constexpr std::size_t p_per_chunk = W/stride;
+	const std::size_t m = size/(4*stride);
+	const std::size_t leg = size/4;
+	S w[6][W], y[8][W];
+	for (std::size_t t = 0, p = 0; t < leg; t += W, p += p_per_chunk) {
+		T wr1, wi1, wr2, wi2, wr3, wi3;
+		if constexpr (stride == 1) {
+			wr1 = V::load(twiddles+p); wi1 = V::load(twiddles+m+p);
+			wr2 = V::load(twiddles+2*m+p); wi2 = V::load(twiddles+3*m+p);
+			wr3 = V::load(twiddles+4*m+p); wi3 = V::load(twiddles+5*m+p);
+		} else {
+			for (std::size_t i = 0; i < 6; ++i)
+				for (std::size_t j = 0; j < p_per_chunk; ++j)
+					for (std::size_t q = 0; q < stride; ++q)
+						w[i][j*stride + q] = twiddles[i*m + p + j];
+			wr1 = V::load(w[0]); wi1 = V::load(w[1]);
+			wr2 = V::load(w[2]); wi2 = V::load(w[3]);
+			wr3 = V::load(w[4]); wi3 = V::load(w[5]);
+		}
+
+		const Stockham_Butterfly<V, inverse> b(
+			V::load(x_re+t), V::load(x_im+t), V::load(x_re+leg+t), V::load(x_im+leg+t),
+			V::load(x_re+2*leg+t), V::load(x_im+2*leg+t), V::load(x_re+3*leg+t), V::load(x_im+3*leg+t),
+			wr1, wi1, wr2, wi2, wr3, wi3
+		);
+		V::store(y[0], b.y0r); V::store(y[1], b.y0i);
+		V::store(y[2], b.y1r); V::store(y[3], b.y1i);
+		V::store(y[4], b.y2r); V::store(y[5], b.y2i);
+		V::store(y[6], b.y3r); V::store(y[7], b.y3i);
+
+		// y[q + stride*(4p + r)], the outputs of the chunk are contiguous from 4*t
+		S* const out_re = y_re + 4*t;
+		S* const out_im = y_im + 4*t;
+		for (std::size_t j = 0; j < p_per_chunk; ++j)
+			for (std::size_t r = 0; r < 4; ++r)
+				for (std::size_t q = 0; q < stride; ++q) {
+					out_re[(4*j + r)*stride + q] = y[2*r][j*stride + q];
+					out_im[(4*j + r)*stride + q] = y[2*r+1][j*stride + q];
+				}
+	}
+}
+
+template <typename V, bool inverse>
+bool try_stockham_pass_over_t(const typename V::scalar* x_re, const typename V::scalar* x_im,
+                              typename V::scalar* y_re, typename V::scalar* y_im,
+                              const typename V::scalar* twiddles, std::size_t size, std::size_t stride) {
+	if ((size/4)%V::width != 0) return false;
+	if (stride == 1) stockham_pass_over_t<V, inverse, 1>(x_re, x_im, y_re, y_im, twiddles, size);
+	else if (stride == 4 && V::width%4 == 0) stockham_pass_over_t<V, inverse, 4>(x_re, x_im, y_re, y_im, twiddles, size);
+	else return false;
+	return true;
+}
+
+template <typename V, typename Narrow, bool inverse>
+void stockham_radix_4_pass(const typename V::scalar* x_re, const typename V::scalar* x_im,
+                           typename V::scalar* y_re, typename V::scalar* y_im,
+                           const typename V::scalar* twiddles, std::size_t size, std::size_t stride) {
+	using S = Scalar<typename V::scalar>;
+	if (stride%V::width == 0) stockham_pass_over_q<V, inverse>(x_re, x_im, y_re, y_im, twiddles, size, stride);
+	else if (stride%Narrow::width == 0) stockham_pass_over_q<Narrow, inverse>(x_re, x_im, y_re, y_im, twiddles, size, stride);
+	else if (!try_stockham_pass_over_t<V, inverse>(x_re, x_im, y_re, y_im, twiddles, size, stride)
+	         && !try_stockham_pass_over_t<Narrow, inverse>(x_re, x_im, y_re, y_im, twiddles, size, stride))
+		stockham_pass_over_q<S, inverse>(x_re, x_im, y_re, y_im, twiddles, size, stride);
+}
+
+template <typename V, typename Narrow>
+void stockham_radix_4(const typename V::scalar* x_re, const typename V::scalar* x_im,
+                      typename V::scalar* y_re, typename V::scalar* y_im,
+                      const typename V::scalar* twiddles, std::size_t size, std::size_t stride, bool inverse) {
+	if (inverse) stockham_radix_4_pass<V, Narrow, true>(x_re, x_im, y_re, y_im, twiddles, size, stride);
+	else stockham_radix_4_pass<V, Narrow, false>(x_re, x_im, y_re, y_im, twiddles, size, stride);
+}
+
+template <typename V>
+void stockham_radix_2(const typename V::scalar* x_re, const typename V::scalar* x_im,
+                      typename V::scalar* y_re, typename V::scalar* y_im, std::size_t size) {
+	using S = typename V::scalar;
+	const std::size_t half = size/2;
+	std::size_t q = 0;
+	for (; q + V::width <= half; q += V::width) {
+		const auto ar = V::load(x_re+q), ai = V::load(x_im+q);
+		const auto br = V::load(x_re+half+q), bi = V::load(x_im+half+q);
+		V::store(y_re+q, ar + br); V::store(y_im+q, ai + bi);
+		V::store(y_re+half+q, ar - br); V::store(y_im+half+q, ai - bi);
+	}
+	for (; q < half; ++q) {
+		const S ar = x_re[q], ai = x_im[q];
+		const S br = x_re[half+q], bi = x_im[half+q];
+		y_re[q] = ar + br; y_im[q] = ai + bi;
+		y_re[half+q] = ar - br; y_im[half+q] = ai - bi;
+	}
+}
+
+template <typename S>
+void radix_2(S* re, S* im, std::size_t size) {
+	for (std::size_t k = 0; k < size; k += 2) {
+		const S ar = re[k], ai = im[k];
+		const S br = re[k+1], bi = im[k+1];
+		re[k] = ar + br; im[k] = ai + bi;
+		re[k+1] = ar - br; im[k+1] = ai - bi;
+	}
+}
+
+template <typename V>
+void multiply(typename V::scalar* re, typename V::scalar* im,
+              const typename V::scalar* b_re, const typename V::scalar* b_im, std::size_t size) {
+	using S = typename V::scalar;
+	using T = typename V::type;
+	std::size_t i = 0;
+	for (; i + V::width <= size; i += V::width) {
+		const T ar = V::load(re+i), ai = V::load(im+i);
+		const T br = V::load(b_re+i), bi = V::load(b_im+i);
+		V::store(re+i, ar*br - ai*bi);
+		V::store(im+i, ar*bi + ai*br);
+	}
+	for (; i < size; ++i) {
+		const S ar = re[i], ai = im[i];
+		re[i] = ar*b_re[i] - ai*b_im[i];
+		im[i] = ar*b_im[i] + ai*b_re[i];
+	}
+}
+
+template <typename V>
+void multiply_add(typename V::scalar* re, typename V::scalar* im,
+                  const typename V::scalar* a_re, const typename V::scalar* a_im,
+                  const typename V::scalar* b_re, const typename V::scalar* b_im, std::size_t size) {
+	using T = typename V::type;
+	std::size_t i = 0;
+	for (; i + V::width <= size; i += V::width) {
+		const T ar = V::load(a_re+i), ai = V::load(a_im+i);
+		const T br = V::load(b_re+i), bi = V::load(b_im+i);
+		V::store(re+i, V::load(re+i) + (ar*br - ai*bi));
+		V::store(im+i, V::load(im+i) + (ar*bi + ai*br));
+	}
+	for (; i < size; ++i) {
+		re[i] += a_re[i]*b_re[i] - a_im[i]*b_im[i];
+		im[i] += a_re[i]*b_im[i] + a_im[i]*b_re[i];
+	}
+}
+
+template <typename V, typename Narrow>
+constexpr FFT_Kernels<typename V::scalar> make_fft_kernels() {
+	return {
+		&dit_radix_4<V, Narrow>,
+		&dif_radix_4<V, Narrow>,
+		&radix_2<typename V::scalar>,
+		&stockham_radix_4<V, Narrow>,
+		&stockham_radix_2<V>,
+		&multiply<V>,
+		&multiply_add<V>
+	};
+}
+
+}
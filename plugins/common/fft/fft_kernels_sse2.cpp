@@ -0,0 +1,37 @@
+#include <emmintrin.h>
+
+#include <cstddef>
+
+#include "fft_kernels_impl.hpp"
+
+namespace {
+
+struct Double_Vector {
+	using scalar = double;
+	using type = __m128d;
+	static constexpr std::size_t width = 2;
+	static type load(const double* p) { return _mm_loadu_pd(p); }
+	static void store(double* p, type v) { _mm_storeu_pd(p, v); }
+	static type broadcast(double x) { return _mm_set1_pd(x); }
+};
+
+using Narrow_Double_Vector = Double_Vector;
+
+struct Float_Vector {
+	using scalar = float;
+	using type = __m128;
+	static constexpr std::size_t width = 4;
+	static type load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, type v) { _mm_storeu_ps(p, v); }
+	static type broadcast(float x) { return _mm_set1_ps(x); }
+};
+
+using Narrow_Float_Vector = Float_Vector;
+
+}
+
+const FFT_Kernel_Set sse2_fft_kernels = {
+	"sse2",
+	make_fft_kernels<Float_Vector, Narrow_Float_Vector>(),
+	make_fft_kernels<Double_Vector, Narrow_Double_Vector>()
+};
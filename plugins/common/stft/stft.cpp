@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "stft.hpp"
+
+// the frames of a block and their spectra take about this many bytes
+static constexpr std::size_t block_bytes = std::size_t(1) << 22;
+
+template <typename T>
+std::vector<T> make_window(Window_Type type, std::size_t size) {
+	std::vector<T> window(size);
+	for (std::size_t n = 0; n < size; ++n) {
+		const double x = 2.0*M_PI*static_cast<double>(n)/static_cast<double>(size);
+		switch (type) {
+			case Window_Type::rectangular:
+				window[n] = 1;
+				break;
+			case Window_Type::hann:
+				window[n] = static_cast<T>(0.5 - 0.5*std::cos(x));
+				break;
+			case Window_Type::hamming:
+				window[n] = static_cast<T>(0.54 - 0.46*std::cos(x));
+				break;
+			case Window_Type::blackman:
+				window[n] = static_cast<T>(0.42 - 0.5*std::cos(x) + 0.08*std::cos(2*x));
+				break;
+		}
+	}
+	return window;
+}
+
+template std::vector<float> make_window<float>(Window_Type type, std::size_t size);
+template std::vector<double> make_window<double>(Window_Type type, std::size_t size);
+
+template <typename T>
+STFT<T>::STFT(std::size_t frame_size, std::size_t hop_size, Window_Type window)
+	: m_frame_size(frame_size),
+	  m_hop_size(hop_size),
+	  m_analysis_window(make_window<T>(window, frame_size)),
+	  m_synthesis_window(frame_size),
+	  m_forward(frame_size, FFT_Direction::forward),
+	  m_inverse(frame_size, FFT_Direction::inverse) {
+	if (hop_size == 0 || hop_size > frame_size)
+		throw std::invalid_argument("the stft hop size must be between 1 and the frame size");
+
+	// every sample is covered by the frames whose windows are at positions i + k*hop_size,
+	// a sample where they are all zero is lost so such windows can not be inverted
+	std::vector<double> overlap(hop_size);
+	for (std::size_t i = 0; i < frame_size; ++i)
+		overlap[i%hop_size] += static_cast<double>(m_analysis_window[i])*m_analysis_window[i];
+	const double largest = *std::max_element(overlap.begin(), overlap.end());
+	if (*std::min_element(overlap.begin(), overlap.end()) <= 1e-6*largest)
+		throw std::invalid_argument("the stft window does not cover every sample with this hop size, use a smaller hop size");
+	for (std::size_t i = 0; i < frame_size; ++i)
+		m_synthesis_window[i] = static_cast<T>(m_analysis_window[i]/overlap[i%hop_size]);
+}
+
+template <typename T>
+std::size_t STFT<T>::frames(std::size_t n_samples) const noexcept {
+	return n_samples ? (n_samples - 1 + offset())/m_hop_size + 1 : 0;
+}
+
+template <typename T>
+void STFT<T>::forward(const float* samples, std::size_t n_samples, std::size_t frame, std::complex<T>* spectrum) const {
+	static thread_local std::vector<T> windowed;
+	windowed.resize(m_frame_size);
+	const std::ptrdiff_t start = static_cast<std::ptrdiff_t>(frame*m_hop_size) - static_cast<std::ptrdiff_t>(offset());
+	for (std::size_t i = 0; i < m_frame_size; ++i) {
+		const std::ptrdiff_t n = start + static_cast<std::ptrdiff_t>(i);
+		windowed[i] = n >= 0 && n < static_cast<std::ptrdiff_t>(n_samples) ? m_analysis_window[i]*samples[n] : T(0);
+	}
+	m_forward.execute(windowed.data(), spectrum);
+}
+
+template <typename T>
+void STFT<T>::inverse(std::complex<T>* spectrum, T* out) const {
+	m_inverse.execute(spectrum, out);
+	for (std::size_t i = 0; i < m_frame_size; ++i) out[i] *= m_synthesis_window[i];
+}
+
+template <typename T>
+void STFT<T>::process(const float* in, float* out, std::size_t n_samples, const Frame_Callback& process_frame) const {
+	const std::size_t n_frames = frames(n_samples);
+	const std::size_t frame_bytes = m_frame_size*sizeof(T) + bins()*sizeof(std::complex<T>);
+	const std::size_t block_frames = std::clamp<std::size_t>(block_bytes/frame_bytes, 1, std::max<std::size_t>(n_frames, 1));
+
+	std::vector<std::complex<T>> spectra(block_frames*bins());
+	std::vector<T> outputs(block_frames*m_frame_size);
+	// overlap added output from the start of the current block, the samples before the start
+	// of the next block are complete and no later frame reads them from in
+	std::vector<T> pending(block_frames*m_hop_size + m_frame_size);
+
+	const std::ptrdiff_t size = static_cast<std::ptrdiff_t>(n_samples);
+	const std::size_t cost = 10*m_frame_size*static_cast<std::size_t>(std::log2(m_frame_size+1));
+	for (std::size_t first = 0; first < n_frames; first += block_frames) {
+		const std::size_t count = std::min(block_frames, n_frames-first);
+		fft_parallel_for(count, cost, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i) {
+				std::complex<T>* spectrum = spectra.data() + i*bins();
+				forward(in, n_samples, first+i, spectrum);
+				process_frame(first+i, spectrum);
+				inverse(spectrum, outputs.data() + i*m_frame_size);
+			}
+		});
+
+		for (std::size_t i = 0; i < count; ++i) {
+			const T* frame = outputs.data() + i*m_frame_size;
+			T* to = pending.data() + i*m_hop_size;
+			for (std::size_t j = 0; j < m_frame_size; ++j) to[j] += frame[j];
+		}
+
+		// pending[0] is sample first*hop_size - offset()
+		const std::ptrdiff_t base = static_cast<std::ptrdiff_t>(first*m_hop_size) - static_cast<std::ptrdiff_t>(offset());
+		const std::size_t complete = first+count == n_frames ? pending.size() : count*m_hop_size;
+		for (std::size_t i = 0; i < complete; ++i) {
+			const std::ptrdiff_t n = base + static_cast<std::ptrdiff_t>(i);
+			if (n >= 0 && n < size) out[n] = static_cast<float>(pending[i]);
+		}
+		std::copy(pending.begin() + complete, pending.end(), pending.begin());
+		std::fill(pending.end() - complete, pending.end(), T(0));
+	}
+}
+
+template class STFT<float>;
+template class STFT<double>;
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <complex>
+#include <functional>
+#include <vector>
+#include "fft.hpp"
+
+enum class Window_Type {
+	rectangular,
+	hann,
+	hamming,
+	blackman
+};
+
+// Periodic window of the given size, so that shifted copies overlap evenly
+template <typename T>
+std::vector<T> make_window(Window_Type type, std::size_t size);
+
+/**
+ * A short time fourier transform which splits a signal into overlapping windowed frames.
+ * Frame f covers the samples [f*hop_size - offset(), f*hop_size - offset() + frame_size),
+ * samples outside the signal are zero. offset() = frame_size - hop_size, so every sample
+ * is covered by the same number of frames.
+ * The inverse transform windows each frame again and overlap adds them, normalised by the
+ * sum of the squared windows over the frames so that unmodified spectra reconstruct the
+ * signal exactly (weighted overlap add).
+ * Requires 0 < hop_size <= frame_size and that the squared windows overlapping at hop_size
+ * have no zeros, the hann and blackman windows are zero at their first sample so they need
+ * hop_size < frame_size. The constructor throws std::invalid_argument otherwise.
+ */
+template <typename T>
+class STFT {
+public:
+	/**
+	 * Called with the index of a frame and its frame_size/2+1 bins, which may be modified
+	 * in place. Frames are processed in parallel so the callback may be called from several
+	 * threads at once, but never twice for the same frame.
+	 */
+	using Frame_Callback = std::function<void(std::size_t frame, std::complex<T>* spectrum)>;
+
+	STFT(std::size_t frame_size, std::size_t hop_size, Window_Type window = Window_Type::hann);
+
+	std::size_t frame_size() const noexcept { return m_frame_size; }
+	std::size_t hop_size() const noexcept { return m_hop_size; }
+	std::size_t bins() const noexcept { return m_frame_size/2+1; }
+	std::size_t offset() const noexcept { return m_frame_size - m_hop_size; }
+
+	// the number of frames which cover n_samples samples
+	std::size_t frames(std::size_t n_samples) const noexcept;
+
+	// Windows frame of samples and transforms it into bins() bins in spectrum using a per thread buffer
+	void forward(const float* samples, std::size_t n_samples, std::size_t frame, std::complex<T>* spectrum) const;
+
+	/**
+	 * Transforms bins() bins in spectrum, which is used as scratch space, into frame_size samples
+	 * in out with the synthesis window applied. Adding the output of every frame at its position
+	 * reconstructs the signal.
+	 */
+	void inverse(std::complex<T>* spectrum, T* out) const;
+
+	/**
+	 * Passes every frame of in through process_frame and writes the overlap added result to out.
+	 * Frames are transformed in blocks of bounded size, the frames of a block are processed in
+	 * parallel and added to out in order, so memory use does not grow with n_samples.
+	 * in and out may be the same array.
+	 */
+	void process(const float* in, float* out, std::size_t n_samples, const Frame_Callback& process_frame) const;
+
+private:
+	std::size_t m_frame_size;
+	std::size_t m_hop_size;
+	std::vector<T> m_analysis_window;
+	// the window divided by the sum of the squared windows of the overlapping frames
+	std::vector<T> m_synthesis_window;
+	Real_FFT_Plan<T> m_forward;
+	Real_FFT_Plan<T> m_inverse;
+};
+
+extern template class STFT<float>;
+extern template class STFT<double>;
@@ -0,0 +1,79 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "stft.hpp"
+
+/**
+ * Round trip checks of the stft. Every window is passed through an unmodified process()
+ * with hop sizes that divide the frame size and ones that do not, and the window and hop
+ * pairs whose overlap has zeros must be rejected by the constructor.
+ * The exit status is non zero if any check fails.
+ */
+
+struct Window {
+	const char* name;
+	Window_Type type;
+	// whether hop_size == frame_size can be inverted
+	bool hop_of_frame_size;
+};
+
+static const Window windows[] = {
+	{"rectangular", Window_Type::rectangular, true},
+	{"hann", Window_Type::hann, false},
+	{"hamming", Window_Type::hamming, true},
+	{"blackman", Window_Type::blackman, false}
+};
+
+static std::vector<float> random_signal(std::size_t size) {
+	std::mt19937 rng(static_cast<std::mt19937::result_type>(size));
+	std::uniform_real_distribution<float> distribution(-1, 1);
+	std::vector<float> signal(size);
+	for (float& x : signal) x = distribution(rng);
+	return signal;
+}
+
+// largest absolute error of an unmodified round trip, out of place and in place
+static double round_trip_error(const STFT<fft_scalar>& stft, const std::vector<float>& signal) {
+	std::vector<float> out(signal.size()), in_place = signal;
+	const auto unmodified = [](std::size_t, std::complex<fft_scalar>*) {};
+	stft.process(signal.data(), out.data(), signal.size(), unmodified);
+	stft.process(in_place.data(), in_place.data(), in_place.size(), unmodified);
+
+	double error = 0;
+	for (std::size_t i = 0; i < signal.size(); ++i) {
+		error = std::max(error, static_cast<double>(std::abs(out[i] - signal[i])));
+		error = std::max(error, static_cast<double>(std::abs(in_place[i] - signal[i])));
+	}
+	return error;
+}
+
+int main() {
+	// the output is stored as floats
+	const double tolerance = 1e-5;
+	std::size_t failures = 0;
+
+	for (const std::size_t frame_size : {std::size_t(1024), std::size_t(1000), std::size_t(255)}) {
+		const std::vector<float> signal = random_signal(37*frame_size + 11);
+		for (const Window& window : windows) {
+			for (const std::size_t hop_size : {frame_size/8, frame_size/4, frame_size/3, frame_size/2, frame_size}) {
+				const bool valid = hop_size < frame_size || window.hop_of_frame_size;
+				std::printf("%-12s %6zu %6zu", window.name, frame_size, hop_size);
+				try {
+					const STFT<fft_scalar> stft(frame_size, hop_size, window.type);
+					const double error = round_trip_error(stft, signal);
+					const bool ok = valid && error <= tolerance;
+					std::printf(" %12.3e%s\n", error, ok ? "" : "  FAIL");
+					if (!ok) ++failures;
+				} catch (const std::invalid_argument&) {
+					std::printf(" %12s%s\n", "rejected", valid ? "  FAIL" : "");
+					if (valid) ++failures;
+				}
+			}
+		}
+	}
+
+	if (failures) std::printf("%zu stft checks failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "thread_pool.hpp"
+
+struct Thread_Pool::Job {
+	const std::function<void(std::size_t, std::size_t)>* task;
+	std::size_t count;
+	std::size_t grain;
+	std::size_t n_chunks;
+
+	std::atomic<std::size_t> next_chunk = 0;
+	std::atomic<std::size_t> completed_chunks = 0;
+
+	std::mutex mutex;
+	std::condition_variable done;
+	std::exception_ptr exception;
+};
+
+static thread_local bool running_task = false;
+
+Thread_Pool::Thread_Pool(std::size_t n_threads) {
+	if (n_threads == 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	m_workers.reserve(n_threads-1);
+	for (std::size_t i = 1; i < n_threads; ++i)
+		m_workers.emplace_back(&Thread_Pool::worker_loop, this);
+}
+
+Thread_Pool::~Thread_Pool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_job_available.notify_all();
+	for (auto& worker : m_workers) worker.join();
+}
+
+bool Thread_Pool::in_task() noexcept { return running_task; }
+
+void Thread_Pool::run_chunks(Job& job) {
+	const bool was_running = running_task;
+	running_task = true;
+
+	std::size_t chunk;
+	while ((chunk = job.next_chunk.fetch_add(1)) < job.n_chunks) {
+		const std::size_t begin = chunk*job.grain;
+		const std::size_t end = std::min(job.count, begin+job.grain);
+		try {
+			(*job.task)(begin, end);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(job.mutex);
+			if (!job.exception) job.exception = std::current_exception();
+		}
+
+		if (job.completed_chunks.fetch_add(1)+1 == job.n_chunks) {
+			std::lock_guard<std::mutex> lock(job.mutex);
+			job.done.notify_all();
+		}
+	}
+
+	running_task = was_running;
+}
+
+void Thread_Pool::worker_loop() {
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_job_available.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_stop) return;
+
+			job = m_jobs.front();
+			// every chunk has been claimed, the job no longer needs new workers
+			if (job->next_chunk >= job->n_chunks) {
+				m_jobs.pop_front();
+				continue;
+			}
+		}
+		run_chunks(*job);
+	}
+}
+
+void Thread_Pool::parallel_for(std::size_t count, std::size_t grain,
+                               const std::function<void(std::size_t, std::size_t)>& task) {
+	if (count == 0) return;
+	grain = std::max<std::size_t>(grain, 1);
+
+	if (m_workers.empty() || running_task || count <= grain) {
+		task(0, count);
+		return;
+	}
+
+	auto job = std::make_shared<Job>();
+	job->task = &task;
+	job->count = count;
+	job->grain = grain;
+	job->n_chunks = (count+grain-1)/grain;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_job_available.notify_all();
+
+	run_chunks(*job);
+
+	std::unique_lock<std::mutex> lock(job->mutex);
+	job->done.wait(lock, [&] { return job->completed_chunks == job->n_chunks; });
+	if (job->exception) std::rethrow_exception(job->exception);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed size pool of worker threads which split loops into chunks.
+ * The thread calling parallel_for also works on the loop, so a pool of size n
+ * creates n-1 worker threads. Loops started from inside a running task are
+ * executed serially by the calling thread so nested parallelism cannot deadlock.
+ */
+class Thread_Pool {
+public:
+	// n_threads = 0 uses one thread per hardware thread
+	explicit Thread_Pool(std::size_t n_threads = 0);
+	Thread_Pool(const Thread_Pool& other) = delete;
+
+	~Thread_Pool();
+
+	Thread_Pool& operator=(const Thread_Pool& other) = delete;
+
+	/**
+	 * Calls task(begin, end) on disjoint ranges which together cover [0, count).
+	 * Each range holds at least grain items except possibly the last.
+	 * Returns once every range has completed, rethrowing the first exception thrown by a task.
+	 */
+	void parallel_for(std::size_t count, std::size_t grain,
+	                  const std::function<void(std::size_t, std::size_t)>& task);
+
+	// the number of threads that work on a loop, including the calling thread
+	std::size_t size() const noexcept { return m_workers.size()+1; }
+
+	// true if the calling thread is currently running a task of any pool
+	static bool in_task() noexcept;
+
+private:
+	struct Job;
+
+	void worker_loop();
+	static void run_chunks(Job& job);
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::shared_ptr<Job>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_job_available;
+	bool m_stop = false;
+};
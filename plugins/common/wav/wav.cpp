@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <vector>
+#include "wav.hpp"
+
+template <typename T>
+static T read_le(const char* data) {
+	T value;
+	std::memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+std::size_t sample_bytes(Sample_Format format) {
+	switch (format) {
+		case Sample_Format::pcm16: return 2;
+		case Sample_Format::pcm24: return 3;
+		case Sample_Format::pcm32: return 4;
+		case Sample_Format::float32: return 4;
+		case Sample_Format::float64: return 8;
+	}
+	return 0;
+}
+
+bool parse_wav_header(const char* header, std::size_t header_size, std::uint64_t file_size, Wav_Layout& layout) {
+	const bool complete = header_size >= file_size;
+	const std::uint64_t end = std::min<std::uint64_t>(header_size, file_size);
+
+	// the offsets of the contents of the fmt and data chunks
+	std::uint64_t fmt_chunk = 0, data_chunk = 0;
+	std::uint64_t fmt_size = 0, data_size = 0;
+	if (end >= 40 && !std::memcmp(header, w64_riff, w64_guid_size) && !std::memcmp(header+24, w64_wave, w64_guid_size)) {
+		// wave64 chunks have a 16 byte guid and a 64 bit size which includes the header,
+		// they are aligned to 8 bytes
+		for (std::uint64_t chunk = 40; chunk + 24 <= end;) {
+			const char* id = header + chunk;
+			const std::uint64_t chunk_size = read_le<std::uint64_t>(id+16);
+			if (chunk_size < 24) break;
+			const std::uint64_t size = std::min<std::uint64_t>(chunk_size-24, file_size-chunk-24);
+			if (!std::memcmp(id, w64_fmt, w64_guid_size)) {
+				fmt_chunk = chunk+24;
+				fmt_size = size;
+			} else if (!std::memcmp(id, w64_data, w64_guid_size)) {
+				data_chunk = chunk+24;
+				data_size = size;
+			}
+			if (size < chunk_size-24) break;
+			chunk += (24 + size + 7)/8*8;
+		}
+	} else {
+		if (end < 12) {
+			if (!complete) return false;
+			throw std::runtime_error("input file is not a valid wav file: incorrect chunk id");
+		}
+		if (std::memcmp(header, "RIFF", 4) && std::memcmp(header, "RF64", 4))
+			throw std::runtime_error("input file is not a valid wav file: incorrect chunk id");
+		if (std::memcmp(header+8, "WAVE", 4))
+			throw std::runtime_error("input file is not a valid wav file: incorrect wave id");
+
+		// in rf64 files the size of the data chunk is replaced by 0xFFFFFFFF and stored in the ds64 chunk
+		const bool rf64 = !std::memcmp(header, "RF64", 4);
+		std::uint64_t ds64_data_size = 0;
+		for (std::uint64_t chunk = 12; chunk + 8 <= end;) {
+			const char* id = header + chunk;
+			std::uint64_t chunk_size = read_le<std::uint32_t>(id+4);
+			if (!std::memcmp(id, "ds64", 4) && chunk_size >= 24 && chunk + 32 <= end) {
+				ds64_data_size = read_le<std::uint64_t>(id+16);
+			} else if (!std::memcmp(id, "data", 4)) {
+				// a size of 0 or 0xFFFFFFFF is left by writers which never finalised the file
+				if (rf64 && chunk_size == UINT32_MAX) chunk_size = ds64_data_size;
+				else if (chunk_size == 0 || chunk_size == UINT32_MAX) chunk_size = file_size-chunk-8;
+			}
+
+			const std::uint64_t size = std::min<std::uint64_t>(chunk_size, file_size-chunk-8);
+			if (!std::memcmp(id, "fmt ", 4)) {
+				fmt_chunk = chunk+8;
+				fmt_size = size;
+			} else if (!std::memcmp(id, "data", 4)) {
+				data_chunk = chunk+8;
+				data_size = size;
+			}
+			chunk += 8 + size + (size & 1);
+		}
+	}
+
+	// the fields which are read from the fmt chunk must be in the header
+	const bool have_fmt = fmt_chunk && fmt_chunk + std::min<std::uint64_t>(fmt_size, 40) <= end;
+	if (!complete && (!have_fmt || !data_chunk)) return false;
+	if (!have_fmt || fmt_size < 16)
+		throw std::runtime_error("wav file is missing fmt chunk");
+	if (!data_chunk)
+		throw std::runtime_error("wav file is missing data chunk");
+
+	const char* fmt = header + fmt_chunk;
+	std::uint16_t audio_format = read_le<std::uint16_t>(fmt);
+	const std::uint16_t channels = read_le<std::uint16_t>(fmt+2);
+	const std::uint16_t bits_per_sample = read_le<std::uint16_t>(fmt+14);
+	// WAVE_FORMAT_EXTENSIBLE stores the format in the first 2 bytes of the sub format guid
+	if (audio_format == 0xFFFE && fmt_size >= 40) audio_format = read_le<std::uint16_t>(fmt+24);
+
+	if (audio_format == 1 && bits_per_sample == 16) layout.format = Sample_Format::pcm16;
+	else if (audio_format == 1 && bits_per_sample == 24) layout.format = Sample_Format::pcm24;
+	else if (audio_format == 1 && bits_per_sample == 32) layout.format = Sample_Format::pcm32;
+	else if (audio_format == 3 && bits_per_sample == 32) layout.format = Sample_Format::float32;
+	else if (audio_format == 3 && bits_per_sample == 64) layout.format = Sample_Format::float64;
+	else throw std::runtime_error("only wav files with 16, 24 or 32 bit pcm or 32 or 64 bit IEEE floating point data are supported!");
+	if (!channels)
+		throw std::runtime_error("input file is not a valid wav file: no channels");
+
+	layout.channels = channels;
+	layout.sample_rate = read_le<std::uint32_t>(fmt+4);
+	layout.data_offset = data_chunk;
+	layout.data_size = data_size;
+	return true;
+}
+
+Wav_Layout read_wav_layout(std::istream& file) {
+	file.seekg(0, std::ios::end);
+	const std::uint64_t file_size = static_cast<std::uint64_t>(file.tellg());
+
+	Wav_Layout layout;
+	std::vector<char> header;
+	for (std::size_t header_size = std::size_t(1) << 16;; header_size *= 2) {
+		header.resize(static_cast<std::size_t>(std::min<std::uint64_t>(header_size, file_size)));
+		file.seekg(0);
+		if (!file.read(header.data(), static_cast<std::streamsize>(header.size())))
+			throw std::runtime_error("unable to read the wav header");
+		if (parse_wav_header(header.data(), header.size(), file_size, layout)) return layout;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+/**
+ * The layout of wav, rf64 and sony wave64 files, shared by the host and the plugins which
+ * read audio files so that they accept the same files
+ */
+
+enum class Sample_Format {
+	pcm16,
+	pcm24,
+	pcm32,
+	float32,
+	float64
+};
+
+// the size in bytes of a sample stored in format
+std::size_t sample_bytes(Sample_Format format);
+
+// riff chunks store their size in 32 bits, larger sizes are stored in the ds64 chunk of rf64 files
+inline constexpr std::uint64_t riff_size_limit = UINT32_MAX;
+
+// the ids of sony wave64 chunks are guids, all but the riff guid start with the riff chunk id
+inline constexpr char w64_riff[] = "riff\x2E\x91\xCF\x11\xA5\xD6\x28\xDB\x04\xC1\x00\x00";
+inline constexpr char w64_wave[] = "wave\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+inline constexpr char w64_fmt[] = "fmt \xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+inline constexpr char w64_fact[] = "fact\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+inline constexpr char w64_data[] = "data\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+inline constexpr std::size_t w64_guid_size = 16;
+
+struct Wav_Layout {
+	Sample_Format format;
+	std::size_t channels;
+	double sample_rate;
+	// the position of the first sample and the size of the samples in bytes
+	std::uint64_t data_offset;
+	std::uint64_t data_size;
+
+	std::uint64_t frames() const noexcept { return data_size/(sample_bytes(format)*channels); }
+};
+
+/**
+ * Finds the fmt and data chunks of a file of file_size bytes whose first header_size bytes are
+ * in header. The sizes are clamped to the end of the file so files whose header was never
+ * finalised can still be read.
+ * Returns false if header ends before the chunks were found, so the file can be read in pieces
+ * and parsed again with more of it. Throws std::runtime_error if the file is not a wav, rf64 or
+ * wave64 file or its sample format is not supported.
+ */
+bool parse_wav_header(const char* header, std::size_t header_size, std::uint64_t file_size, Wav_Layout& layout);
+
+/**
+ * Reads the header of the file open in file, which must be seekable, with twice as many bytes
+ * each time until parse_wav_header finds the chunks. The samples are not read.
+ */
+Wav_Layout read_wav_layout(std::istream& file);